@@ -49,7 +49,7 @@ int main() {
 	printf("CPL-1 uses GPLv3 license. Its full text is in \"/etc/src/COPYING\" file.\n\n");
 	Log_InfoMsg("Init Process", "Up and running. Starting shell");
 	while (true) {
-		int pid = fork();
+		int pid = vfork();
 		if (pid == 0) {
 			char const *argv[] = {NULL};
 			char const *envp[] = {NULL};
@@ -25,6 +25,12 @@ static INLINE uint32_t i686_CPU_SetCR0(uint32_t val) {
 	return val;
 }
 
+static INLINE uint32_t i686_CPU_GetCR2() {
+	uint32_t val;
+	asm VOLATILE("mov %%cr2, %0" : "=r"(val));
+	return val;
+}
+
 static INLINE uint32_t i686_CPU_GetCR4() {
 	uint32_t val;
 	asm VOLATILE("mov %%cr4, %0" : "=r"(val));
@@ -36,6 +42,20 @@ static INLINE uint32_t i686_CPU_SetCR4(uint32_t val) {
 	return val;
 }
 
+static INLINE void i686_CPU_CPUID(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+	asm VOLATILE("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static INLINE uint64_t i686_CPU_ReadMSR(uint32_t msr) {
+	uint32_t low, high;
+	asm VOLATILE("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+	return ((uint64_t)high << 32) | low;
+}
+
+static INLINE void i686_CPU_WriteMSR(uint32_t msr, uint64_t val) {
+	asm VOLATILE("wrmsr" : : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
 static INLINE void i686_CPU_InvalidatePage(uint32_t vaddr) {
 	asm VOLATILE("invlpg (%0)" : : "b"(vaddr) : "memory");
 }
@@ -11,12 +11,15 @@ m_bootStackBottom:
 resb 65536
 m_bootStackTop:
 m_bootStackTopPhys: equ m_bootStackTop - KERNEL_MAPPING_BASE
-m_bootPageTableDirectory:
+m_bootPageDirectoryPointerTable:
 resb 4096
-m_bootPageTableDirectoryPhys: equ m_bootPageTableDirectory - KERNEL_MAPPING_BASE
-m_bootPageTable:
+m_bootPageDirectoryPointerTablePhys: equ m_bootPageDirectoryPointerTable - KERNEL_MAPPING_BASE
+m_bootPageDirectory:
 resb 4096
-m_bootPageTablePhys: equ m_bootPageTable - KERNEL_MAPPING_BASE
+m_bootPageDirectoryPhys: equ m_bootPageDirectory - KERNEL_MAPPING_BASE
+m_bootPageTables:
+resb 8192
+m_bootPageTablesPhys: equ m_bootPageTables - KERNEL_MAPPING_BASE
 
 section .stivalehdr
 dd m_bootStackTopPhys
@@ -31,7 +34,15 @@ section .inittext
 i686_Stivale_EntryPoint:
     pop ebx
     pop ebx
-    mov edi, m_bootPageTablePhys
+    ; kernel uses PAE page tables, there is no way to report missing support this early
+    push ebx
+    mov eax, 1
+    cpuid
+    pop ebx
+    test edx, 1 << 6
+    jz .no_pae
+    ; two PAE page tables map the first 4 MiB with 8 byte entries
+    mov edi, m_bootPageTablesPhys
     xor esi, esi
     mov ecx, 1024
 .mapping_loop:
@@ -40,21 +51,35 @@ i686_Stivale_EntryPoint:
     mov edx, esi
     or edx, 0b11
     mov dword [edi], edx
+    mov dword [edi + 4], 0
     add esi, 0x1000
-    add edi, 4
+    add edi, 8
     dec ecx
     jmp .mapping_loop
 .mapping_done:
-    mov ebp, m_bootPageTablePhys
+    mov ebp, m_bootPageTablesPhys
     or ebp, 0b11
-    mov dword [m_bootPageTableDirectoryPhys], ebp
-    mov dword [m_bootPageTableDirectoryPhys + 768 * 4], ebp
-    mov ecx, m_bootPageTableDirectoryPhys
+    mov dword [m_bootPageDirectoryPhys], ebp
+    add ebp, 0x1000
+    mov dword [m_bootPageDirectoryPhys + 8], ebp
+    ; identity and higher half mappings share the directory. Pointer table entries only have present bit
+    mov ebp, m_bootPageDirectoryPhys
+    or ebp, 0b1
+    mov dword [m_bootPageDirectoryPointerTablePhys], ebp
+    mov dword [m_bootPageDirectoryPointerTablePhys + 3 * 8], ebp
+    mov ecx, cr4
+    or ecx, 1 << 5
+    mov cr4, ecx
+    mov ecx, m_bootPageDirectoryPointerTablePhys
     mov cr3, ecx
     mov ecx, cr0
     or ecx, 0x80010000
     mov cr0, ecx
     jmp i686_higher_half_start
+.no_pae:
+    cli
+    hlt
+    jmp .no_pae
 
 section .text
 i686_higher_half_start:
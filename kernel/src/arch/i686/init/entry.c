@@ -18,6 +18,8 @@
 #include <arch/i686/proc/ring1.h>
 #include <arch/i686/proc/ring3.h>
 #include <arch/i686/proc/state.h>
+#include <common/core/devices/heapprof.h>
+#include <common/core/devices/memstat.h>
 #include <common/core/devices/tty.h>
 #include <common/core/fd/fdtable.h>
 #include <common/core/fd/fs/devfs.h>
@@ -28,6 +30,7 @@
 #include <common/core/memory/iomap.h>
 #include <common/core/memory/msecurity.h>
 #include <common/core/memory/virt.h>
+#include <common/core/memory/zeropool.h>
 #include <common/core/proc/elf32.h>
 #include <common/core/proc/proc.h>
 #include <common/core/proc/proclayout.h>
@@ -52,6 +55,7 @@ void i686_KernelInit_URMThreadFunction() {
 	while (true) {
 		while (Proc_PollDisposeQueue()) {
 		}
+		ZeroPool_Refill();
 		ASM VOLATILE("pause");
 		Proc_Yield();
 	}
@@ -75,10 +79,14 @@ void i686_KernelInit_Main(uint32_t mb_offset) {
 	KernelLog_InitDoneMsg("i686 Physical Memory Allocator");
 	i686_VirtualMM_InitializeKernelMap();
 	KernelLog_InitDoneMsg("i686 Virtual Memory Mapper");
+	i686_PhysicalMM_InitializeBuddyAllocator();
+	KernelLog_InitDoneMsg("i686 Buddy Frame Allocator");
 	Heap_Initialize();
 	KernelLog_InitDoneMsg("Kernel Heap Heap");
 	IOMap_Initialize();
 	KernelLog_InitDoneMsg("IO Mapping Manager");
+	ZeroPool_Initialize();
+	KernelLog_InitDoneMsg("Zeroed Frames Pool");
 	i686_IOWait_Initialize();
 	KernelLog_InitDoneMsg("i686 IO Wait Subsystem");
 	i686_IDT_Initialize();
@@ -156,6 +164,10 @@ void i686_KernelInit_ExecuteInitProcess() {
 	KernelLog_InfoMsg("i686 Kernel Init", "Remounted Device Filesystem on /dev/");
 	TTYDevice_Register();
 	KernelLog_InitDoneMsg("TTY Character Device Driver");
+	MemStatDevice_Register();
+	KernelLog_InitDoneMsg("Memory Statistics Device");
+	HeapProfDevice_Register();
+	KernelLog_InitDoneMsg("Heap Profiler Device");
 	KernelLog_InfoMsg("i686 Kernel Init", "Loading \"/sbin/init\" executable");
 	struct File *file = VFS_Open("/sbin/init", VFS_O_RDONLY);
 	if (file == NULL) {
@@ -165,14 +177,15 @@ void i686_KernelInit_ExecuteInitProcess() {
 	if (elf == NULL) {
 		KernelLog_ErrorMsg("i686 Kernel Init", "Failed to parse init binary");
 	}
-	if (!Elf32_LoadProgramHeaders(file, elf)) {
+	if (!Elf32_LoadProgramHeaders(VirtualMM_GetCurrentAddressSpace(), file, elf)) {
 		KernelLog_ErrorMsg("i686 Kernel Init", "Failed to load init binary in memory");
 	}
 	File_Drop(file);
 	KernelLog_InfoMsg("i686 Kernel Init", "Init binary is loaded. Mapping memory stack");
 	struct VirtualMM_MemoryRegionNode *node =
-		VirtualMM_MemoryMap(NULL, 0, INIT_PROCESS_STACK_SIZE,
-							HAL_VIRT_FLAGS_WRITABLE | HAL_VIRT_FLAGS_USER_ACCESSIBLE | HAL_VIRT_FLAGS_READABLE, true);
+		VirtualMM_MemoryMapZeroed(NULL, 0, INIT_PROCESS_STACK_SIZE,
+								  HAL_VIRT_FLAGS_WRITABLE | HAL_VIRT_FLAGS_USER_ACCESSIBLE | HAL_VIRT_FLAGS_READABLE,
+								  true);
 	if (node->base.start == 0) {
 		KernelLog_ErrorMsg("i686 Kernel Init", "Failed to map stack for init process");
 	}
@@ -190,7 +203,6 @@ void i686_KernelInit_ExecuteInitProcess() {
 	// [ char **argv  ] // arguments
 	// [ int argc = 0 ]
 	// [ libc will push pointer here ]
-	memset((void *)(node->base.start), 0, node->base.size);
 	*(uint32_t *)(node->base.end - 28) = 0;					  // argc = 0;
 	*(uint32_t *)(node->base.end - 24) = node->base.end - 16; // argv
 	*(uint32_t *)(node->base.end - 20) = node->base.end - 12; // envp
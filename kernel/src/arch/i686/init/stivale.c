@@ -3,6 +3,7 @@
 #include <common/lib/kmsg.h>
 
 #define STIVALE_MOD_NAME "i686 Stivale Parser"
+#define STIVALE_CMDLINE_MAX 256
 
 struct i686_Stivale_BootInfo {
 	uint64_t cmdline;
@@ -21,12 +22,49 @@ struct i686_Stivale_BootInfo {
 };
 
 static struct i686_Stivale_BootInfo m_StivaleInfo;
+static char m_cmdline[STIVALE_CMDLINE_MAX];
 
 void i686_Stivale_Initialize(uint32_t phys_info) {
 	if (phys_info + sizeof(struct i686_Stivale_BootInfo) > I686_KERNEL_INIT_MAPPING_SIZE) {
 		KernelLog_ErrorMsg(STIVALE_MOD_NAME, "Stivale information is not visible from boot kernel mapping");
 	}
 	m_StivaleInfo = *(struct i686_Stivale_BootInfo *)(phys_info + I686_KERNEL_MAPPING_BASE);
+	m_cmdline[0] = '\0';
+	if (m_StivaleInfo.cmdline == 0) {
+		return;
+	}
+	if (m_StivaleInfo.cmdline + STIVALE_CMDLINE_MAX > (uint64_t)I686_KERNEL_INIT_MAPPING_SIZE) {
+		KernelLog_WarnMsg(STIVALE_MOD_NAME, "Kernel command line is not visible from boot kernel mapping");
+		return;
+	}
+	const char *cmdline = (const char *)((uint32_t)(m_StivaleInfo.cmdline) + I686_KERNEL_MAPPING_BASE);
+	size_t i = 0;
+	for (; i < STIVALE_CMDLINE_MAX - 1 && cmdline[i] != '\0'; ++i) {
+		m_cmdline[i] = cmdline[i];
+	}
+	m_cmdline[i] = '\0';
+}
+
+bool i686_Stivale_HasCommandLineOption(const char *option) {
+	size_t optionLength = strlen(option);
+	const char *current = m_cmdline;
+	while (*current != '\0') {
+		while (*current == ' ') {
+			++current;
+		}
+		size_t length = 0;
+		while (current[length] != '\0' && current[length] != ' ' && current[length] == option[length]) {
+			++length;
+		}
+		if (length == optionLength && (current[length] == '\0' || current[length] == ' ')) {
+			return true;
+		}
+		while (current[length] != '\0' && current[length] != ' ') {
+			++length;
+		}
+		current += length;
+	}
+	return false;
 }
 
 bool i686_Stivale_GetMemoryMap(struct i686_Stivale_MemoryMap *buf) {
@@ -36,5 +36,6 @@ struct i686_Stivale_MemoryMap {
 void i686_Stivale_Initialize(uint32_t phys_info);
 bool i686_Stivale_GetMemoryMap(struct i686_Stivale_MemoryMap *buf);
 bool i686_Stivale_GetFramebufferInfo(struct i686_Stivale_FramebufferInfo *buf);
+bool i686_Stivale_HasCommandLineOption(const char *option);
 
 #endif
@@ -4,11 +4,16 @@
 #define I686_KERNEL_MAPPING_BASE 0xC0000000U
 #define I686_KERNEL_INIT_MAPPING_SIZE 0x400000U
 #define I686_PAGE_SIZE 0x1000U
+#define I686_LARGE_PAGE_SIZE 0x200000U
 #define I686_KERNEL_IGNORED_AREA_SIZE 0x100000U
 #define I686_PHYS_LOW_LIMIT 0x30000000U
+#define I686_PHYS_HIGH_LIMIT 0x400000000ULL
+#define I686_PHYS_ORDERS_COUNT 11
 #define I686_USER_AREA_START 0x1000
 #define I686_USER_AREA_END I686_KERNEL_MAPPING_BASE
 #define I686_IOMAP_AREA_START 0xf0000000
 #define I686_IOMAP_AREA_END 0xff000000
+#define I686_TEMP_MAPPING_AREA_START 0xff000000U
+#define I686_TEMP_MAPPING_SLOTS 64
 
 #endif
@@ -6,15 +6,30 @@
 #include <hal/memory/phys.h>
 
 #define PHYS_MOD_NAME "i686 Physical Memory Manager"
+#define I686_PHYS_NO_FRAME 0xffffffffU
+#define I686_PHYS_NOT_FREE 0xff
+
+struct i686_PhysicalMM_BuddyFrame {
+	uint32_t next;
+	uint32_t prev;
+	uint8_t order;
+};
 
 extern uint32_t i686_PhysicalMM_KernelEnd;
-static uint32_t m_bitmap[0x5000];
+static uint32_t m_bitmap[ALIGN_UP(I686_PHYS_HIGH_LIMIT / I686_PAGE_SIZE, 32) / 32];
 static uint32_t m_lowArenaMinIndex = I686_KERNEL_IGNORED_AREA_SIZE / I686_PAGE_SIZE;
 static uint32_t m_lowArenaMaxIndex = I686_PHYS_LOW_LIMIT / I686_PAGE_SIZE;
 static uint32_t m_highArenaMinIndex = I686_PHYS_LOW_LIMIT / I686_PAGE_SIZE;
-static uint32_t m_highArenaMaxIndex = 0xa0000;
+static uint32_t m_highArenaMaxIndex = I686_PHYS_HIGH_LIMIT / I686_PAGE_SIZE;
 static struct Mutex m_mutex;
-uint32_t m_memoryLimit;
+static struct i686_PhysicalMM_BuddyFrame *m_frames = NULL;
+static uint32_t m_framesCount = 0;
+static uint32_t m_freeLists[HAL_PHYS_ARENAS_COUNT][I686_PHYS_ORDERS_COUNT];
+static size_t m_freeBlocksCount[HAL_PHYS_ARENAS_COUNT][I686_PHYS_ORDERS_COUNT];
+static bool m_buddyInitialized = false;
+uint64_t m_memoryLimit;
+
+const size_t HAL_PhysicalMM_OrdersCount = I686_PHYS_ORDERS_COUNT;
 
 static void i686_PhysicalMM_SetBit(uint32_t index) {
 	m_bitmap[index / 32] |= (1U << (index % 32));
@@ -24,16 +39,15 @@ static void i686_PhysicalMM_ClearBit(uint32_t index) {
 	m_bitmap[index / 32] &= ~(1U << (index % 32));
 }
 
-static void i686_PhysicalMM_ClearRange(uint32_t start, uint32_t size) {
-	uint32_t end = start + size;
-	for (uint32_t i = (start / I686_PAGE_SIZE); i < (end / I686_PAGE_SIZE); ++i) {
+// Ranges are given in frames, as byte addresses of frames above 4 GiB do not fit into 32 bits
+static void i686_PhysicalMM_ClearRange(uint32_t start, uint32_t count) {
+	for (uint32_t i = start; i < start + count; ++i) {
 		i686_PhysicalMM_ClearBit(i);
 	}
 }
 
-static void i686_PhysicalMM_SetRange(uint32_t start, uint32_t size) {
-	uint32_t end = start + size;
-	for (uint32_t i = (start / I686_PAGE_SIZE); i < (end / I686_PAGE_SIZE); ++i) {
+static void i686_PhysicalMM_SetRange(uint32_t start, uint32_t count) {
+	for (uint32_t i = start; i < start + count; ++i) {
 		i686_PhysicalMM_SetBit(i);
 	}
 }
@@ -42,34 +56,147 @@ static bool i686_PhysicalMM_GetBit(uint32_t index) {
 	return (m_bitmap[index / 32] & (1U << (index % 32))) != 0;
 }
 
-uint32_t i686_PhysicalMM_KernelAllocFrame() {
-	Mutex_Lock(&m_mutex);
+static INLINE int i686_PhysicalMM_GetArena(uint32_t index) {
+	if (index < I686_PHYS_LOW_LIMIT / I686_PAGE_SIZE) {
+		return HAL_PHYS_ARENA_KERNEL;
+	}
+	return HAL_PHYS_ARENA_USER;
+}
+
+static uint8_t i686_PhysicalMM_GetOrder(uint32_t framesCount) {
+	uint8_t order = 0;
+	while ((1U << order) < framesCount) {
+		++order;
+	}
+	return order;
+}
+
+static void i686_PhysicalMM_PushBlock(uint32_t index, uint8_t order) {
+	int arena = i686_PhysicalMM_GetArena(index);
+	struct i686_PhysicalMM_BuddyFrame *frame = m_frames + index;
+	frame->order = order;
+	frame->prev = I686_PHYS_NO_FRAME;
+	frame->next = m_freeLists[arena][order];
+	if (frame->next != I686_PHYS_NO_FRAME) {
+		m_frames[frame->next].prev = index;
+	}
+	m_freeLists[arena][order] = index;
+	m_freeBlocksCount[arena][order]++;
+}
+
+static void i686_PhysicalMM_RemoveBlock(uint32_t index) {
+	int arena = i686_PhysicalMM_GetArena(index);
+	struct i686_PhysicalMM_BuddyFrame *frame = m_frames + index;
+	uint8_t order = frame->order;
+	if (frame->prev != I686_PHYS_NO_FRAME) {
+		m_frames[frame->prev].next = frame->next;
+	} else {
+		m_freeLists[arena][order] = frame->next;
+	}
+	if (frame->next != I686_PHYS_NO_FRAME) {
+		m_frames[frame->next].prev = frame->prev;
+	}
+	frame->order = I686_PHYS_NOT_FREE;
+	m_freeBlocksCount[arena][order]--;
+}
+
+static void i686_PhysicalMM_BuddyFreeBlock(uint32_t index, uint8_t order) {
+	int arena = i686_PhysicalMM_GetArena(index);
+	while (order + 1 < I686_PHYS_ORDERS_COUNT) {
+		uint32_t buddy = index ^ (1U << order);
+		if (buddy >= m_framesCount || m_frames[buddy].order != order || i686_PhysicalMM_GetArena(buddy) != arena) {
+			break;
+		}
+		i686_PhysicalMM_RemoveBlock(buddy);
+		index &= ~(1U << order);
+		++order;
+	}
+	i686_PhysicalMM_PushBlock(index, order);
+}
+
+static void i686_PhysicalMM_BuddyFreeRange(uint32_t start, uint32_t count) {
+	while (count > 0) {
+		uint8_t order = 0;
+		while (order + 1 < I686_PHYS_ORDERS_COUNT && (start & ((1U << (order + 1)) - 1)) == 0 &&
+			   (1U << (order + 1)) <= count) {
+			++order;
+		}
+		i686_PhysicalMM_BuddyFreeBlock(start, order);
+		start += (1U << order);
+		count -= (1U << order);
+	}
+}
+
+static uint32_t i686_PhysicalMM_BuddyAllocateBlock(int arena, uint8_t order) {
+	uint8_t current = order;
+	while (current < I686_PHYS_ORDERS_COUNT && m_freeLists[arena][current] == I686_PHYS_NO_FRAME) {
+		++current;
+	}
+	if (current == I686_PHYS_ORDERS_COUNT) {
+		return I686_PHYS_NO_FRAME;
+	}
+	uint32_t index = m_freeLists[arena][current];
+	i686_PhysicalMM_RemoveBlock(index);
+	while (current > order) {
+		--current;
+		i686_PhysicalMM_PushBlock(index + (1U << current), current);
+	}
+	return index;
+}
+
+static uint32_t i686_PhysicalMM_BuddyAllocateHuge(int arena, uint32_t framesCount) {
+	const uint8_t maxOrder = I686_PHYS_ORDERS_COUNT - 1;
+	const uint32_t blocksNeeded = ALIGN_UP(framesCount, 1U << maxOrder) >> maxOrder;
+	uint32_t start = (arena == HAL_PHYS_ARENA_KERNEL) ? 0 : m_highArenaMinIndex;
+	uint32_t end = (arena == HAL_PHYS_ARENA_KERNEL) ? m_lowArenaMaxIndex : m_highArenaMaxIndex;
+	uint32_t runStart = ALIGN_UP(start, 1U << maxOrder);
+	uint32_t runLength = 0;
+	for (uint32_t index = runStart; index + (1U << maxOrder) <= end; index += (1U << maxOrder)) {
+		if (m_frames[index].order != maxOrder) {
+			runStart = index + (1U << maxOrder);
+			runLength = 0;
+			continue;
+		}
+		++runLength;
+		if (runLength == blocksNeeded) {
+			for (uint32_t i = 0; i < blocksNeeded; ++i) {
+				i686_PhysicalMM_RemoveBlock(runStart + (i << maxOrder));
+			}
+			return runStart;
+		}
+	}
+	return I686_PHYS_NO_FRAME;
+}
+
+static uint32_t i686_PhysicalMM_BuddyAllocate(int arena, uint32_t framesCount) {
+	uint8_t order = i686_PhysicalMM_GetOrder(framesCount);
+	uint32_t index;
+	if (order < I686_PHYS_ORDERS_COUNT) {
+		index = i686_PhysicalMM_BuddyAllocateBlock(arena, order);
+	} else {
+		index = i686_PhysicalMM_BuddyAllocateHuge(arena, framesCount);
+	}
+	if (index == I686_PHYS_NO_FRAME) {
+		return I686_PHYS_NO_FRAME;
+	}
+	uint32_t allocated = (order < I686_PHYS_ORDERS_COUNT) ? (1U << order)
+														 : ALIGN_UP(framesCount, 1U << (I686_PHYS_ORDERS_COUNT - 1));
+	i686_PhysicalMM_BuddyFreeRange(index + framesCount, allocated - framesCount);
+	i686_PhysicalMM_SetRange(index, framesCount);
+	return index;
+}
+
+static uint32_t i686_PhysicalMM_BootstrapAllocFrame() {
 	for (; m_lowArenaMinIndex < m_lowArenaMaxIndex; ++m_lowArenaMinIndex) {
 		if (!i686_PhysicalMM_GetBit(m_lowArenaMinIndex)) {
 			i686_PhysicalMM_SetBit(m_lowArenaMinIndex);
-			Mutex_Unlock(&m_mutex);
 			return m_lowArenaMinIndex * I686_PAGE_SIZE;
 		}
 	}
-	Mutex_Unlock(&m_mutex);
 	return 0;
 }
 
-uintptr_t HAL_PhysicalMM_UserAllocFrame() {
-	Mutex_Lock(&m_mutex);
-	for (; m_highArenaMinIndex < m_highArenaMaxIndex; ++m_highArenaMinIndex) {
-		if (!i686_PhysicalMM_GetBit(m_highArenaMinIndex)) {
-			i686_PhysicalMM_SetBit(m_highArenaMinIndex);
-			Mutex_Unlock(&m_mutex);
-			return m_highArenaMinIndex * I686_PAGE_SIZE;
-		}
-	}
-	Mutex_Unlock(&m_mutex);
-	return i686_PhysicalMM_KernelAllocFrame();
-}
-
-uintptr_t HAL_PhysicalMM_KernelAllocArea(size_t size) {
-	Mutex_Lock(&m_mutex);
+static uint32_t i686_PhysicalMM_BootstrapAllocArea(size_t size) {
 	const uint32_t framesNeeded = size / I686_PAGE_SIZE;
 	uint32_t freeFrames = 0;
 	uint32_t resultIndex = m_lowArenaMinIndex;
@@ -82,54 +209,204 @@ uintptr_t HAL_PhysicalMM_KernelAllocArea(size_t size) {
 			++freeFrames;
 		}
 		if (freeFrames >= framesNeeded) {
-			i686_PhysicalMM_SetRange(resultIndex * I686_PAGE_SIZE, size);
+			i686_PhysicalMM_SetRange(resultIndex, framesNeeded);
 			if (resultIndex == m_lowArenaMinIndex) {
 				m_lowArenaMinIndex += framesNeeded;
 			}
-			Mutex_Unlock(&m_mutex);
 			return resultIndex * I686_PAGE_SIZE;
 		}
 		++currentIndex;
 	}
-	Mutex_Unlock(&m_mutex);
 	return 0;
 }
 
-static void i686_PhysicalMM_FreeFrame(uint32_t frame) {
-	uint32_t index = frame / I686_PAGE_SIZE;
-	if (index < m_lowArenaMaxIndex) {
+uint32_t i686_PhysicalMM_KernelAllocFrame() {
+	Mutex_Lock(&m_mutex);
+	if (!m_buddyInitialized) {
+		uint32_t result = i686_PhysicalMM_BootstrapAllocFrame();
+		Mutex_Unlock(&m_mutex);
+		return result;
+	}
+	uint32_t index = i686_PhysicalMM_BuddyAllocate(HAL_PHYS_ARENA_KERNEL, 1);
+	Mutex_Unlock(&m_mutex);
+	if (index == I686_PHYS_NO_FRAME) {
+		return 0;
+	}
+	return index * I686_PAGE_SIZE;
+}
+
+HAL_PhysicalMM_Address HAL_PhysicalMM_UserAllocFrame() {
+	Mutex_Lock(&m_mutex);
+	if (m_buddyInitialized) {
+		uint32_t index = i686_PhysicalMM_BuddyAllocate(HAL_PHYS_ARENA_USER, 1);
+		if (index != I686_PHYS_NO_FRAME) {
+			Mutex_Unlock(&m_mutex);
+			return (HAL_PhysicalMM_Address)index * I686_PAGE_SIZE;
+		}
+	}
+	Mutex_Unlock(&m_mutex);
+	return i686_PhysicalMM_KernelAllocFrame();
+}
+
+static void i686_PhysicalMM_FreeFrames(HAL_PhysicalMM_Address frame, uint32_t count) {
+	uint32_t index = (uint32_t)(frame / I686_PAGE_SIZE);
+	for (uint32_t i = index; i < index + count; ++i) {
+		if (!i686_PhysicalMM_GetBit(i)) {
+			KernelLog_ErrorMsg(PHYS_MOD_NAME, "Physical memory corruption detected");
+		}
+		i686_PhysicalMM_ClearBit(i);
+	}
+	if (!m_buddyInitialized) {
 		if (index < m_lowArenaMinIndex) {
 			m_lowArenaMinIndex = index;
 		}
-	} else {
-		if (index < m_highArenaMinIndex) {
-			m_highArenaMinIndex = index;
+		return;
+	}
+	i686_PhysicalMM_BuddyFreeRange(index, count);
+}
+
+static bool i686_PhysicalMM_AllocFramesFromArena(int arena, HAL_PhysicalMM_Address *frames, size_t count,
+												 size_t *allocated) {
+	uint8_t order = I686_PHYS_ORDERS_COUNT - 1;
+	while (*allocated < count) {
+		while ((1U << order) > count - *allocated) {
+			--order;
+		}
+		uint32_t index = i686_PhysicalMM_BuddyAllocateBlock(arena, order);
+		while (index == I686_PHYS_NO_FRAME && order > 0) {
+			--order;
+			index = i686_PhysicalMM_BuddyAllocateBlock(arena, order);
+		}
+		if (index == I686_PHYS_NO_FRAME) {
+			return false;
+		}
+		i686_PhysicalMM_SetRange(index, 1U << order);
+		for (uint32_t i = 0; i < (1U << order); ++i) {
+			frames[(*allocated)++] = (HAL_PhysicalMM_Address)(index + i) * I686_PAGE_SIZE;
 		}
 	}
-	if (!i686_PhysicalMM_GetBit(frame / I686_PAGE_SIZE)) {
-		KernelLog_ErrorMsg(PHYS_MOD_NAME, "Physical memory corruption detected");
+	return true;
+}
+
+static void i686_PhysicalMM_FreeFramesList(HAL_PhysicalMM_Address *frames, size_t count) {
+	size_t runStart = 0;
+	for (size_t i = 1; i <= count; ++i) {
+		if (i == count || frames[i] != frames[i - 1] + I686_PAGE_SIZE) {
+			i686_PhysicalMM_FreeFrames(frames[runStart], i - runStart);
+			runStart = i;
+		}
 	}
-	i686_PhysicalMM_ClearBit(frame / I686_PAGE_SIZE);
 }
 
-void HAL_PhysicalMM_UserFreeFrame(uintptr_t frame) {
+bool HAL_PhysicalMM_UserAllocFrames(HAL_PhysicalMM_Address *frames, size_t count) {
+	if (count == 0) {
+		return true;
+	}
 	Mutex_Lock(&m_mutex);
-	i686_PhysicalMM_FreeFrame(frame);
+	if (!m_buddyInitialized) {
+		for (size_t i = 0; i < count; ++i) {
+			frames[i] = i686_PhysicalMM_BootstrapAllocFrame();
+			if (frames[i] == 0) {
+				i686_PhysicalMM_FreeFramesList(frames, i);
+				Mutex_Unlock(&m_mutex);
+				return false;
+			}
+		}
+		Mutex_Unlock(&m_mutex);
+		return true;
+	}
+	size_t allocated = 0;
+	if (!i686_PhysicalMM_AllocFramesFromArena(HAL_PHYS_ARENA_USER, frames, count, &allocated) &&
+		!i686_PhysicalMM_AllocFramesFromArena(HAL_PHYS_ARENA_KERNEL, frames, count, &allocated)) {
+		i686_PhysicalMM_FreeFramesList(frames, allocated);
+		Mutex_Unlock(&m_mutex);
+		return false;
+	}
+	Mutex_Unlock(&m_mutex);
+	return true;
+}
+
+void HAL_PhysicalMM_UserFreeFrames(HAL_PhysicalMM_Address *frames, size_t count) {
+	if (count == 0) {
+		return;
+	}
+	Mutex_Lock(&m_mutex);
+	i686_PhysicalMM_FreeFramesList(frames, count);
+	Mutex_Unlock(&m_mutex);
+}
+
+uintptr_t HAL_PhysicalMM_KernelAllocArea(size_t size) {
+	const uint32_t framesNeeded = ALIGN_UP(size, I686_PAGE_SIZE) / I686_PAGE_SIZE;
+	if (framesNeeded == 0) {
+		return 0;
+	}
+	Mutex_Lock(&m_mutex);
+	if (!m_buddyInitialized) {
+		uint32_t result = i686_PhysicalMM_BootstrapAllocArea(framesNeeded * I686_PAGE_SIZE);
+		Mutex_Unlock(&m_mutex);
+		return result;
+	}
+	uint32_t index = i686_PhysicalMM_BuddyAllocate(HAL_PHYS_ARENA_KERNEL, framesNeeded);
+	Mutex_Unlock(&m_mutex);
+	if (index == I686_PHYS_NO_FRAME) {
+		return 0;
+	}
+	return index * I686_PAGE_SIZE;
+}
+
+HAL_PhysicalMM_Address HAL_PhysicalMM_UserAllocArea(size_t size) {
+	const uint32_t framesNeeded = ALIGN_UP(size, I686_PAGE_SIZE) / I686_PAGE_SIZE;
+	const uint8_t order = i686_PhysicalMM_GetOrder(framesNeeded);
+	if (framesNeeded == 0 || order >= I686_PHYS_ORDERS_COUNT) {
+		return 0;
+	}
+	// unlike single frames, areas are not taken from the kernel arena. Callers can fall back to separate frames
+	Mutex_Lock(&m_mutex);
+	if (!m_buddyInitialized) {
+		Mutex_Unlock(&m_mutex);
+		return 0;
+	}
+	uint32_t index = i686_PhysicalMM_BuddyAllocate(HAL_PHYS_ARENA_USER, 1U << order);
+	Mutex_Unlock(&m_mutex);
+	if (index == I686_PHYS_NO_FRAME) {
+		return 0;
+	}
+	return (HAL_PhysicalMM_Address)index * I686_PAGE_SIZE;
+}
+
+void HAL_PhysicalMM_UserFreeArea(HAL_PhysicalMM_Address area, size_t size) {
+	size = ALIGN_UP(size, I686_PAGE_SIZE);
+	Mutex_Lock(&m_mutex);
+	i686_PhysicalMM_FreeFrames(area, size / I686_PAGE_SIZE);
+	Mutex_Unlock(&m_mutex);
+}
+
+void HAL_PhysicalMM_UserFreeFrame(HAL_PhysicalMM_Address frame) {
+	Mutex_Lock(&m_mutex);
+	i686_PhysicalMM_FreeFrames(frame, 1);
 	Mutex_Unlock(&m_mutex);
 }
 void HAL_PhysicalMM_KernelFreeFrame(uint32_t frame) {
 	Mutex_Lock(&m_mutex);
-	i686_PhysicalMM_FreeFrame(frame);
+	i686_PhysicalMM_FreeFrames(frame, 1);
 	Mutex_Unlock(&m_mutex);
 }
 
 void HAL_PhysicalMM_KernelFreeArea(uintptr_t area, size_t size) {
 	size = ALIGN_UP(size, I686_PAGE_SIZE);
 	Mutex_Lock(&m_mutex);
-	for (uint32_t offset = 0; offset < size; offset += I686_PAGE_SIZE) {
-		i686_PhysicalMM_FreeFrame(area + offset);
+	i686_PhysicalMM_FreeFrames(area, size / I686_PAGE_SIZE);
+	Mutex_Unlock(&m_mutex);
+}
+
+size_t HAL_PhysicalMM_GetFreeBlocksCount(int arena, size_t order) {
+	if (arena < 0 || arena >= HAL_PHYS_ARENAS_COUNT || order >= I686_PHYS_ORDERS_COUNT) {
+		return 0;
 	}
+	Mutex_Lock(&m_mutex);
+	size_t result = m_freeBlocksCount[arena][order];
 	Mutex_Unlock(&m_mutex);
+	return result;
 }
 
 void i686_PhysicalMM_Initialize() {
@@ -139,29 +416,39 @@ void i686_PhysicalMM_Initialize() {
 	if (!i686_Stivale_GetMemoryMap(&mmap_buf)) {
 		KernelLog_ErrorMsg(PHYS_MOD_NAME, "No memory map present");
 	}
-	uint32_t max = 0;
+	uint64_t max = 0;
+	uint64_t ignored = 0;
 	for (uint32_t i = 0; i < mmap_buf.entries_count; ++i) {
 		uint32_t entry_type = mmap_buf.entries[i].type;
 		if (entry_type == AVAILABLE) {
-			if (mmap_buf.entries[i].length + mmap_buf.entries[i].base > 0x100000000ULL ||
-				mmap_buf.entries[i].length > 0xffffffffULL || mmap_buf.entries[i].base > 0xffffffffULL) {
-				KernelLog_WarnMsg(PHYS_MOD_NAME, "area that is not visible in protected mode was "
-												 "found. This area will be ignored\n");
+			uint64_t start = mmap_buf.entries[i].base;
+			uint64_t end = mmap_buf.entries[i].base + mmap_buf.entries[i].length;
+			if (start >= I686_PHYS_HIGH_LIMIT) {
+				ignored += end - start;
 				continue;
 			}
-			uint32_t len = (uint32_t)(mmap_buf.entries[i].length);
-			uint32_t addr = (uint32_t)(mmap_buf.entries[i].base);
-			uint32_t alignedAddr = ALIGN_UP(addr, I686_PAGE_SIZE);
-			uint32_t alignedLen = ALIGN_DOWN(len + addr, I686_PAGE_SIZE) - alignedAddr;
-			if (alignedAddr + alignedLen > max) {
-				max = alignedAddr + alignedLen;
+			if (end > I686_PHYS_HIGH_LIMIT) {
+				ignored += end - I686_PHYS_HIGH_LIMIT;
+				end = I686_PHYS_HIGH_LIMIT;
 			}
-			i686_PhysicalMM_ClearRange(alignedAddr, alignedLen);
+			uint32_t startIndex = (uint32_t)(ALIGN_UP(start, I686_PAGE_SIZE) / I686_PAGE_SIZE);
+			uint32_t endIndex = (uint32_t)(end / I686_PAGE_SIZE);
+			if (endIndex <= startIndex) {
+				continue;
+			}
+			if ((uint64_t)endIndex * I686_PAGE_SIZE > max) {
+				max = (uint64_t)endIndex * I686_PAGE_SIZE;
+			}
+			i686_PhysicalMM_ClearRange(startIndex, endIndex - startIndex);
 		}
 	}
-	i686_PhysicalMM_SetRange(0, ALIGN_UP((uint32_t)&i686_PhysicalMM_KernelEnd, I686_PAGE_SIZE));
+	if (ignored != 0) {
+		KernelLog_WarnMsg(PHYS_MOD_NAME, "%u MiB of memory above supported physical address limit is ignored",
+						  (uint32_t)(ignored >> 20));
+	}
+	i686_PhysicalMM_SetRange(0, ALIGN_UP((uint32_t)&i686_PhysicalMM_KernelEnd, I686_PAGE_SIZE) / I686_PAGE_SIZE);
 	m_memoryLimit = max;
-	uint32_t pagesCount = m_memoryLimit / I686_PAGE_SIZE;
+	uint32_t pagesCount = (uint32_t)(m_memoryLimit / I686_PAGE_SIZE);
 	if (m_lowArenaMaxIndex > pagesCount) {
 		m_lowArenaMaxIndex = pagesCount;
 	}
@@ -170,6 +457,44 @@ void i686_PhysicalMM_Initialize() {
 	}
 }
 
-uint32_t i686_PhysicalMM_GetMemorySize() {
+static void i686_PhysicalMM_AddFreeFramesToBuddy(uint32_t start, uint32_t end) {
+	uint32_t runStart = start;
+	for (uint32_t index = start; index < end; ++index) {
+		if (i686_PhysicalMM_GetBit(index)) {
+			i686_PhysicalMM_BuddyFreeRange(runStart, index - runStart);
+			runStart = index + 1;
+		}
+	}
+	if (runStart < end) {
+		i686_PhysicalMM_BuddyFreeRange(runStart, end - runStart);
+	}
+}
+
+void i686_PhysicalMM_InitializeBuddyAllocator() {
+	Mutex_Lock(&m_mutex);
+	m_framesCount = m_lowArenaMaxIndex;
+	if (m_highArenaMaxIndex > m_framesCount) {
+		m_framesCount = m_highArenaMaxIndex;
+	}
+	size_t framesArraySize = ALIGN_UP(m_framesCount * sizeof(struct i686_PhysicalMM_BuddyFrame), I686_PAGE_SIZE);
+	uint32_t framesArray = i686_PhysicalMM_BootstrapAllocArea(framesArraySize);
+	if (framesArray == 0) {
+		KernelLog_ErrorMsg(PHYS_MOD_NAME, "Failed to allocate buddy allocator frame array");
+	}
+	m_frames = (struct i686_PhysicalMM_BuddyFrame *)(framesArray + I686_KERNEL_MAPPING_BASE);
+	memset(m_frames, 0xff, m_framesCount * sizeof(struct i686_PhysicalMM_BuddyFrame));
+	for (int arena = 0; arena < HAL_PHYS_ARENAS_COUNT; ++arena) {
+		for (size_t order = 0; order < I686_PHYS_ORDERS_COUNT; ++order) {
+			m_freeLists[arena][order] = I686_PHYS_NO_FRAME;
+			m_freeBlocksCount[arena][order] = 0;
+		}
+	}
+	i686_PhysicalMM_AddFreeFramesToBuddy(I686_KERNEL_IGNORED_AREA_SIZE / I686_PAGE_SIZE, m_lowArenaMaxIndex);
+	i686_PhysicalMM_AddFreeFramesToBuddy(m_highArenaMinIndex, m_highArenaMaxIndex);
+	m_buddyInitialized = true;
+	Mutex_Unlock(&m_mutex);
+}
+
+uint64_t i686_PhysicalMM_GetMemorySize() {
 	return m_memoryLimit;
 }
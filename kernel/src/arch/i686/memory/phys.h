@@ -4,9 +4,10 @@
 #include <common/misc/utils.h>
 
 void i686_PhysicalMM_Initialize();
+void i686_PhysicalMM_InitializeBuddyAllocator();
 
 uint32_t i686_PhysicalMM_KernelAllocFrame();
 void HAL_PhysicalMM_KernelFreeFrame(uint32_t frame);
-uint32_t i686_PhysicalMM_GetMemorySize();
+uint64_t i686_PhysicalMM_GetMemorySize();
 
 #endif
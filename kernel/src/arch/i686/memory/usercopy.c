@@ -0,0 +1,24 @@
+#include <arch/i686/memory/config.h>
+#include <arch/i686/memory/usercopy.h>
+
+struct i686_UserCopy_Fixup {
+	uint32_t faultingInstruction;
+	uint32_t fixup;
+} PACKED;
+
+extern const struct i686_UserCopy_Fixup i686_UserCopy_FixupTable[];
+extern const struct i686_UserCopy_Fixup i686_UserCopy_FixupTableEnd[];
+
+bool i686_UserCopy_FixupFault(struct i686_CPUState *state, uintptr_t addr) {
+	if (addr < I686_USER_AREA_START || addr >= I686_USER_AREA_END) {
+		return false;
+	}
+	for (const struct i686_UserCopy_Fixup *entry = i686_UserCopy_FixupTable; entry < i686_UserCopy_FixupTableEnd;
+		 ++entry) {
+		if (entry->faultingInstruction == state->eip) {
+			state->eip = entry->fixup;
+			return true;
+		}
+	}
+	return false;
+}
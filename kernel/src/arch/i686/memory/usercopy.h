@@ -0,0 +1,9 @@
+#ifndef __I686_MEMORY_USERCOPY_H_INCLUDED__
+#define __I686_MEMORY_USERCOPY_H_INCLUDED__
+
+#include <arch/i686/proc/state.h>
+#include <common/misc/utils.h>
+
+bool i686_UserCopy_FixupFault(struct i686_CPUState *state, uintptr_t addr);
+
+#endif
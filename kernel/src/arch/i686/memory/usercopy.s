@@ -0,0 +1,102 @@
+bits 32
+
+global HAL_VirtualMM_CopyUser
+global HAL_VirtualMM_CopyUserString
+global HAL_VirtualMM_UserStringLength
+global i686_UserCopy_FixupTable
+global i686_UserCopy_FixupTableEnd
+
+; Instructions listed in the fixup table may fault on user addresses. If the fault can't be resolved, page fault
+; handler resumes execution at the corresponding fixup label instead of treating it as kernel bug
+
+section .text
+; size_t HAL_VirtualMM_CopyUser(void *dst, const void *src, size_t size)
+; Returns count of bytes that were not copied
+HAL_VirtualMM_CopyUser:
+    push esi
+    push edi
+    mov edi, dword [esp + 12]
+    mov esi, dword [esp + 16]
+    mov ecx, dword [esp + 20]
+    cld
+    mov edx, ecx
+    and edx, 0b11
+    shr ecx, 2
+.copy_dwords:
+    rep movsd
+    mov ecx, edx
+.copy_bytes:
+    rep movsb
+    xor eax, eax
+    pop edi
+    pop esi
+    ret
+.dwords_fault:
+    lea eax, [edx + ecx * 4]
+    pop edi
+    pop esi
+    ret
+.bytes_fault:
+    mov eax, ecx
+    pop edi
+    pop esi
+    ret
+
+; int HAL_VirtualMM_CopyUserString(char *dst, const char *src, size_t maxLength)
+; Copies string with null terminator. Returns its length or -1 if there is no terminator in first maxLength bytes
+HAL_VirtualMM_CopyUserString:
+    push esi
+    push edi
+    mov edi, dword [esp + 12]
+    mov esi, dword [esp + 16]
+    mov ecx, dword [esp + 20]
+    xor edx, edx
+.loop:
+    cmp edx, ecx
+    je .fault
+.load:
+    mov al, byte [esi + edx]
+    mov byte [edi + edx], al
+    test al, al
+    jz .done
+    inc edx
+    jmp .loop
+.done:
+    mov eax, edx
+    pop edi
+    pop esi
+    ret
+.fault:
+    mov eax, -1
+    pop edi
+    pop esi
+    ret
+
+; int HAL_VirtualMM_UserStringLength(const char *src, size_t maxLength)
+; Returns string length or -1 if there is no terminator in first maxLength bytes
+HAL_VirtualMM_UserStringLength:
+    mov edx, dword [esp + 4]
+    mov ecx, dword [esp + 8]
+    xor eax, eax
+.loop:
+    cmp eax, ecx
+    je .fault
+.load:
+    cmp byte [edx + eax], 0
+    je .done
+    inc eax
+    jmp .loop
+.done:
+    ret
+.fault:
+    mov eax, -1
+    ret
+
+section .rodata
+; Pairs of faulting instruction address and fixup address
+i686_UserCopy_FixupTable:
+    dd HAL_VirtualMM_CopyUser.copy_dwords, HAL_VirtualMM_CopyUser.dwords_fault
+    dd HAL_VirtualMM_CopyUser.copy_bytes, HAL_VirtualMM_CopyUser.bytes_fault
+    dd HAL_VirtualMM_CopyUserString.load, HAL_VirtualMM_CopyUserString.fault
+    dd HAL_VirtualMM_UserStringLength.load, HAL_VirtualMM_UserStringLength.fault
+i686_UserCopy_FixupTableEnd:
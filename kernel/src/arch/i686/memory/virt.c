@@ -1,75 +1,120 @@
 #include <arch/i686/cpu/cr3.h>
+#include <arch/i686/init/stivale.h>
 #include <arch/i686/memory/config.h>
 #include <arch/i686/memory/phys.h>
 #include <arch/i686/memory/virt.h>
 #include <arch/i686/proc/priv.h>
 #include <arch/i686/proc/ring1.h>
+#include <common/core/proc/mutex.h>
 #include <common/lib/kmsg.h>
 #include <hal/memory/phys.h>
 #include <hal/memory/virt.h>
+#include <hal/proc/intlevel.h>
 
 #define I686_VIRT_MOD_NAME "i686 Virtual Memory Manager"
-#define I686_FLAGS_MASK 0b111111111111
+#define I686_ADDRESS_MASK 0x000ffffffffff000ULL
+#define I686_LARGE_ADDRESS_MASK (I686_ADDRESS_MASK & ~((uint64_t)I686_LARGE_PAGE_SIZE - 1))
+#define I686_PAGE_TABLE_ENTRIES 512
+// directory entries are numbered across all four page directories, so user ones are the ones below kernel base
+#define I686_USER_DIRECTORY_ENTRIES (I686_USER_AREA_END / I686_LARGE_PAGE_SIZE)
+#define I686_USER_DIRECTORIES (I686_USER_DIRECTORY_ENTRIES / I686_PAGE_TABLE_ENTRIES)
+#define I686_CPUID_PGE (1 << 13)
+#define I686_CPUID_NX (1 << 20)
+#define I686_CR4_PGE (1 << 7)
+#define I686_CR0_WP (1 << 16)
+#define I686_MSR_EFER 0xc0000080
+#define I686_EFER_NXE (1 << 11)
+// ranges longer than that are flushed by reloading CR3
+#define I686_FLUSH_RANGE_MAX_PAGES 32
 
 union i686_VirtualMM_PageTableEntry {
-	uint32_t addr;
+	uint64_t addr;
 	struct {
-		uint32_t present : 1;
-		uint32_t writable : 1;
-		uint32_t user : 1;
-		uint32_t writeThrough : 1;
-		uint32_t cacheDisabled : 1;
-		uint32_t accessed : 1;
-		uint32_t huge : 1;
-		uint32_t ignored : 1;
-		uint32_t : 24;
+		uint64_t present : 1;
+		uint64_t writable : 1;
+		uint64_t user : 1;
+		uint64_t writeThrough : 1;
+		uint64_t cacheDisabled : 1;
+		uint64_t accessed : 1;
+		uint64_t dirty : 1;
+		uint64_t huge : 1;
+		uint64_t global : 1;
+		uint64_t cow : 1;
+		uint64_t : 53;
+		uint64_t noExecute : 1;
 	} PACKED;
 } PACKED;
 
 struct i686_VirtualMM_PageTable {
-	union i686_VirtualMM_PageTableEntry entries[1024];
+	union i686_VirtualMM_PageTableEntry entries[I686_PAGE_TABLE_ENTRIES];
 } PACKED;
 
 const uintptr_t HAL_VirtualMM_KernelMappingBase = I686_KERNEL_MAPPING_BASE;
 const size_t HAL_VirtualMM_PageSize = I686_PAGE_SIZE;
+const size_t HAL_VirtualMM_LargePageSize = I686_LARGE_PAGE_SIZE;
 const uintptr_t HAL_VirtualMM_UserAreaStart = I686_USER_AREA_START;
 const uintptr_t HAL_VirtualMM_UserAreaEnd = I686_USER_AREA_END;
 const uintptr_t HAL_VirtualMM_IOMappingsStart = I686_IOMAP_AREA_START;
 const uintptr_t HAL_VirtualMM_IOMappingsEnd = I686_IOMAP_AREA_END;
 uint16_t *m_pageRefcounts = NULL;
+static uint32_t m_pageRefcountsCount = 0;
+// Counts of copy-on-write owners of user frames. Page table entry counts above are only kept for kernel frames that
+// page tables are allocated from
+static uint16_t *m_frameShareCounts = NULL;
+static uint32_t m_frameShareCountsCount = 0;
+static struct Mutex m_tempMappingMutex;
+static struct HAL_VirtualMM_FlushStatistics m_flushStatistics;
+// page tables of the current address space that became empty. They can still be cached by the CPU, so they are
+// freed after the next flush. List is linked through the first entry of each table
+static uint32_t m_pendingPageTables = 0;
+static bool m_largeUserPages = false;
+static bool m_noExecute = false;
 
 static INLINE uint16_t i686_VirtualMM_GetPageDirectoryIndex(uint32_t vaddr) {
-	return (vaddr >> 22) & (0b1111111111);
+	return vaddr >> 21;
 }
 
 static INLINE uint16_t i686_VirtualMM_GetPageTableIndex(uint32_t vaddr) {
-	return (vaddr >> 12) & (0b1111111111);
+	return (vaddr >> 12) & (0b111111111);
 }
 
-static INLINE uint32_t i686_VirtualMM_WalkToNextPageTable(uint32_t current, uint16_t index) {
-	struct i686_VirtualMM_PageTable *table = (struct i686_VirtualMM_PageTable *)(current + I686_KERNEL_MAPPING_BASE);
-	if (!table->entries[index].present) {
+// Root is the page directory pointer table. Its entries are only reloaded together with CR3, so all page directories
+// are allocated with the address space, and the last one is shared by all address spaces
+static INLINE union i686_VirtualMM_PageTableEntry *i686_VirtualMM_GetDirectoryEntry(uint32_t root, uint16_t pdIndex) {
+	union i686_VirtualMM_PageTableEntry *pointers =
+		(union i686_VirtualMM_PageTableEntry *)(root + I686_KERNEL_MAPPING_BASE);
+	uint32_t pageDirPhys = (uint32_t)(pointers[pdIndex / I686_PAGE_TABLE_ENTRIES].addr & I686_ADDRESS_MASK);
+	struct i686_VirtualMM_PageTable *pageDir =
+		(struct i686_VirtualMM_PageTable *)(pageDirPhys + I686_KERNEL_MAPPING_BASE);
+	return pageDir->entries + pdIndex % I686_PAGE_TABLE_ENTRIES;
+}
+
+static INLINE uint32_t i686_VirtualMM_WalkToNextPageTable(uint32_t root, uint16_t pdIndex) {
+	union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+	if (!dirEntry->present) {
 		return 0;
 	}
-	return table->entries[index].addr & ~(I686_FLAGS_MASK);
+	return (uint32_t)(dirEntry->addr & I686_ADDRESS_MASK);
 }
 
 static void i686_VirtualMM_CreateBootstrapMapping(uint32_t cr3, uint32_t vaddr, uint32_t paddr) {
 	uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
 	uint16_t ptIndex = i686_VirtualMM_GetPageTableIndex(vaddr);
-	struct i686_VirtualMM_PageTable *pageDir = (struct i686_VirtualMM_PageTable *)(cr3 + I686_KERNEL_MAPPING_BASE);
-	if (!(pageDir->entries[pdIndex].present)) {
+	union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(cr3, pdIndex);
+	if (!(dirEntry->present)) {
 		uint32_t addr = i686_PhysicalMM_KernelAllocFrame();
 		if (addr == 0) {
 			KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Failed to allocate page table for the kernel memory mapping");
 		}
-		if (addr > I686_KERNEL_INIT_MAPPING_SIZE) {
-			KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Allocated page table is not reachable from the initial "
-												   "kernel mapping");
+		// memory is mapped in ascending order, so everything below paddr is reachable already
+		if (addr >= paddr) {
+			KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Allocated page table is not reachable from the kernel "
+												   "mapping built so far");
 		}
-		pageDir->entries[pdIndex].addr = addr;
-		pageDir->entries[pdIndex].present = true;
-		pageDir->entries[pdIndex].writable = true;
+		memset((void *)(addr + I686_KERNEL_MAPPING_BASE), 0, I686_PAGE_SIZE);
+		dirEntry->addr = addr;
+		dirEntry->present = true;
+		dirEntry->writable = true;
 	}
 	struct i686_VirtualMM_PageTable *pageTable =
 		(struct i686_VirtualMM_PageTable *)(i686_VirtualMM_WalkToNextPageTable(cr3, pdIndex) +
@@ -79,139 +124,491 @@ static void i686_VirtualMM_CreateBootstrapMapping(uint32_t cr3, uint32_t vaddr,
 	pageTable->entries[ptIndex].writable = true;
 }
 
-static uint16_t i686_VirtualMM_GetPageTableReferenceCount(uint32_t paddr) {
-	struct i686_VirtualMM_PageTable *pageTable = (struct i686_VirtualMM_PageTable *)(paddr + I686_KERNEL_MAPPING_BASE);
-	uint16_t result = 0;
-	for (uint16_t i = 0; i < 1024; ++i) {
-		if (pageTable->entries[i].present) {
-			result++;
-		}
+static bool i686_VirtualMM_LargeKernelPagesAvailable() {
+	if (i686_Stivale_HasCommandLineOption("nohugekmap")) {
+		KernelLog_InfoMsg(I686_VIRT_MOD_NAME, "Large kernel pages are disabled from the command line");
+		return false;
 	}
-	return result;
+	// PAE page directories always accept large pages
+	uint32_t eax, ebx, ecx, edx;
+	i686_CPU_CPUID(1, &eax, &ebx, &ecx, &edx);
+	if ((edx & I686_CPUID_PGE) == 0) {
+		KernelLog_WarnMsg(I686_VIRT_MOD_NAME, "CPU does not support global pages");
+		return false;
+	}
+	return true;
 }
 
-static void i686_VirtualMM_FillMissingKernelPageTables() {
-	uint32_t cr3 = i686_CR3_Get();
-	struct i686_VirtualMM_PageTable *pageDir = (struct i686_VirtualMM_PageTable *)(cr3 + I686_KERNEL_MAPPING_BASE);
-	for (uint16_t i = 768; i < 1024; ++i) {
-		if (!pageDir->entries[i].present) {
-			pageDir->entries[i].addr = i686_PhysicalMM_KernelAllocFrame();
-			if (pageDir->entries[i].addr == 0) {
-				KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Failed to allocate page table in kernel half");
-			}
-			memset((void *)(pageDir->entries[i].addr + I686_KERNEL_MAPPING_BASE), 0, 4096);
-			pageDir->entries[i].present = true;
-			pageDir->entries[i].writable = true;
+static void i686_VirtualMM_CreateLargeKernelMapping(uint32_t cr3) {
+	for (uint32_t paddr = 0; paddr < I686_PHYS_LOW_LIMIT; paddr += I686_LARGE_PAGE_SIZE) {
+		uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(paddr + I686_KERNEL_MAPPING_BASE);
+		union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(cr3, pdIndex);
+		dirEntry->addr = paddr;
+		dirEntry->present = true;
+		dirEntry->writable = true;
+		dirEntry->huge = true;
+		dirEntry->global = true;
+	}
+	// setting PGE flushes the whole TLB, dropping stale entries of the bootstrap mapping
+	i686_CPU_SetCR4(i686_CPU_GetCR4() | I686_CR4_PGE);
+	KernelLog_InfoMsg(I686_VIRT_MOD_NAME, "Kernel direct map is built from global 2 MiB pages");
+}
+
+static void i686_VirtualMM_EnableLargeUserPages() {
+	if (i686_Stivale_HasCommandLineOption("nohugeumap")) {
+		KernelLog_InfoMsg(I686_VIRT_MOD_NAME, "Large user pages are disabled from the command line");
+		return;
+	}
+	m_largeUserPages = true;
+}
+
+static void i686_VirtualMM_EnableNoExecute() {
+	uint32_t eax, ebx, ecx, edx;
+	i686_CPU_CPUID(0x80000000, &eax, &ebx, &ecx, &edx);
+	if (eax >= 0x80000001) {
+		i686_CPU_CPUID(0x80000001, &eax, &ebx, &ecx, &edx);
+	} else {
+		edx = 0;
+	}
+	if ((edx & I686_CPUID_NX) == 0) {
+		KernelLog_WarnMsg(I686_VIRT_MOD_NAME, "CPU does not support no-execute pages");
+		return;
+	}
+	i686_CPU_WriteMSR(I686_MSR_EFER, i686_CPU_ReadMSR(I686_MSR_EFER) | I686_EFER_NXE);
+	m_noExecute = true;
+}
+
+// Bootstrap code maps the kernel page directory at the bottom as well, so user area gets its own directories instead
+static void i686_VirtualMM_CreateUserPageDirectories(uint32_t cr3) {
+	union i686_VirtualMM_PageTableEntry *pointers =
+		(union i686_VirtualMM_PageTableEntry *)(cr3 + I686_KERNEL_MAPPING_BASE);
+	for (uint16_t i = 0; i < I686_USER_DIRECTORIES; ++i) {
+		uint32_t addr = i686_PhysicalMM_KernelAllocFrame();
+		if (addr == 0) {
+			KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Failed to allocate page directory for the user area");
 		}
+		memset((void *)(addr + I686_KERNEL_MAPPING_BASE), 0, I686_PAGE_SIZE);
+		pointers[i].addr = addr;
+		pointers[i].present = true;
+	}
+}
+
+static void i686_VirtualMM_CreateTempMappingPageTable(uint32_t cr3) {
+	union i686_VirtualMM_PageTableEntry *dirEntry =
+		i686_VirtualMM_GetDirectoryEntry(cr3, i686_VirtualMM_GetPageDirectoryIndex(I686_TEMP_MAPPING_AREA_START));
+	if (dirEntry->present) {
+		return;
 	}
+	uint32_t addr = i686_PhysicalMM_KernelAllocFrame();
+	if (addr == 0) {
+		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Failed to allocate page table for temporary mappings");
+	}
+	memset((void *)(addr + I686_KERNEL_MAPPING_BASE), 0, I686_PAGE_SIZE);
+	dirEntry->addr = addr;
+	dirEntry->present = true;
+	dirEntry->writable = true;
 }
 
 void i686_VirtualMM_InitializeKernelMap() {
 	uint32_t cr3 = i686_CR3_Get();
-	for (uint32_t paddr = I686_KERNEL_INIT_MAPPING_SIZE; paddr < I686_PHYS_LOW_LIMIT; paddr += I686_PAGE_SIZE) {
-		i686_VirtualMM_CreateBootstrapMapping(cr3, paddr + I686_KERNEL_MAPPING_BASE, paddr);
+	if (i686_VirtualMM_LargeKernelPagesAvailable()) {
+		i686_VirtualMM_CreateLargeKernelMapping(cr3);
+	} else {
+		for (uint32_t paddr = I686_KERNEL_INIT_MAPPING_SIZE; paddr < I686_PHYS_LOW_LIMIT; paddr += I686_PAGE_SIZE) {
+			i686_VirtualMM_CreateBootstrapMapping(cr3, paddr + I686_KERNEL_MAPPING_BASE, paddr);
+		}
 	}
-	struct i686_VirtualMM_PageTable *pageDir = (struct i686_VirtualMM_PageTable *)(cr3 + I686_KERNEL_MAPPING_BASE);
-	pageDir->entries[0].addr = 0;
-	uint32_t refcountsSize = i686_PhysicalMM_GetMemorySize() * 2 / HAL_VirtualMM_PageSize;
+	i686_VirtualMM_CreateUserPageDirectories(cr3);
+	m_frameShareCountsCount = (uint32_t)(i686_PhysicalMM_GetMemorySize() / HAL_VirtualMM_PageSize);
+	m_pageRefcountsCount = m_frameShareCountsCount;
+	if (m_pageRefcountsCount > I686_PHYS_LOW_LIMIT / HAL_VirtualMM_PageSize) {
+		m_pageRefcountsCount = I686_PHYS_LOW_LIMIT / HAL_VirtualMM_PageSize;
+	}
+	uint32_t refcountsSize = m_pageRefcountsCount * sizeof(uint16_t);
 	uint32_t refcounts = HAL_PhysicalMM_KernelAllocArea(refcountsSize);
 	if (refcounts == 0) {
-		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Failed to allocate frame refcount array");
+		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Failed to allocate page table refcount array");
 	}
 	m_pageRefcounts = (uint16_t *)(refcounts + HAL_VirtualMM_KernelMappingBase);
 	memset(m_pageRefcounts, 0, refcountsSize);
-	i686_VirtualMM_FillMissingKernelPageTables();
-	for (uint16_t i = 0; i < 768; ++i) {
-		if (pageDir->entries[i].present) {
-			uint32_t next = i686_VirtualMM_WalkToNextPageTable(cr3, i);
-			uint16_t refcount = i686_VirtualMM_GetPageTableReferenceCount(next);
-			m_pageRefcounts[next / HAL_VirtualMM_PageSize] = refcount;
-		}
+	uint32_t shareCountsSize = m_frameShareCountsCount * sizeof(uint16_t);
+	uint32_t shareCounts = HAL_PhysicalMM_KernelAllocArea(shareCountsSize);
+	if (shareCounts == 0) {
+		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Failed to allocate frame share count array");
 	}
+	m_frameShareCounts = (uint16_t *)(shareCounts + HAL_VirtualMM_KernelMappingBase);
+	memset(m_frameShareCounts, 0, shareCountsSize);
+	i686_VirtualMM_CreateTempMappingPageTable(cr3);
+	i686_VirtualMM_EnableLargeUserPages();
+	i686_VirtualMM_EnableNoExecute();
+	Mutex_Initialize(&m_tempMappingMutex);
+	// kernel writes to copy-on-write user pages should fault as well
+	i686_CPU_SetCR0(i686_CPU_GetCR0() | I686_CR0_WP);
 	i686_CPU_SetCR3(i686_CPU_GetCR3());
 }
 
-bool HAL_VirtualMM_MapPageAt(uintptr_t root, uintptr_t vaddr, uintptr_t paddr, int flags) {
-	struct i686_VirtualMM_PageTable *pageDir = (struct i686_VirtualMM_PageTable *)(root + I686_KERNEL_MAPPING_BASE);
-	uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
-	uint16_t ptIndex = i686_VirtualMM_GetPageTableIndex(vaddr);
-	if (!(pageDir->entries[pdIndex].present)) {
+static INLINE bool i686_VirtualMM_IsLargePage(uint32_t root, uint16_t pdIndex) {
+	union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+	return dirEntry->present && dirEntry->huge;
+}
+
+static union i686_VirtualMM_PageTableEntry *i686_VirtualMM_GetPageTableEntry(uint32_t root, uint32_t vaddr) {
+	if (i686_VirtualMM_IsLargePage(root, i686_VirtualMM_GetPageDirectoryIndex(vaddr))) {
+		return NULL;
+	}
+	uint32_t pageTablePhys = i686_VirtualMM_WalkToNextPageTable(root, i686_VirtualMM_GetPageDirectoryIndex(vaddr));
+	if (pageTablePhys == 0) {
+		return NULL;
+	}
+	struct i686_VirtualMM_PageTable *pageTable =
+		(struct i686_VirtualMM_PageTable *)(pageTablePhys + I686_KERNEL_MAPPING_BASE);
+	return pageTable->entries + i686_VirtualMM_GetPageTableIndex(vaddr);
+}
+
+static INLINE bool i686_VirtualMM_IsFrameShared(HAL_PhysicalMM_Address frame) {
+	uint64_t index = frame / I686_PAGE_SIZE;
+	return index < m_frameShareCountsCount && m_frameShareCounts[index] > 1;
+}
+
+// Entries of inaccessible pages are not present but still hold the frame, so the address should be checked instead of
+// present bit to find out whether the page is mapped
+static void i686_VirtualMM_SetEntry(union i686_VirtualMM_PageTableEntry *entry, HAL_PhysicalMM_Address paddr,
+									int flags) {
+	bool writable = (flags & HAL_VIRT_FLAGS_WRITABLE) != 0;
+	entry->addr = paddr;
+	entry->cow = writable && (flags & HAL_VIRT_FLAGS_SHARED) == 0 && i686_VirtualMM_IsFrameShared(paddr);
+	entry->writable = writable && !entry->cow;
+	entry->cacheDisabled = (flags & HAL_VIRT_FLAGS_DISABLE_CACHE) != 0;
+	entry->user = (flags & HAL_VIRT_FLAGS_USER_ACCESSIBLE) != 0;
+	entry->noExecute = m_noExecute && (flags & HAL_VIRT_FLAGS_EXECUTABLE) == 0;
+	entry->present = ((flags & HAL_VIRT_FLAGS_WRITABLE) != 0) || ((flags & HAL_VIRT_FLAGS_READABLE) != 0);
+}
+
+static struct i686_VirtualMM_PageTable *i686_VirtualMM_GetOrCreatePageTable(uint32_t root, uint16_t pdIndex) {
+	union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+	if (!(dirEntry->present)) {
 		uint32_t addr = i686_PhysicalMM_KernelAllocFrame();
 		if (addr == 0) {
-			return false;
+			return NULL;
 		}
-		pageDir->entries[pdIndex].addr = addr;
-		pageDir->entries[pdIndex].present = true;
-		pageDir->entries[pdIndex].writable = true;
-		pageDir->entries[pdIndex].user = true;
+		memset((void *)(addr + HAL_VirtualMM_KernelMappingBase), 0, I686_PAGE_SIZE);
 		m_pageRefcounts[addr / HAL_VirtualMM_PageSize] = 0;
-		memset((void *)(addr + HAL_VirtualMM_KernelMappingBase), 0, 0x1000);
+		dirEntry->addr = addr;
+		dirEntry->present = true;
+		dirEntry->writable = true;
+		dirEntry->user = true;
 	}
-	uint32_t next = i686_VirtualMM_WalkToNextPageTable(root, pdIndex);
-	struct i686_VirtualMM_PageTable *pageTable = (struct i686_VirtualMM_PageTable *)(next + I686_KERNEL_MAPPING_BASE);
-	if (pageTable->entries[ptIndex].present) {
+	if (dirEntry->huge) {
 		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Mapping over already mapped page is not allowed");
 	}
-	pageTable->entries[ptIndex].addr = paddr;
-	pageTable->entries[ptIndex].present =
-		((flags & HAL_VIRT_FLAGS_WRITABLE) != 0) || ((flags & HAL_VIRT_FLAGS_READABLE) != 0);
-	pageTable->entries[ptIndex].writable = (flags & HAL_VIRT_FLAGS_WRITABLE) != 0;
-	pageTable->entries[ptIndex].cacheDisabled = (flags & HAL_VIRT_FLAGS_DISABLE_CACHE) != 0;
-	pageTable->entries[ptIndex].user = (flags & HAL_VIRT_FLAGS_USER_ACCESSIBLE) != 0;
-	if (pdIndex < 768) {
-		m_pageRefcounts[next / HAL_VirtualMM_PageSize]++;
+	uint32_t next = i686_VirtualMM_WalkToNextPageTable(root, pdIndex);
+	return (struct i686_VirtualMM_PageTable *)(next + I686_KERNEL_MAPPING_BASE);
+}
+
+bool HAL_VirtualMM_MapPageAt(uintptr_t root, uintptr_t vaddr, HAL_PhysicalMM_Address paddr, int flags) {
+	return HAL_VirtualMM_MapRange(root, vaddr, &paddr, 1, flags) == 1;
+}
+
+size_t HAL_VirtualMM_MapRange(uintptr_t root, uintptr_t vaddr, const HAL_PhysicalMM_Address *frames, size_t count,
+							  int flags) {
+	size_t mapped = 0;
+	while (mapped < count) {
+		uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
+		struct i686_VirtualMM_PageTable *pageTable = i686_VirtualMM_GetOrCreatePageTable(root, pdIndex);
+		if (pageTable == NULL) {
+			return mapped;
+		}
+		uint16_t added = 0;
+		for (uint16_t ptIndex = i686_VirtualMM_GetPageTableIndex(vaddr);
+			 ptIndex < I686_PAGE_TABLE_ENTRIES && mapped < count; ++ptIndex) {
+			if (pageTable->entries[ptIndex].present) {
+				KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Mapping over already mapped page is not allowed");
+			}
+			i686_VirtualMM_SetEntry(pageTable->entries + ptIndex, frames[mapped], flags);
+			++mapped;
+			++added;
+			vaddr += I686_PAGE_SIZE;
+		}
+		if (pdIndex < I686_USER_DIRECTORY_ENTRIES) {
+			uint32_t pageTablePhys = (uint32_t)pageTable - I686_KERNEL_MAPPING_BASE;
+			m_pageRefcounts[pageTablePhys / HAL_VirtualMM_PageSize] += added;
+		}
 	}
-	return true;
+	return mapped;
 }
 
-uintptr_t HAL_VirtualMM_UnmapPageAt(uintptr_t root, uintptr_t vaddr) {
-	uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
-	uint16_t ptIndex = i686_VirtualMM_GetPageTableIndex(vaddr);
-	uint32_t pageTablePhys = i686_VirtualMM_WalkToNextPageTable(root, pdIndex);
+static void i686_VirtualMM_InvalidatePage(uint32_t root, uint32_t vaddr);
+
+// Replaces large page with page table mapping the same frames, so that its pages can be changed separately
+static bool i686_VirtualMM_SplitLargePage(uint32_t root, uint16_t pdIndex) {
+	union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+	uint32_t pageTablePhys = i686_PhysicalMM_KernelAllocFrame();
 	if (pageTablePhys == 0) {
-		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Attempt to unmap page that is not mapped");
+		return false;
 	}
-	struct i686_VirtualMM_PageTable *pageDir = (struct i686_VirtualMM_PageTable *)(root + I686_KERNEL_MAPPING_BASE);
 	struct i686_VirtualMM_PageTable *pageTable =
 		(struct i686_VirtualMM_PageTable *)(pageTablePhys + I686_KERNEL_MAPPING_BASE);
-	if (!(pageTable->entries[ptIndex].present)) {
+	union i686_VirtualMM_PageTableEntry largeEntry = *dirEntry;
+	HAL_PhysicalMM_Address area = largeEntry.addr & I686_LARGE_ADDRESS_MASK;
+	for (uint16_t i = 0; i < I686_PAGE_TABLE_ENTRIES; ++i) {
+		pageTable->entries[i].addr = area + i * I686_PAGE_SIZE;
+		pageTable->entries[i].present = largeEntry.present;
+		pageTable->entries[i].writable = largeEntry.writable;
+		pageTable->entries[i].user = largeEntry.user;
+		pageTable->entries[i].cacheDisabled = largeEntry.cacheDisabled;
+		pageTable->entries[i].noExecute = largeEntry.noExecute;
+	}
+	m_pageRefcounts[pageTablePhys / I686_PAGE_SIZE] = I686_PAGE_TABLE_ENTRIES;
+	dirEntry->addr = pageTablePhys;
+	dirEntry->present = true;
+	dirEntry->writable = true;
+	dirEntry->user = true;
+	// translations are the same, but TLB should not hold both large and small entries for them
+	i686_VirtualMM_InvalidatePage(root, (uint32_t)pdIndex * I686_LARGE_PAGE_SIZE);
+	return true;
+}
+
+static void i686_VirtualMM_SplitLargePageOrPanic(uint32_t root, uint16_t pdIndex) {
+	if (pdIndex < I686_USER_DIRECTORY_ENTRIES && i686_VirtualMM_IsLargePage(root, pdIndex) &&
+		!i686_VirtualMM_SplitLargePage(root, pdIndex)) {
+		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Failed to allocate page table to split large page");
+	}
+}
+
+bool HAL_VirtualMM_CanMapLargePageAt(uintptr_t root, uintptr_t vaddr) {
+	uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
+	if (!m_largeUserPages || pdIndex >= I686_USER_DIRECTORY_ENTRIES) {
+		return false;
+	}
+	union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+	return !(dirEntry->present) && dirEntry->addr == 0;
+}
+
+bool HAL_VirtualMM_MapLargePageAt(uintptr_t root, uintptr_t vaddr, HAL_PhysicalMM_Address paddr, int flags) {
+	// inaccessible pages still have to hold their frames, which is only possible in page tables
+	if (!HAL_VirtualMM_CanMapLargePageAt(root, vaddr) || vaddr % I686_LARGE_PAGE_SIZE != 0 ||
+		paddr % I686_LARGE_PAGE_SIZE != 0 || (flags & (HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_WRITABLE)) == 0) {
+		return false;
+	}
+	union i686_VirtualMM_PageTableEntry *dirEntry =
+		i686_VirtualMM_GetDirectoryEntry(root, i686_VirtualMM_GetPageDirectoryIndex(vaddr));
+	dirEntry->addr = paddr;
+	dirEntry->huge = true;
+	dirEntry->writable = (flags & HAL_VIRT_FLAGS_WRITABLE) != 0;
+	dirEntry->cacheDisabled = (flags & HAL_VIRT_FLAGS_DISABLE_CACHE) != 0;
+	dirEntry->user = (flags & HAL_VIRT_FLAGS_USER_ACCESSIBLE) != 0;
+	dirEntry->noExecute = m_noExecute && (flags & HAL_VIRT_FLAGS_EXECUTABLE) == 0;
+	dirEntry->present = true;
+	return true;
+}
+
+HAL_PhysicalMM_Address HAL_VirtualMM_UnmapLargePageAt(uintptr_t root, uintptr_t vaddr) {
+	uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
+	if (pdIndex >= I686_USER_DIRECTORY_ENTRIES || !i686_VirtualMM_IsLargePage(root, pdIndex)) {
+		return 0;
+	}
+	union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+	HAL_PhysicalMM_Address area = dirEntry->addr & I686_LARGE_ADDRESS_MASK;
+	dirEntry->addr = 0;
+	return area;
+}
+
+static void i686_VirtualMM_ReleasePageTable(uint32_t root, uint32_t pageTablePhys) {
+	if (root != i686_CR3_Get()) {
+		HAL_PhysicalMM_KernelFreeFrame(pageTablePhys);
+		return;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	*(uint32_t *)(pageTablePhys + I686_KERNEL_MAPPING_BASE) = m_pendingPageTables;
+	m_pendingPageTables = pageTablePhys;
+	HAL_InterruptLevel_Recover(level);
+}
+
+static void i686_VirtualMM_FreePendingPageTables() {
+	int level = HAL_InterruptLevel_Elevate();
+	uint32_t current = m_pendingPageTables;
+	m_pendingPageTables = 0;
+	HAL_InterruptLevel_Recover(level);
+	HAL_PhysicalMM_Address frames[64];
+	size_t count = 0;
+	while (current != 0) {
+		frames[count++] = current;
+		current = *(uint32_t *)(current + I686_KERNEL_MAPPING_BASE);
+		if (count == ARR_SIZE(frames)) {
+			HAL_PhysicalMM_UserFreeFrames(frames, count);
+			count = 0;
+		}
+	}
+	HAL_PhysicalMM_UserFreeFrames(frames, count);
+}
+
+static void i686_VirtualMM_StoreUnmappedFrame(HAL_PhysicalMM_Address frame, MAYBE_UNUSED size_t size, void *ctx) {
+	*(HAL_PhysicalMM_Address *)ctx = frame;
+}
+
+HAL_PhysicalMM_Address HAL_VirtualMM_UnmapPageAt(uintptr_t root, uintptr_t vaddr) {
+	HAL_PhysicalMM_Address result = 0;
+	HAL_VirtualMM_UnmapRange(root, vaddr, vaddr + I686_PAGE_SIZE, i686_VirtualMM_StoreUnmappedFrame, &result);
+	// ranges may have holes, but a single page is only unmapped by callers that mapped it
+	if (result == 0) {
 		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Attempt to unmap page that is not mapped");
 	}
-	uintptr_t result = i686_VirtualMM_WalkToNextPageTable(pageTablePhys, ptIndex);
-	pageTable->entries[ptIndex].addr = 0;
-	if (pdIndex < 768) {
-		if (m_pageRefcounts[pageTablePhys / HAL_VirtualMM_PageSize] == 0) {
-			KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Attempt to decrement reference count which is already zero");
+	return result;
+}
+
+// Returns end of the range part that lies in the same page table
+static INLINE uintptr_t i686_VirtualMM_GetTableRangeEnd(uintptr_t vaddr, uintptr_t end) {
+	uintptr_t tableEnd = ALIGN_DOWN(vaddr, I686_LARGE_PAGE_SIZE) + I686_LARGE_PAGE_SIZE;
+	if (tableEnd > end || tableEnd == 0) {
+		return end;
+	}
+	return tableEnd;
+}
+
+void HAL_VirtualMM_UnmapRange(uintptr_t root, uintptr_t start, uintptr_t end, HAL_VirtualMM_UnmapCallback callback,
+							  void *ctx) {
+	uintptr_t vaddr = start;
+	while (vaddr < end) {
+		uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
+		uintptr_t tableEnd = i686_VirtualMM_GetTableRangeEnd(vaddr, end);
+		union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+		// pages of user regions may be left unmapped if fork failed midway or were never touched
+		if (!(dirEntry->present)) {
+			vaddr = tableEnd;
+			continue;
 		}
-		--m_pageRefcounts[pageTablePhys / HAL_VirtualMM_PageSize];
-		if (m_pageRefcounts[pageTablePhys / HAL_VirtualMM_PageSize] == 0) {
-			pageDir->entries[pdIndex].addr = 0;
-			HAL_PhysicalMM_KernelFreeFrame(pageTablePhys);
+		if (pdIndex < I686_USER_DIRECTORY_ENTRIES && dirEntry->huge) {
+			if (vaddr % I686_LARGE_PAGE_SIZE == 0 && tableEnd - vaddr == I686_LARGE_PAGE_SIZE) {
+				HAL_PhysicalMM_Address area = HAL_VirtualMM_UnmapLargePageAt(root, vaddr);
+				if (callback != NULL) {
+					callback(area, I686_LARGE_PAGE_SIZE, ctx);
+				}
+				vaddr = tableEnd;
+				continue;
+			}
+			i686_VirtualMM_SplitLargePageOrPanic(root, pdIndex);
+		}
+		uint32_t pageTablePhys = i686_VirtualMM_WalkToNextPageTable(root, pdIndex);
+		struct i686_VirtualMM_PageTable *pageTable =
+			(struct i686_VirtualMM_PageTable *)(pageTablePhys + I686_KERNEL_MAPPING_BASE);
+		uint16_t removed = 0;
+		for (; vaddr < tableEnd; vaddr += I686_PAGE_SIZE) {
+			union i686_VirtualMM_PageTableEntry *entry = pageTable->entries + i686_VirtualMM_GetPageTableIndex(vaddr);
+			HAL_PhysicalMM_Address frame = entry->addr & I686_ADDRESS_MASK;
+			if (frame == 0 && !(entry->present)) {
+				continue;
+			}
+			entry->addr = 0;
+			++removed;
+			if (frame != 0 && callback != NULL) {
+				callback(frame, I686_PAGE_SIZE, ctx);
+			}
+		}
+		if (pdIndex < I686_USER_DIRECTORY_ENTRIES && removed != 0) {
+			if (m_pageRefcounts[pageTablePhys / HAL_VirtualMM_PageSize] < removed) {
+				KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Attempt to decrement reference count which is already zero");
+			}
+			m_pageRefcounts[pageTablePhys / HAL_VirtualMM_PageSize] -= removed;
+			if (m_pageRefcounts[pageTablePhys / HAL_VirtualMM_PageSize] == 0) {
+				dirEntry->addr = 0;
+				i686_VirtualMM_ReleasePageTable(root, pageTablePhys);
+			}
 		}
 	}
-	return result;
+}
+
+static bool i686_VirtualMM_LargePageHasAttributes(uint32_t root, uint16_t pdIndex, int flags) {
+	union i686_VirtualMM_PageTableEntry *entry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+	return (flags & (HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_WRITABLE)) != 0 &&
+		   entry->writable == ((flags & HAL_VIRT_FLAGS_WRITABLE) != 0) &&
+		   entry->user == ((flags & HAL_VIRT_FLAGS_USER_ACCESSIBLE) != 0) &&
+		   entry->cacheDisabled == ((flags & HAL_VIRT_FLAGS_DISABLE_CACHE) != 0) &&
+		   entry->noExecute == (m_noExecute && (flags & HAL_VIRT_FLAGS_EXECUTABLE) == 0);
 }
 
 void HAL_VirtualMM_SetPageAttributes(uintptr_t root, uintptr_t vaddr, int flags) {
-	uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
-	uint16_t ptIndex = i686_VirtualMM_GetPageTableIndex(vaddr);
-	uint32_t pageTablePhys = i686_VirtualMM_WalkToNextPageTable(root, pdIndex);
-	if (pageTablePhys == 0) {
-		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Trying to change permissions on the page, page table for "
-											   "which is not mapped");
+	HAL_VirtualMM_ProtectRange(root, vaddr, vaddr + I686_PAGE_SIZE, flags);
+}
+
+void HAL_VirtualMM_ProtectRange(uintptr_t root, uintptr_t start, uintptr_t end, int flags) {
+	uintptr_t vaddr = start;
+	while (vaddr < end) {
+		uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
+		uintptr_t tableEnd = i686_VirtualMM_GetTableRangeEnd(vaddr, end);
+		union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+		// pages of demand paged regions are not mapped until first access
+		if (!(dirEntry->present)) {
+			vaddr = tableEnd;
+			continue;
+		}
+		if (pdIndex < I686_USER_DIRECTORY_ENTRIES && dirEntry->huge) {
+			bool whole = vaddr % I686_LARGE_PAGE_SIZE == 0 && tableEnd - vaddr == I686_LARGE_PAGE_SIZE;
+			if (i686_VirtualMM_LargePageHasAttributes(root, pdIndex, flags)) {
+				vaddr = tableEnd;
+				continue;
+			} else if (whole && (flags & (HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_WRITABLE)) != 0) {
+				dirEntry->writable = (flags & HAL_VIRT_FLAGS_WRITABLE) != 0;
+				dirEntry->cacheDisabled = (flags & HAL_VIRT_FLAGS_DISABLE_CACHE) != 0;
+				dirEntry->user = (flags & HAL_VIRT_FLAGS_USER_ACCESSIBLE) != 0;
+				dirEntry->noExecute = m_noExecute && (flags & HAL_VIRT_FLAGS_EXECUTABLE) == 0;
+				vaddr = tableEnd;
+				continue;
+			}
+			i686_VirtualMM_SplitLargePageOrPanic(root, pdIndex);
+		}
+		uint32_t pageTablePhys = i686_VirtualMM_WalkToNextPageTable(root, pdIndex);
+		struct i686_VirtualMM_PageTable *pageTable =
+			(struct i686_VirtualMM_PageTable *)(pageTablePhys + I686_KERNEL_MAPPING_BASE);
+		for (; vaddr < tableEnd; vaddr += I686_PAGE_SIZE) {
+			union i686_VirtualMM_PageTableEntry *entry = pageTable->entries + i686_VirtualMM_GetPageTableIndex(vaddr);
+			HAL_PhysicalMM_Address addr = entry->addr & I686_ADDRESS_MASK;
+			if (addr != 0) {
+				i686_VirtualMM_SetEntry(entry, addr, flags);
+			}
+		}
 	}
-	struct i686_VirtualMM_PageTable *pageTable =
-		(struct i686_VirtualMM_PageTable *)(pageTablePhys + I686_KERNEL_MAPPING_BASE);
-	uintptr_t addr = i686_VirtualMM_WalkToNextPageTable(pageTablePhys, ptIndex);
-	if (!(pageTable->entries[ptIndex].present)) {
-		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Trying to unmap virtual page page which is not mapped");
+}
+
+void HAL_VirtualMM_ClearUserArea(uintptr_t root, HAL_VirtualMM_UnmapCallback callback, void *ctx) {
+	bool current = root == i686_CR3_Get();
+	HAL_PhysicalMM_Address pageTables[64];
+	size_t count = 0;
+	for (uint16_t pdIndex = 0; pdIndex < I686_USER_DIRECTORY_ENTRIES; ++pdIndex) {
+		union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+		if (!(dirEntry->present)) {
+			continue;
+		}
+		if (dirEntry->huge) {
+			HAL_PhysicalMM_Address area = dirEntry->addr & I686_LARGE_ADDRESS_MASK;
+			dirEntry->addr = 0;
+			callback(area, I686_LARGE_PAGE_SIZE, ctx);
+			continue;
+		}
+		uint32_t pageTablePhys = (uint32_t)(dirEntry->addr & I686_ADDRESS_MASK);
+		struct i686_VirtualMM_PageTable *pageTable =
+			(struct i686_VirtualMM_PageTable *)(pageTablePhys + I686_KERNEL_MAPPING_BASE);
+		for (uint16_t ptIndex = 0; ptIndex < I686_PAGE_TABLE_ENTRIES; ++ptIndex) {
+			HAL_PhysicalMM_Address frame = pageTable->entries[ptIndex].addr & I686_ADDRESS_MASK;
+			if (frame != 0) {
+				callback(frame, I686_PAGE_SIZE, ctx);
+			}
+		}
+		// page tables are zeroed on allocation, so their entries are left as they are
+		dirEntry->addr = 0;
+		if (current) {
+			i686_VirtualMM_ReleasePageTable(root, pageTablePhys);
+			continue;
+		}
+		pageTables[count++] = pageTablePhys;
+		if (count == ARR_SIZE(pageTables)) {
+			HAL_PhysicalMM_UserFreeFrames(pageTables, count);
+			count = 0;
+		}
+	}
+	HAL_PhysicalMM_UserFreeFrames(pageTables, count);
+	if (current) {
+		HAL_VirtualMM_Flush();
 	}
-	pageTable->entries[ptIndex].addr = addr;
-	pageTable->entries[ptIndex].writable = (flags & HAL_VIRT_FLAGS_WRITABLE) != 0;
-	pageTable->entries[ptIndex].cacheDisabled = (flags & HAL_VIRT_FLAGS_DISABLE_CACHE) != 0;
-	pageTable->entries[ptIndex].user = (flags & HAL_VIRT_FLAGS_USER_ACCESSIBLE) != 0;
-	pageTable->entries[ptIndex].present =
-		((flags & HAL_VIRT_FLAGS_WRITABLE) != 0) || ((flags & HAL_VIRT_FLAGS_READABLE) != 0);
 }
 
 uintptr_t HAL_VirtualMM_MakeNewAddressSpace() {
@@ -219,14 +616,33 @@ uintptr_t HAL_VirtualMM_MakeNewAddressSpace() {
 	if (frame == 0) {
 		return 0;
 	}
-	uint32_t *writableFrame = (uint32_t *)(frame + I686_KERNEL_MAPPING_BASE);
-	uint32_t *pageDir = (uint32_t *)(i686_CR3_Get() + I686_KERNEL_MAPPING_BASE);
-	memset(writableFrame, 0, I686_PAGE_SIZE);
-	memcpy(writableFrame + 768, pageDir + 768, (1024 - 768) * 4);
+	union i686_VirtualMM_PageTableEntry *pointers =
+		(union i686_VirtualMM_PageTableEntry *)(frame + I686_KERNEL_MAPPING_BASE);
+	union i686_VirtualMM_PageTableEntry *currentPointers =
+		(union i686_VirtualMM_PageTableEntry *)(i686_CR3_Get() + I686_KERNEL_MAPPING_BASE);
+	memset(pointers, 0, I686_PAGE_SIZE);
+	for (uint16_t i = 0; i < I686_USER_DIRECTORIES; ++i) {
+		uint32_t pageDirPhys = i686_PhysicalMM_KernelAllocFrame();
+		if (pageDirPhys == 0) {
+			HAL_VirtualMM_FreeAddressSpace(frame);
+			return 0;
+		}
+		memset((void *)(pageDirPhys + I686_KERNEL_MAPPING_BASE), 0, I686_PAGE_SIZE);
+		pointers[i].addr = pageDirPhys;
+		pointers[i].present = true;
+	}
+	pointers[I686_USER_DIRECTORIES] = currentPointers[I686_USER_DIRECTORIES];
 	return frame;
 }
 
 void HAL_VirtualMM_FreeAddressSpace(uintptr_t root) {
+	union i686_VirtualMM_PageTableEntry *pointers =
+		(union i686_VirtualMM_PageTableEntry *)(root + I686_KERNEL_MAPPING_BASE);
+	for (uint16_t i = 0; i < I686_USER_DIRECTORIES; ++i) {
+		if (pointers[i].present) {
+			HAL_PhysicalMM_KernelFreeFrame((uint32_t)(pointers[i].addr & I686_ADDRESS_MASK));
+		}
+	}
 	HAL_PhysicalMM_KernelFreeFrame(root);
 }
 
@@ -252,12 +668,64 @@ static void i686_VirtualMM_FlushCR3() {
 }
 
 void HAL_VirtualMM_Flush() {
+	m_flushStatistics.fullFlushes++;
 	i686_VirtualMM_FlushCR3();
+	i686_VirtualMM_FreePendingPageTables();
+}
+
+struct i686_VirtualMM_FlushRange {
+	uint32_t start;
+	uint32_t end;
+};
+
+static void i686_VirtualMM_InvalidateRangeRing0(void *ctx) {
+	struct i686_VirtualMM_FlushRange *range = (struct i686_VirtualMM_FlushRange *)ctx;
+	for (uint32_t page = range->start; page < range->end; page += I686_PAGE_SIZE) {
+		i686_CPU_InvalidatePage(page);
+	}
+}
+
+void HAL_VirtualMM_FlushRange(uintptr_t start, uintptr_t end) {
+	struct i686_VirtualMM_FlushRange range;
+	range.start = ALIGN_DOWN(start, I686_PAGE_SIZE);
+	range.end = ALIGN_UP(end, I686_PAGE_SIZE);
+	if (range.end <= range.start) {
+		return;
+	}
+	uint32_t pagesCount = (range.end - range.start) / I686_PAGE_SIZE;
+	if (pagesCount > I686_FLUSH_RANGE_MAX_PAGES) {
+		HAL_VirtualMM_Flush();
+		return;
+	}
+	m_flushStatistics.rangedFlushes++;
+	m_flushStatistics.invalidatedPages += pagesCount;
+	i686_Ring0Executor_Invoke((uint32_t)i686_VirtualMM_InvalidateRangeRing0, (uint32_t)&range);
+	i686_VirtualMM_FreePendingPageTables();
+}
+
+void HAL_VirtualMM_GetFlushStatistics(struct HAL_VirtualMM_FlushStatistics *stats) {
+	int level = HAL_InterruptLevel_Elevate();
+	*stats = m_flushStatistics;
+	HAL_InterruptLevel_Recover(level);
 }
 
 int HAL_VirtualMM_GetPageAttributes(uintptr_t root, uintptr_t vaddr) {
 	uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
 	uint16_t ptIndex = i686_VirtualMM_GetPageTableIndex(vaddr);
+	union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+	if (dirEntry->present && dirEntry->huge) {
+		int result = HAL_VIRT_FLAGS_READABLE;
+		if (dirEntry->user) {
+			result |= HAL_VIRT_FLAGS_USER_ACCESSIBLE;
+		}
+		if (dirEntry->writable) {
+			result |= HAL_VIRT_FLAGS_WRITABLE;
+		}
+		if (!(dirEntry->noExecute)) {
+			result |= HAL_VIRT_FLAGS_EXECUTABLE;
+		}
+		return result;
+	}
 	uint32_t pageTablePhys = i686_VirtualMM_WalkToNextPageTable(root, pdIndex);
 	if (pageTablePhys == 0) {
 		return 0;
@@ -274,12 +742,270 @@ int HAL_VirtualMM_GetPageAttributes(uintptr_t root, uintptr_t vaddr) {
 	if (pageTable->entries[ptIndex].user) {
 		result |= HAL_VIRT_FLAGS_USER_ACCESSIBLE;
 	}
-	if (pageTable->entries[ptIndex].writable) {
+	if (pageTable->entries[ptIndex].writable || pageTable->entries[ptIndex].cow) {
 		result |= HAL_VIRT_FLAGS_WRITABLE;
 	}
 	if (pageTable->entries[ptIndex].cacheDisabled) {
 		result |= HAL_VIRT_FLAGS_DISABLE_CACHE;
 	}
-	result |= HAL_VIRT_FLAGS_EXECUTABLE;
+	if (!(pageTable->entries[ptIndex].noExecute)) {
+		result |= HAL_VIRT_FLAGS_EXECUTABLE;
+	}
 	return result;
 }
+
+static struct i686_VirtualMM_PageTable *i686_VirtualMM_GetTempMappingPageTable() {
+	uint32_t pageTablePhys = i686_VirtualMM_WalkToNextPageTable(
+		i686_CR3_Get(), i686_VirtualMM_GetPageDirectoryIndex(I686_TEMP_MAPPING_AREA_START));
+	return (struct i686_VirtualMM_PageTable *)(pageTablePhys + I686_KERNEL_MAPPING_BASE);
+}
+
+static void i686_VirtualMM_InvalidateTempMappingsRing0(void *ctx) {
+	uint32_t count = (uint32_t)ctx;
+	for (uint32_t i = 0; i < count; ++i) {
+		i686_CPU_InvalidatePage(I686_TEMP_MAPPING_AREA_START + i * I686_PAGE_SIZE);
+	}
+}
+
+void HAL_VirtualMM_ZeroFrames(HAL_PhysicalMM_Address *frames, size_t count) {
+	struct i686_VirtualMM_PageTable *pageTable = i686_VirtualMM_GetTempMappingPageTable();
+	uint16_t firstSlot = i686_VirtualMM_GetPageTableIndex(I686_TEMP_MAPPING_AREA_START);
+	Mutex_Lock(&m_tempMappingMutex);
+	size_t index = 0;
+	while (index < count) {
+		uint32_t slotsUsed = 0;
+		for (; index < count && slotsUsed < I686_TEMP_MAPPING_SLOTS; ++index) {
+			if (frames[index] < I686_PHYS_LOW_LIMIT) {
+				memset((void *)((uint32_t)frames[index] + I686_KERNEL_MAPPING_BASE), 0, I686_PAGE_SIZE);
+				continue;
+			}
+			pageTable->entries[firstSlot + slotsUsed].addr = frames[index];
+			pageTable->entries[firstSlot + slotsUsed].present = true;
+			pageTable->entries[firstSlot + slotsUsed].writable = true;
+			++slotsUsed;
+		}
+		if (slotsUsed == 0) {
+			continue;
+		}
+		i686_Ring0Executor_Invoke((uint32_t)i686_VirtualMM_InvalidateTempMappingsRing0, slotsUsed);
+		memset((void *)I686_TEMP_MAPPING_AREA_START, 0, slotsUsed * I686_PAGE_SIZE);
+	}
+	Mutex_Unlock(&m_tempMappingMutex);
+}
+
+static void i686_VirtualMM_CopyFrame(HAL_PhysicalMM_Address dst, HAL_PhysicalMM_Address src) {
+	if (dst < I686_PHYS_LOW_LIMIT && src < I686_PHYS_LOW_LIMIT) {
+		memcpy((void *)((uint32_t)dst + I686_KERNEL_MAPPING_BASE), (void *)((uint32_t)src + I686_KERNEL_MAPPING_BASE),
+			   I686_PAGE_SIZE);
+		return;
+	}
+	struct i686_VirtualMM_PageTable *pageTable = i686_VirtualMM_GetTempMappingPageTable();
+	uint16_t firstSlot = i686_VirtualMM_GetPageTableIndex(I686_TEMP_MAPPING_AREA_START);
+	Mutex_Lock(&m_tempMappingMutex);
+	HAL_PhysicalMM_Address frames[2] = {dst, src};
+	for (uint16_t i = 0; i < 2; ++i) {
+		pageTable->entries[firstSlot + i].addr = frames[i];
+		pageTable->entries[firstSlot + i].present = true;
+		pageTable->entries[firstSlot + i].writable = true;
+	}
+	i686_Ring0Executor_Invoke((uint32_t)i686_VirtualMM_InvalidateTempMappingsRing0, 2);
+	memcpy((void *)I686_TEMP_MAPPING_AREA_START, (void *)(I686_TEMP_MAPPING_AREA_START + I686_PAGE_SIZE),
+		   I686_PAGE_SIZE);
+	Mutex_Unlock(&m_tempMappingMutex);
+}
+
+void *HAL_VirtualMM_MapWindow(HAL_PhysicalMM_Address frame) {
+	if (frame < I686_PHYS_LOW_LIMIT) {
+		return (void *)((uint32_t)frame + I686_KERNEL_MAPPING_BASE);
+	}
+	struct i686_VirtualMM_PageTable *pageTable = i686_VirtualMM_GetTempMappingPageTable();
+	uint16_t slot = i686_VirtualMM_GetPageTableIndex(I686_TEMP_MAPPING_AREA_START);
+	Mutex_Lock(&m_tempMappingMutex);
+	pageTable->entries[slot].addr = frame;
+	pageTable->entries[slot].present = true;
+	pageTable->entries[slot].writable = true;
+	i686_Ring0Executor_Invoke((uint32_t)i686_VirtualMM_InvalidateTempMappingsRing0, 1);
+	return (void *)I686_TEMP_MAPPING_AREA_START;
+}
+
+void HAL_VirtualMM_UnmapWindow(void *window) {
+	if ((uintptr_t)window == I686_TEMP_MAPPING_AREA_START) {
+		Mutex_Unlock(&m_tempMappingMutex);
+	}
+}
+
+HAL_PhysicalMM_Address HAL_VirtualMM_GetFrame(uintptr_t root, uintptr_t vaddr) {
+	int level = HAL_InterruptLevel_Elevate();
+	uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
+	union i686_VirtualMM_PageTableEntry *entry = i686_VirtualMM_GetPageTableEntry(root, vaddr);
+	HAL_PhysicalMM_Address frame = 0;
+	if (i686_VirtualMM_IsLargePage(root, pdIndex)) {
+		union i686_VirtualMM_PageTableEntry *dirEntry = i686_VirtualMM_GetDirectoryEntry(root, pdIndex);
+		frame = (dirEntry->addr & I686_LARGE_ADDRESS_MASK) + ALIGN_DOWN(vaddr % I686_LARGE_PAGE_SIZE, I686_PAGE_SIZE);
+	} else if (entry != NULL) {
+		frame = entry->addr & I686_ADDRESS_MASK;
+	}
+	HAL_InterruptLevel_Recover(level);
+	return frame;
+}
+
+static void i686_VirtualMM_InvalidatePageRing0(void *ctx) {
+	i686_CPU_InvalidatePage((uint32_t)ctx);
+}
+
+static void i686_VirtualMM_InvalidatePage(uint32_t root, uint32_t vaddr) {
+	if (root == i686_CR3_Get()) {
+		i686_Ring0Executor_Invoke((uint32_t)i686_VirtualMM_InvalidatePageRing0, vaddr);
+	}
+}
+
+bool HAL_VirtualMM_ShareCopyOnWrite(uintptr_t srcRoot, uintptr_t dstRoot, uintptr_t start, uintptr_t end) {
+	uintptr_t vaddr = start;
+	while (vaddr < end) {
+		uint16_t pdIndex = i686_VirtualMM_GetPageDirectoryIndex(vaddr);
+		uintptr_t tableEnd = i686_VirtualMM_GetTableRangeEnd(vaddr, end);
+		union i686_VirtualMM_PageTableEntry *srcDirEntry = i686_VirtualMM_GetDirectoryEntry(srcRoot, pdIndex);
+		union i686_VirtualMM_PageTableEntry *dstDirEntry = i686_VirtualMM_GetDirectoryEntry(dstRoot, pdIndex);
+		if (!srcDirEntry->present) {
+			vaddr = tableEnd;
+			continue;
+		}
+		// frames of large pages are copied separately, so they are shared as small pages
+		if (srcDirEntry->huge && !i686_VirtualMM_SplitLargePage(srcRoot, pdIndex)) {
+			return false;
+		}
+		uint32_t srcTablePhys = i686_VirtualMM_WalkToNextPageTable(srcRoot, pdIndex);
+		struct i686_VirtualMM_PageTable *srcTable =
+			(struct i686_VirtualMM_PageTable *)(srcTablePhys + I686_KERNEL_MAPPING_BASE);
+		// do not leave empty page tables in the destination
+		bool hasEntries = false;
+		for (uintptr_t page = vaddr; page < tableEnd && !hasEntries; page += I686_PAGE_SIZE) {
+			hasEntries = srcTable->entries[i686_VirtualMM_GetPageTableIndex(page)].addr != 0;
+		}
+		if (!hasEntries) {
+			vaddr = tableEnd;
+			continue;
+		}
+		if (!dstDirEntry->present) {
+			uint32_t addr = i686_PhysicalMM_KernelAllocFrame();
+			if (addr == 0) {
+				return false;
+			}
+			memset((void *)(addr + I686_KERNEL_MAPPING_BASE), 0, I686_PAGE_SIZE);
+			m_pageRefcounts[addr / I686_PAGE_SIZE] = 0;
+			dstDirEntry->addr = addr;
+			dstDirEntry->present = true;
+			dstDirEntry->writable = true;
+			dstDirEntry->user = true;
+		}
+		uint32_t dstTablePhys = i686_VirtualMM_WalkToNextPageTable(dstRoot, pdIndex);
+		struct i686_VirtualMM_PageTable *dstTable =
+			(struct i686_VirtualMM_PageTable *)(dstTablePhys + I686_KERNEL_MAPPING_BASE);
+		int level = HAL_InterruptLevel_Elevate();
+		for (; vaddr < tableEnd; vaddr += I686_PAGE_SIZE) {
+			uint16_t ptIndex = i686_VirtualMM_GetPageTableIndex(vaddr);
+			union i686_VirtualMM_PageTableEntry *entry = srcTable->entries + ptIndex;
+			if (!entry->present && (entry->addr & I686_ADDRESS_MASK) == 0) {
+				continue;
+			}
+			if (dstTable->entries[ptIndex].present) {
+				KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Mapping over already mapped page is not allowed");
+			}
+			HAL_VirtualMM_ReferenceFrame(entry->addr & I686_ADDRESS_MASK);
+			if (entry->writable) {
+				entry->writable = false;
+				entry->cow = true;
+			}
+			dstTable->entries[ptIndex].addr = entry->addr;
+			m_pageRefcounts[dstTablePhys / I686_PAGE_SIZE]++;
+		}
+		HAL_InterruptLevel_Recover(level);
+	}
+	return true;
+}
+
+bool HAL_VirtualMM_ResolveCopyOnWrite(uintptr_t root, uintptr_t vaddr) {
+	vaddr = ALIGN_DOWN(vaddr, I686_PAGE_SIZE);
+	int level = HAL_InterruptLevel_Elevate();
+	union i686_VirtualMM_PageTableEntry *entry = i686_VirtualMM_GetPageTableEntry(root, vaddr);
+	if (entry == NULL || !entry->present || !entry->cow) {
+		HAL_InterruptLevel_Recover(level);
+		return false;
+	}
+	HAL_PhysicalMM_Address frame = entry->addr & I686_ADDRESS_MASK;
+	HAL_PhysicalMM_Address newFrame = 0;
+	if (i686_VirtualMM_IsFrameShared(frame)) {
+		HAL_InterruptLevel_Recover(level);
+		newFrame = HAL_PhysicalMM_UserAllocFrame();
+		if (newFrame == 0) {
+			return false;
+		}
+		i686_VirtualMM_CopyFrame(newFrame, frame);
+		level = HAL_InterruptLevel_Elevate();
+		// other owners might have dropped their references while the frame was copied
+		entry = i686_VirtualMM_GetPageTableEntry(root, vaddr);
+		if (entry == NULL || !entry->present || !entry->cow || (entry->addr & I686_ADDRESS_MASK) != frame) {
+			HAL_InterruptLevel_Recover(level);
+			HAL_PhysicalMM_UserFreeFrame(newFrame);
+			return entry != NULL && entry->present && entry->writable;
+		}
+	}
+	uint32_t index = (uint32_t)(frame / I686_PAGE_SIZE);
+	if (newFrame != 0 && i686_VirtualMM_IsFrameShared(frame)) {
+		m_frameShareCounts[index]--;
+		entry->addr = (entry->addr & ~I686_ADDRESS_MASK) | newFrame;
+		newFrame = 0;
+	} else if (index < m_frameShareCountsCount) {
+		m_frameShareCounts[index] = 0;
+	}
+	entry->cow = false;
+	entry->writable = true;
+	HAL_InterruptLevel_Recover(level);
+	if (newFrame != 0) {
+		HAL_PhysicalMM_UserFreeFrame(newFrame);
+	}
+	i686_VirtualMM_InvalidatePage(root, vaddr);
+	return true;
+}
+
+bool HAL_VirtualMM_IsCopyOnWrite(uintptr_t root, uintptr_t vaddr) {
+	int level = HAL_InterruptLevel_Elevate();
+	union i686_VirtualMM_PageTableEntry *entry =
+		i686_VirtualMM_GetPageTableEntry(root, ALIGN_DOWN(vaddr, I686_PAGE_SIZE));
+	bool result = entry != NULL && entry->cow;
+	HAL_InterruptLevel_Recover(level);
+	return result;
+}
+
+void HAL_VirtualMM_ReferenceFrame(HAL_PhysicalMM_Address frame) {
+	uint32_t index = (uint32_t)(frame / I686_PAGE_SIZE);
+	if (frame / I686_PAGE_SIZE >= m_frameShareCountsCount) {
+		return;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	if (m_frameShareCounts[index] == 0xffff) {
+		KernelLog_ErrorMsg(I686_VIRT_MOD_NAME, "Frame %u is shared too many times", index);
+	}
+	m_frameShareCounts[index] = (m_frameShareCounts[index] == 0) ? 2 : m_frameShareCounts[index] + 1;
+	HAL_InterruptLevel_Recover(level);
+}
+
+bool HAL_VirtualMM_IsFrameShared(HAL_PhysicalMM_Address frame) {
+	return i686_VirtualMM_IsFrameShared(frame);
+}
+
+bool HAL_VirtualMM_DropFrameReference(HAL_PhysicalMM_Address frame) {
+	uint32_t index = (uint32_t)(frame / I686_PAGE_SIZE);
+	if (frame / I686_PAGE_SIZE >= m_frameShareCountsCount) {
+		return true;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	bool last = m_frameShareCounts[index] <= 1;
+	if (last) {
+		m_frameShareCounts[index] = 0;
+	} else {
+		m_frameShareCounts[index]--;
+	}
+	HAL_InterruptLevel_Recover(level);
+	return last;
+}
@@ -1,10 +1,21 @@
+#include <arch/i686/cpu/cpu.h>
 #include <arch/i686/cpu/idt.h>
 #include <arch/i686/memory/config.h>
+#include <arch/i686/memory/usercopy.h>
 #include <arch/i686/proc/except.h>
 #include <arch/i686/proc/isrhandler.h>
+#include <arch/i686/proc/priv.h>
 #include <arch/i686/proc/state.h>
+#include <common/core/memory/virt.h>
 #include <common/core/proc/proc.h>
 #include <common/lib/kmsg.h>
+#include <hal/proc/intlevel.h>
+
+#define I686_PAGE_FAULT_VECTOR 14
+#define I686_PAGE_FAULT_WRITE (1 << 1)
+#define I686_EFLAGS_IF (1 << 9)
+
+extern void i686_ExceptionMonitor_PageFaultEntry();
 
 static const char *m_exceptionNames[0x20] = {"Divide-by-zero Error",
 											 "Debug",
@@ -39,6 +50,30 @@ void i686_ExceptionMonitor_ExceptionHandler(void *ctx, char *frame) {
 					   state->esp, state->eflags);
 }
 
+static void i686_ExceptionMonitor_GetFaultAddressRing0(void *ctx) {
+	*(uint32_t *)ctx = i686_CPU_GetCR2();
+}
+
+// Runs in ring 1 on the stack of the faulting process, so resolving the fault may sleep the same way system calls do
+void i686_ExceptionMonitor_PageFaultHandler(struct i686_CPUState *state) {
+	uint32_t addr;
+	i686_Ring0Executor_Invoke((uint32_t)i686_ExceptionMonitor_GetFaultAddressRing0, (uint32_t)&addr);
+	if ((state->eflags & I686_EFLAGS_IF) != 0) {
+		HAL_InterruptLevel_Recover(0);
+	}
+	if (VirtualMM_HandlePageFault(addr, (state->errorcode & I686_PAGE_FAULT_WRITE) != 0)) {
+		return;
+	}
+	if (state->eip < I686_KERNEL_MAPPING_BASE) {
+		Proc_Exit(-1);
+	}
+	if (i686_UserCopy_FixupFault(state, addr)) {
+		return;
+	}
+	KernelLog_ErrorMsg("CPU Exception monitor", "Unhandled page fault at %p. EIP: %p, error code: %u", addr,
+					   state->eip, state->errorcode);
+}
+
 static bool m_errorCodes[0x20] = {false, false, false, false, false, false, false, false, true,	 false, true, true,
 								  true,	 true,	true,  false, false, true,	false, false, false, false, true, false};
 
@@ -48,4 +83,6 @@ void i686_ExceptionMonitor_Initialize() {
 															 (void *)(m_exceptionNames + i), m_errorCodes[i]);
 		i686_IDT_InstallISR(i, (uint32_t)handler);
 	}
+	i686_IDT_InstallHandler(I686_PAGE_FAULT_VECTOR, (uint32_t)i686_ExceptionMonitor_PageFaultEntry, I686_32BIT_INT_GATE,
+							1, 0x19);
 }
@@ -0,0 +1,33 @@
+bits 32
+
+global i686_ExceptionMonitor_PageFaultEntry
+
+extern i686_ExceptionMonitor_PageFaultHandler
+
+section .text
+i686_ExceptionMonitor_PageFaultEntry:
+    pusha
+
+    push es
+    push fs
+    push gs
+    push ds
+
+    mov eax, 0x21
+    mov es, eax
+    mov ds, eax
+    mov fs, eax
+    mov gs, eax
+
+    push esp
+    call i686_ExceptionMonitor_PageFaultHandler
+    add esp, 4
+
+    pop gs
+    pop fs
+    pop ds
+    pop es
+
+    popa
+    add esp, 4
+    iretd
@@ -28,6 +28,10 @@ void i686_Ring3_SyscallInit() {
 	i686_Ring3_SyscallTable[67] = (uint32_t)i686_Syscall_GetTimeOfDay;
 	i686_Ring3_SyscallTable[73] = (uint32_t)i686_Syscall_MemoryUnmap;
 	i686_Ring3_SyscallTable[99] = (uint32_t)i686_Syscall_GetDirectoryEntries;
+	i686_Ring3_SyscallTable[163] = (uint32_t)i686_Syscall_MemoryRemap;
+	i686_Ring3_SyscallTable[190] = (uint32_t)i686_Syscall_Vfork;
 	i686_Ring3_SyscallTable[197] = (uint32_t)i686_Syscall_MemoryMap;
 	i686_Ring3_SyscallTable[304] = (uint32_t)i686_Syscall_GetCWD;
+	i686_Ring3_SyscallTable[482] = (uint32_t)i686_Syscall_SharedMemoryOpen;
+	i686_Ring3_SyscallTable[483] = (uint32_t)i686_Syscall_SharedMemoryUnlink;
 }
@@ -1,6 +1,7 @@
 #include <arch/i686/proc/elf32.h>
 #include <arch/i686/proc/ring3.h>
 #include <arch/i686/proc/syscalls.h>
+#include <common/core/devices/shm.h>
 #include <common/core/fd/cwd.h>
 #include <common/core/fd/fdtable.h>
 #include <common/core/fd/vfs.h>
@@ -15,6 +16,7 @@
 #include <common/core/proc/syscall.h>
 #include <common/lib/kmsg.h>
 #include <hal/drivers/time.h>
+#include <hal/memory/virt.h>
 #include <hal/proc/extended.h>
 
 #define MAX_PATH_LEN 65536
@@ -24,159 +26,113 @@
 #define MAX_ARGS_LEN 65536
 #define PROCESS_STACK_SIZE 0x100000
 
+// Parameters are passed on the user stack right above the return address
+static bool i686_Syscall_GetParameters(struct i686_CPUState *state, uint32_t *params, size_t count) {
+	return MemorySecurity_CopyFromUser(params, state->esp + 4, count * sizeof(uint32_t));
+}
+
 void i686_Syscall_Exit(struct i686_CPUState *state) {
-	uint32_t statusStart = state->esp + 4;
-	uint32_t statusEnd = state->esp + 8;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(statusStart, statusEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[1];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	int status = *(int *)statusStart;
-	Mutex_Unlock(&(space->mutex));
+	int status = (int)params[0];
 	Proc_Exit(status);
 	KernelLog_ErrorMsg("i686 ExitProcess System Call", "Failed to terminate process");
 }
 
 void i686_Syscall_Open(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 12;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[2];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	uint32_t pathAddr = (*(uint32_t *)paramsStart);
-	int perms = *(int *)(paramsStart + 4);
-	Mutex_Unlock(&(space->mutex));
+	uint32_t pathAddr = params[0];
+	int perms = (int)params[1];
 	state->eax = Syscall_Open(pathAddr, perms);
 }
 
 void i686_Syscall_Read(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 16;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[3];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	int fd = *(int *)(paramsStart);
-	uint32_t bufferAddr = *(uint32_t *)(paramsStart + 4);
-	int size = *(int *)(paramsStart + 8);
+	int fd = (int)params[0];
+	uint32_t bufferAddr = params[1];
+	int size = (int)params[2];
 	if (size < 0) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
 	if (size > MAX_IO_BUF_LEN) {
 		size = MAX_IO_BUF_LEN;
 	}
-	Mutex_Unlock(&(space->mutex));
-	char *buf = Heap_AllocateMemory(size);
-	if (buf == NULL) {
-		state->eax = -1;
-		return;
-	}
-	int result = FileTable_FileRead(NULL, fd, buf, size);
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(bufferAddr, bufferAddr + size, MSECURITY_UW)) {
-		Heap_FreeMemory(buf, size);
-		Mutex_Unlock(&(space->mutex));
+	// filesystems and devices fill user pages directly, so the buffer is pinned for the duration of the call
+	if (!VirtualMM_PinUserRange(NULL, bufferAddr, size, true)) {
 		state->eax = -1;
 		return;
 	}
-	if (result > 0) {
-		memcpy((void *)bufferAddr, buf, result);
-	}
-	Heap_FreeMemory(buf, size);
-	Mutex_Unlock(&(space->mutex));
+	int result = FileTable_FileRead(NULL, fd, (char *)bufferAddr, size);
+	VirtualMM_UnpinUserRange(NULL, bufferAddr, size);
 	state->eax = result;
 }
 
 void i686_Syscall_Write(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 16;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[3];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	int fd = *(int *)(paramsStart);
-	uint32_t bufferAddr = *(uint32_t *)(paramsStart + 4);
-	int size = *(int *)(paramsStart + 8);
+	int fd = (int)params[0];
+	uint32_t bufferAddr = params[1];
+	int size = (int)params[2];
 	if (size < 0) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
 	if (size > MAX_IO_BUF_LEN) {
 		size = MAX_IO_BUF_LEN;
 	}
-	char *buf = Heap_AllocateMemory(size);
-	if (buf == NULL) {
-		Mutex_Unlock(&(space->mutex));
-		state->eax = -1;
-		return;
-	}
-	if (!MemorySecurity_VerifyMemoryRangePermissions(bufferAddr, bufferAddr + size, MSECURITY_UR)) {
-		Heap_FreeMemory(buf, size);
-		Mutex_Unlock(&(space->mutex));
+	if (!VirtualMM_PinUserRange(NULL, bufferAddr, size, false)) {
 		state->eax = -1;
 		return;
 	}
-	memcpy(buf, (void *)bufferAddr, size);
-	Mutex_Unlock(&(space->mutex));
-	int result = FileTable_FileWrite(NULL, fd, buf, size);
-	Heap_FreeMemory(buf, size);
+	int result = FileTable_FileWrite(NULL, fd, (const char *)bufferAddr, size);
+	VirtualMM_UnpinUserRange(NULL, bufferAddr, size);
 	state->eax = result;
 }
 
 void i686_Syscall_Close(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 8;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[1];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	int fd = *(int *)(paramsStart);
-	Mutex_Unlock(&(space->mutex));
+	int fd = (int)params[0];
 	int result = FileTable_FileClose(NULL, fd);
 	state->eax = result;
 }
 
 void i686_Syscall_MemoryUnmap(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 12;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[2];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = 0;
 		return;
 	}
-	uintptr_t addr = *(uintptr_t *)paramsStart;
-	size_t size = *(size_t *)(paramsStart + 4);
+	uintptr_t addr = params[0];
+	size_t size = params[1];
 	if (addr % HAL_VirtualMM_PageSize != 0) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = 0;
 		return;
 	}
 	if (size % HAL_VirtualMM_PageSize != 0) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = 0;
 		return;
 	}
+	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
+	Mutex_Lock(&(space->mutex));
 	int result = VirtualMM_MemoryUnmap(NULL, addr, size, false);
 	Mutex_Unlock(&(space->mutex));
 	state->eax = result;
@@ -184,38 +140,29 @@ void i686_Syscall_MemoryUnmap(struct i686_CPUState *state) {
 }
 
 void i686_Syscall_MemoryMap(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 28;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[6];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
 
-	uintptr_t addr = *(uintptr_t *)paramsStart;
-	size_t size = *(size_t *)(paramsStart + 4);
-	int prot = *(int *)(paramsStart + 8);
-	int flags = *(int *)(paramsStart + 12);
+	uintptr_t addr = params[0];
+	size_t size = params[1];
+	int prot = (int)params[2];
+	int flags = (int)params[3];
+	int fd = (int)params[4];
+	// userspace passes offset as long
+	off_t offset = (int32_t)params[5];
 
 	if ((prot & ~PROT_MASK) != 0) {
-		Mutex_Unlock(&(space->mutex));
-		state->eax = -1;
-		return;
-	}
-	if ((flags & MAP_ANON) == 0) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
 	if (addr % HAL_VirtualMM_PageSize != 0) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
 	if (size % HAL_VirtualMM_PageSize != 0) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
@@ -230,19 +177,97 @@ void i686_Syscall_MemoryMap(struct i686_CPUState *state) {
 		halFlags |= HAL_VIRT_FLAGS_EXECUTABLE;
 	}
 
-	struct VirtualMM_MemoryRegionNode *region = VirtualMM_MemoryMap(NULL, addr, size, HAL_VIRT_FLAGS_WRITABLE, false);
+	// anonymous shared mappings are backed by a fresh shared memory object, so that forked children see the same pages
+	struct File *file = NULL;
+	if ((flags & MAP_ANON) != 0 && (flags & MAP_SHARED) != 0) {
+		file = SharedMemory_MakeAnonymousFile();
+		offset = 0;
+	} else if ((flags & MAP_ANON) == 0) {
+		file = FileTable_Grab(NULL, fd);
+	}
+	if ((flags & MAP_ANON) == 0 || (flags & MAP_SHARED) != 0) {
+		if (file == NULL) {
+			state->eax = -1;
+			return;
+		}
+		// shared file mappings would need write back, so only read-only ones are allowed. Writable shared mappings of
+		// shared memory objects need descriptors opened for both reading and writing
+		bool isSharedMemory = SharedMemory_GetFileObject(file) != NULL;
+		bool writableShared = (flags & MAP_SHARED) != 0 && (prot & PROT_WRITE) != 0;
+		if (offset < 0 || offset % HAL_VirtualMM_PageSize != 0 || file->mode == VFS_O_WRONLY ||
+			(!isSharedMemory && (file->dentry == NULL || file->dentry->inode->stat.stType != VFS_DT_REG)) ||
+			(!isSharedMemory && writableShared) || (writableShared && file->mode != VFS_O_RDWR)) {
+			File_Drop(file);
+			state->eax = -1;
+			return;
+		}
+		if (isSharedMemory && (flags & MAP_SHARED) != 0) {
+			halFlags |= HAL_VIRT_FLAGS_SHARED;
+		}
+	}
+
+	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
+	Mutex_Lock(&(space->mutex));
+	struct VirtualMM_MemoryRegionNode *region;
+	if (file != NULL) {
+		region = VirtualMM_MemoryMapFile(NULL, addr, size, halFlags, file, offset, false);
+		File_Drop(file);
+		if (region != NULL && (flags & MAP_POPULATE) != 0) {
+			for (uintptr_t page = region->base.start; page < region->base.end; page += HAL_VirtualMM_PageSize) {
+				VirtualMM_PopulatePage(NULL, page);
+			}
+		}
+	} else if ((flags & MAP_HUGETLB) != 0 || size >= HAL_VirtualMM_LargePageSize) {
+		region = VirtualMM_MemoryMapDemandZeroLarge(NULL, addr, size, halFlags, false);
+		if (region != NULL && (flags & MAP_POPULATE) != 0) {
+			for (uintptr_t page = region->base.start; page < region->base.end; page += HAL_VirtualMM_PageSize) {
+				VirtualMM_PopulatePage(NULL, page);
+			}
+		}
+	} else if ((flags & MAP_POPULATE) != 0) {
+		region = VirtualMM_MemoryMapZeroed(NULL, addr, size, HAL_VIRT_FLAGS_WRITABLE, false);
+		if (region != NULL) {
+			VirtualMM_MemoryRetype(NULL, region, halFlags);
+		}
+	} else {
+		region = VirtualMM_MemoryMapDemandZero(NULL, addr, size, halFlags, false);
+	}
 	if (region == NULL) {
 		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
-	memset((void *)(region->base.start), 0, region->base.size);
-	VirtualMM_MemoryRetype(NULL, region, halFlags);
 	Mutex_Unlock(&(space->mutex));
 
 	state->eax = region->base.start;
 }
 
+void i686_Syscall_MemoryRemap(struct i686_CPUState *state) {
+	uint32_t params[4];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
+		state->eax = -1;
+		return;
+	}
+	uintptr_t addr = params[0];
+	size_t oldSize = params[1];
+	size_t newSize = params[2];
+	int flags = (int)params[3];
+	if ((flags & ~MREMAP_MAYMOVE) != 0) {
+		state->eax = -1;
+		return;
+	}
+	if (addr % HAL_VirtualMM_PageSize != 0 || oldSize % HAL_VirtualMM_PageSize != 0 ||
+		newSize % HAL_VirtualMM_PageSize != 0) {
+		state->eax = -1;
+		return;
+	}
+	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
+	Mutex_Lock(&(space->mutex));
+	uintptr_t result = VirtualMM_MemoryRemap(NULL, addr, oldSize, newSize, (flags & MREMAP_MAYMOVE) != 0, false);
+	Mutex_Unlock(&(space->mutex));
+	state->eax = (result == 0) ? (uint32_t)-1 : result;
+}
+
 void i686_Syscall_Fork(struct i686_CPUState *state) {
 	struct Proc_Process *thisProcess = Proc_GetProcessData(Proc_GetProcessID());
 	struct Proc_ProcessID newProcess = Proc_MakeNewProcess(Proc_GetProcessID());
@@ -273,9 +298,34 @@ void i686_Syscall_Fork(struct i686_CPUState *state) {
 	Proc_Resume(newProcess);
 }
 
+void i686_Syscall_Vfork(struct i686_CPUState *state) {
+	struct Proc_Process *thisProcess = Proc_GetProcessData(Proc_GetProcessID());
+	struct Proc_ProcessID newProcess = Proc_MakeNewProcess(Proc_GetProcessID());
+	if (!Proc_IsValidProcessID(newProcess)) {
+		state->eax = -1;
+		return;
+	}
+	struct Proc_Process *newProcessData = Proc_GetProcessData(newProcess);
+	newProcessData->fdTable = FileTable_Fork(NULL);
+	if (newProcessData->fdTable == NULL) {
+		Proc_Dispose(newProcessData);
+		state->eax = -1;
+		return;
+	}
+	File_Ref(thisProcess->cwd);
+	newProcessData->cwd = thisProcess->cwd;
+	// child borrows address space until it calls execve or exits. Parent is suspended until then
+	newProcessData->addressSpace = VirtualMM_ReferenceAddressSpace(thisProcess->addressSpace);
+	memcpy(newProcessData->processState, state, sizeof(struct i686_CPUState));
+	HAL_ExtendedState_StoreTo(newProcessData->extendedState);
+	((struct i686_CPUState *)newProcessData->processState)->eax = 0;
+	state->eax = newProcessData->pid.id;
+	Proc_WaitForVforkChild(newProcess);
+}
+
 static void i686_Syscall_ExecveCleanupArgs(char *pathCopy, char **argsCopy, char **envpCopy) {
 	int pathLength = strlen(pathCopy);
-	Heap_FreeMemory((void *)pathCopy, pathLength);
+	Heap_FreeMemory((void *)pathCopy, pathLength + 1);
 	int argsSize = 0;
 	int envpSize = 0;
 	for (int i = 0; argsCopy[i] != NULL; ++i) {
@@ -296,65 +346,50 @@ static void i686_Syscall_ExecveCleanupArgs(char *pathCopy, char **argsCopy, char
 	Heap_FreeMemory((void *)envpCopy, (envpSize + 1) * 4);
 }
 
+static bool i686_Syscall_ExecveCopyStrings(char **kernelCopy, uintptr_t listAddr, int count, int *fullLength) {
+	*fullLength = 0;
+	for (int i = 0; i < count; ++i) {
+		uintptr_t stringAddr;
+		if (!MemorySecurity_CopyFromUser(&stringAddr, listAddr + 4 * i, 4)) {
+			return false;
+		}
+		int length;
+		kernelCopy[i] = MemorySecurity_CopyStringFromUser(stringAddr, MAX_ARGS_LEN, &length);
+		if (kernelCopy[i] == NULL) {
+			return false;
+		}
+		*fullLength += length + 1;
+	}
+	return true;
+}
+
 void i686_Syscall_Execve(struct i686_CPUState *state) {
 	struct Proc_Process *thisProcess = Proc_GetProcessData(Proc_GetProcessID());
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 16;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[3];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	uint32_t pathAddr = *(uint32_t *)(paramsStart);
-	uint32_t argsAddr = *(uint32_t *)(paramsStart + 4);
-	uint32_t envpAddr = *(uint32_t *)(paramsStart + 8);
-	int pathLength = MemorySecurity_VerifyCString(pathAddr, MAX_PATH_LEN, MSECURITY_UR);
-	int argsCount = MemorySecurity_VerifyNullTerminatedPointerList(argsAddr, MAX_ARGS, MSECURITY_UR);
-	int envsCount = MemorySecurity_VerifyNullTerminatedPointerList(envpAddr, MAX_ENVP, MSECURITY_UR);
-	if (argsCount == -1 || envsCount == -1 || pathLength == -1) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t pathAddr = params[0];
+	uint32_t argsAddr = params[1];
+	uint32_t envpAddr = params[2];
+	int argsCount = MemorySecurity_CountUserPointers(argsAddr, MAX_ARGS);
+	int envsCount = MemorySecurity_CountUserPointers(envpAddr, MAX_ENVP);
+	if (argsCount == -1 || envsCount == -1) {
 		state->eax = -1;
 		return;
 	}
-	int fullArgsLength = 0;
-	for (int i = 0; i < argsCount; ++i) {
-		int argLength = MemorySecurity_VerifyCString(*(uint32_t *)(argsAddr + 4 * i), MAX_ARGS_LEN, MSECURITY_UR);
-		if (argLength == -1) {
-			Mutex_Unlock(&(space->mutex));
-			state->eax = -1;
-			return;
-		}
-		fullArgsLength += argLength + 1;
-	}
-	int fullEnvpLength = 0;
-	for (int i = 0; i < envsCount; ++i) {
-		int envLength = MemorySecurity_VerifyCString(*(uint32_t *)(envpAddr + 4 * i), MAX_ARGS_LEN, MSECURITY_UR);
-		if (envLength == -1) {
-			Mutex_Unlock(&(space->mutex));
-			state->eax = -1;
-			return;
-		}
-		fullEnvpLength += envLength + 1;
-	}
 
-	char *pathCopy = Heap_AllocateMemory(pathLength + 1);
+	int pathLength;
+	char *pathCopy = MemorySecurity_CopyStringFromUser(pathAddr, MAX_PATH_LEN, &pathLength);
 	if (pathCopy == NULL) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
-	memcpy(pathCopy, (void *)pathAddr, pathLength);
-	pathCopy[pathLength] = '\0';
-
-	char **argsUser = (char **)argsAddr;
-	char **envpUser = (char **)envpAddr;
 
 	char **argsKernelCopy = Heap_AllocateMemory((argsCount + 1) * 4);
 	if (argsKernelCopy == NULL) {
 		Heap_FreeMemory(pathCopy, pathLength + 1);
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
@@ -362,56 +397,30 @@ void i686_Syscall_Execve(struct i686_CPUState *state) {
 	if (envpKernelCopy == NULL) {
 		Heap_FreeMemory(pathCopy, pathLength + 1);
 		Heap_FreeMemory(argsKernelCopy, (argsCount + 1) * 4);
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
 	memset(argsKernelCopy, 0, (argsCount + 1) * 4);
 	memset(envpKernelCopy, 0, (envsCount + 1) * 4);
 
-	for (int i = 0; i < argsCount; ++i) {
-		char *argUser = argsUser[i];
-		int len = strlen(argUser);
-		char *argKernelCopy = Heap_AllocateMemory(len + 1);
-		if (argKernelCopy == NULL) {
-			Mutex_Unlock(&(space->mutex));
-			i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
-			state->eax = -1;
-			return;
-		}
-		memcpy(argKernelCopy, argUser, len);
-		argsKernelCopy[i] = argKernelCopy;
-		argKernelCopy[len] = '\0';
-	}
-
-	for (int i = 0; i < envsCount; ++i) {
-		char *envUser = envpUser[i];
-		int len = strlen(envUser);
-		char *envKernelCopy = Heap_AllocateMemory(len + 1);
-		if (envKernelCopy == NULL) {
-			Mutex_Unlock(&(space->mutex));
-			i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
-			state->eax = -1;
-			return;
-		}
-		memcpy(envKernelCopy, envUser, len + 1);
-		envpKernelCopy[i] = envKernelCopy;
-		envKernelCopy[len] = '\0';
+	int fullArgsLength, fullEnvpLength;
+	if (!i686_Syscall_ExecveCopyStrings(argsKernelCopy, argsAddr, argsCount, &fullArgsLength) ||
+		!i686_Syscall_ExecveCopyStrings(envpKernelCopy, envpAddr, envsCount, &fullEnvpLength)) {
+		i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
+		state->eax = -1;
+		return;
 	}
 
-	Mutex_Unlock(&(space->mutex));
-
+	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
 	struct VirtualMM_AddressSpace *newSpace = VirtualMM_MakeNewAddressSpace();
-	if (space == NULL) {
+	if (newSpace == NULL) {
 		i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
 		state->eax = -1;
 		return;
 	}
-	VirtualMM_SwitchToAddressSpace(newSpace);
 
 	struct FileTable *table = FileTable_Fork(NULL);
 	if (table == NULL) {
-		VirtualMM_SwitchToAddressSpace(space);
 		VirtualMM_DropAddressSpace(newSpace);
 		i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
 		state->eax = -1;
@@ -425,50 +434,75 @@ void i686_Syscall_Execve(struct i686_CPUState *state) {
 	int requiredMemorySize =
 		PROCESS_STACK_SIZE + (4 * (argsCount + 1)) + (4 * (envsCount + 1)) + 4 + fullArgsLength + fullEnvpLength;
 	struct VirtualMM_MemoryRegionNode *node =
-		VirtualMM_MemoryMap(NULL, 0, ALIGN_UP(requiredMemorySize, HAL_VirtualMM_PageSize),
-							HAL_VIRT_FLAGS_WRITABLE | HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_USER_ACCESSIBLE, true);
+		VirtualMM_MemoryMapZeroed(newSpace, 0, ALIGN_UP(requiredMemorySize, HAL_VirtualMM_PageSize),
+								  HAL_VIRT_FLAGS_WRITABLE | HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_USER_ACCESSIBLE,
+								  true);
 	if (node == NULL) {
-		VirtualMM_SwitchToAddressSpace(space);
 		FileTable_Drop(table);
 		VirtualMM_DropAddressSpace(newSpace);
 		i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
 		state->eax = -1;
 		return;
 	}
-	memset((void *)(node->base.start), 0, ALIGN_UP(requiredMemorySize, HAL_VirtualMM_PageSize));
 
+	// Area starting from the stack top is assembled in kernel memory and copied to the new address space at once
+	// stack layout on entry
+	// [main will be pushed here] esp here [argc: 4 bytes] [argv: 4 bytes] [env: 4 bytes]
+	int areaSize = requiredMemorySize - PROCESS_STACK_SIZE + 12;
+	uintptr_t areaStart = node->base.start + PROCESS_STACK_SIZE - 12;
+	char *area = Heap_AllocateMemory(areaSize);
+	if (area == NULL) {
+		FileTable_Drop(table);
+		VirtualMM_DropAddressSpace(newSpace);
+		i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
+		state->eax = -1;
+		return;
+	}
+	memset(area, 0, areaSize);
+	int areaOffset = 12;
 	// Allocate space for arguments table
-	int areaOffset = PROCESS_STACK_SIZE;
 	int argsOffset = areaOffset;
 	areaOffset += 4 * (argsCount + 1);
 	// Allocate space for environment variables table
 	int envpOffset = areaOffset;
-	memcpy((void *)(node->base.start + areaOffset), envpKernelCopy, 4 * (envsCount + 1));
-	areaOffset += 4 * (envsCount + 1);
+	areaOffset += 4 * (envsCount + 1) + 4;
 
-	char **newArgsUser = (char **)(node->base.start + argsOffset);
-	char **newEnvpUser = (char **)(node->base.start + envpOffset);
+	uint32_t *header = (uint32_t *)area;
+	uint32_t *newArgsUser = (uint32_t *)(area + argsOffset);
+	uint32_t *newEnvpUser = (uint32_t *)(area + envpOffset);
+	header[0] = argsCount;
+	header[1] = areaStart + argsOffset;
+	header[2] = areaStart + envpOffset;
 
 	for (int i = 0; i < argsCount; ++i) {
 		char *arg = argsKernelCopy[i];
 		int argLen = strlen(arg);
-		memcpy((void *)(node->base.start + areaOffset), arg, argLen + 1);
-		newArgsUser[i] = (char *)(node->base.start + areaOffset);
+		memcpy(area + areaOffset, arg, argLen + 1);
+		newArgsUser[i] = areaStart + areaOffset;
 		areaOffset += argLen + 1;
 	}
 
 	for (int i = 0; i < envsCount; ++i) {
 		char *env = envpKernelCopy[i];
 		int envLength = strlen(env);
-		memcpy((void *)(node->base.start + areaOffset), env, envLength + 1);
-		newEnvpUser[i] = (char *)(node->base.start + envpOffset);
+		memcpy(area + areaOffset, env, envLength + 1);
+		newEnvpUser[i] = areaStart + areaOffset;
 		areaOffset += envLength + 1;
 	}
 
+	bool copied = VirtualMM_CopyToAddressSpace(newSpace, areaStart, area, areaSize);
+	Heap_FreeMemory(area, areaSize);
+	if (!copied) {
+		FileTable_Drop(table);
+		VirtualMM_DropAddressSpace(newSpace);
+		i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
+		state->eax = -1;
+		return;
+	}
+
 	struct File *file = VFS_OpenAt(thisProcess->cwd, pathCopy, VFS_O_RDONLY);
 	i686_Syscall_ExecveCleanupArgs(pathCopy, argsKernelCopy, envpKernelCopy);
 	if (file == NULL) {
-		VirtualMM_SwitchToAddressSpace(space);
 		FileTable_Drop(table);
 		VirtualMM_DropAddressSpace(newSpace);
 		state->eax = -1;
@@ -478,17 +512,16 @@ void i686_Syscall_Execve(struct i686_CPUState *state) {
 	struct Elf32 *elf = Elf32_Parse(file, i686_Elf32_HeaderVerifyCallback);
 	if (elf == NULL) {
 		File_Drop(file);
-		VirtualMM_SwitchToAddressSpace(space);
 		FileTable_Drop(table);
 		VirtualMM_DropAddressSpace(newSpace);
 		state->eax = -1;
 		return;
 	}
 
-	if (!Elf32_LoadProgramHeaders(file, elf)) {
+	// New address space is filled without switching to it, so there is only one switch on success
+	if (!Elf32_LoadProgramHeaders(newSpace, file, elf)) {
 		Elf32_Dispose(elf);
 		File_Drop(file);
-		VirtualMM_SwitchToAddressSpace(space);
 		FileTable_Drop(table);
 		VirtualMM_DropAddressSpace(newSpace);
 		state->eax = -1;
@@ -500,36 +533,27 @@ void i686_Syscall_Execve(struct i686_CPUState *state) {
 	struct Proc_Process *processData = Proc_GetProcessData(Proc_GetProcessID());
 	struct FileTable *currentTable = processData->fdTable;
 	FileTable_Drop(currentTable);
+	VirtualMM_SwitchToAddressSpace(newSpace);
 	VirtualMM_DropAddressSpace(space);
 	processData->fdTable = table;
-	processData->addressSpace = newSpace;
+	Proc_ReleaseVforkParent();
 
 	uintptr_t entrypoint = elf->entryPoint;
 	Elf32_Dispose(elf);
-	// stack layout on entry
-	// [main will be pushed here] esp here [argc: 4 bytes] [argv: 4 bytes] [env: 4 bytes]
-	*(uint32_t *)(node->base.start + PROCESS_STACK_SIZE - 12) = argsCount;
-	*(uint32_t *)(node->base.start + PROCESS_STACK_SIZE - 8) = node->base.start + argsOffset;
-	*(uint32_t *)(node->base.start + PROCESS_STACK_SIZE - 4) = node->base.start + envpOffset;
-	i686_Ring3_Switch(entrypoint, node->base.start + PROCESS_STACK_SIZE - 12);
+	i686_Ring3_Switch(entrypoint, areaStart);
 }
 
 void i686_Syscall_Wait4(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 20;
 	struct Proc_Process *currentProcess = Proc_GetProcessData(Proc_GetProcessID());
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[4];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	int pid = *(int *)(paramsStart);
-	uint32_t wstatusAddr = *(uint32_t *)(paramsStart + 4);
-	int options = *(int *)(paramsStart + 8);
-	uint32_t rusageAddr = *(uint32_t *)(paramsStart + 12);
-	Mutex_Unlock(&(space->mutex));
+	int pid = (int)params[0];
+	uint32_t wstatusAddr = params[1];
+	int options = (int)params[2];
+	uint32_t rusageAddr = params[3];
 	if (pid != -1) {
 		state->eax = -1;
 		return;
@@ -552,39 +576,30 @@ void i686_Syscall_Wait4(struct i686_CPUState *state) {
 		return;
 	}
 	if (wstatusAddr != 0) {
-		Mutex_Lock(&(space->mutex));
-		if (!MemorySecurity_VerifyMemoryRangePermissions(wstatusAddr, wstatusAddr + sizeof(uintptr_t), MSECURITY_UR)) {
-			Mutex_Unlock(&(space->mutex));
+		uint32_t wstatus = (childProcess->returnCode & 0xff) | ((int)(childProcess->terminatedNormally) << 7U);
+		if (!MemorySecurity_CopyToUser(wstatusAddr, &wstatus, sizeof(wstatus))) {
 			Proc_InsertChildBack(childProcess);
 			state->eax = -1;
 			return;
 		}
-		*(uint32_t *)wstatusAddr = (childProcess->returnCode & 0xff) | ((int)(childProcess->terminatedNormally) << 7U);
-		Mutex_Unlock(&(space->mutex));
 	}
 	state->eax = childProcess->pid.id;
 	Proc_Dispose(childProcess);
 }
 
 void i686_Syscall_GetDirectoryEntries(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 16;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[3];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	int fd = *(int *)(paramsStart);
-	struct DirectoryEntry *entries = *(struct DirectoryEntry **)(paramsStart + 4);
-	int bufLength = *(int *)(paramsStart + 8);
+	int fd = (int)params[0];
+	uintptr_t entriesAddr = params[1];
+	int bufLength = (int)params[2];
 	if (bufLength < 0 || bufLength > (int)(MAX_IO_BUF_LEN / sizeof(struct DirectoryEntry))) {
 		state->eax = -1;
 		return;
 	}
-	struct DirectoryEntry *entriesEnd = entries + bufLength;
-	Mutex_Unlock(&(space->mutex));
 	struct DirectoryEntry *inKernelCopy = Heap_AllocateMemory(bufLength * sizeof(struct DirectoryEntry));
 	if (inKernelCopy == NULL) {
 		state->eax = -1;
@@ -592,51 +607,40 @@ void i686_Syscall_GetDirectoryEntries(struct i686_CPUState *state) {
 	}
 	memset(inKernelCopy, 0, bufLength * sizeof(struct DirectoryEntry));
 	int result = FileTable_FileReaddir(NULL, fd, inKernelCopy, bufLength);
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions((uintptr_t)entries, (uintptr_t)entriesEnd, MSECURITY_UW)) {
-		Mutex_Unlock(&(space->mutex));
+	if (result > 0 &&
+		!MemorySecurity_CopyToUser(entriesAddr, inKernelCopy, result * sizeof(struct DirectoryEntry))) {
 		Heap_FreeMemory(inKernelCopy, bufLength * sizeof(struct DirectoryEntry));
 		state->eax = -1;
 		return;
 	}
-	if (result > 0) {
-		memcpy(entries, inKernelCopy, result * sizeof(struct DirectoryEntry));
-	}
-	Mutex_Unlock(&(space->mutex));
+	Heap_FreeMemory(inKernelCopy, bufLength * sizeof(struct DirectoryEntry));
 	state->eax = result;
 }
 
 void i686_Syscall_Chdir(struct i686_CPUState *state) {
 	struct Proc_Process *thisProcess = Proc_GetProcessData(Proc_GetProcessID());
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 8;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[1];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	uintptr_t pathAddr = *(uintptr_t *)(paramsStart);
-	int pathLen = MemorySecurity_VerifyCString(pathAddr, MAX_PATH_LEN, MSECURITY_UR);
-	if (pathLen == -1) {
-		Mutex_Unlock(&(space->mutex));
+	int pathLength;
+	char *pathCopy = MemorySecurity_CopyStringFromUser(params[0], MAX_PATH_LEN, &pathLength);
+	if (pathCopy == NULL) {
 		state->eax = -1;
 		return;
 	}
-	struct File *newWorkingDirectory = VFS_OpenAt(thisProcess->cwd, (char *)pathAddr, VFS_O_RDONLY);
+	struct File *newWorkingDirectory = VFS_OpenAt(thisProcess->cwd, pathCopy, VFS_O_RDONLY);
+	Heap_FreeMemory(pathCopy, pathLength + 1);
 	if (newWorkingDirectory == NULL) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
 	if (newWorkingDirectory->dentry->cwd == NULL) {
 		File_Drop(newWorkingDirectory);
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
-	Mutex_Unlock(&(space->mutex));
 	File_Drop(thisProcess->cwd);
 	thisProcess->cwd = newWorkingDirectory;
 	state->eax = 0;
@@ -645,26 +649,19 @@ void i686_Syscall_Chdir(struct i686_CPUState *state) {
 
 void i686_Syscall_Fchdir(struct i686_CPUState *state) {
 	struct Proc_Process *thisProcess = Proc_GetProcessData(Proc_GetProcessID());
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 8;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[1];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	int fd = *(int *)(paramsStart);
-	Mutex_Unlock(&(space->mutex));
+	int fd = (int)params[0];
 	struct File *file = FileTable_Grab(NULL, fd);
 	if (file == NULL) {
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
 	if (file->dentry->cwd == NULL) {
 		File_Drop(file);
-		Mutex_Unlock(&(space->mutex));
 		state->eax = -1;
 		return;
 	}
@@ -675,26 +672,32 @@ void i686_Syscall_Fchdir(struct i686_CPUState *state) {
 }
 
 void i686_Syscall_GetCWD(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 12;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[2];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	uintptr_t bufferAddr = *(uintptr_t *)(paramsStart);
-	size_t size = *(size_t *)(paramsStart + 4);
-	if (!MemorySecurity_VerifyMemoryRangePermissions(bufferAddr, bufferAddr + size, MSECURITY_UW)) {
-		Mutex_Unlock(&(space->mutex));
+	uintptr_t bufferAddr = params[0];
+	size_t size = params[1];
+	if (size == 0) {
+		state->eax = -1;
+		return;
+	}
+	if (size > MAX_PATH_LEN) {
+		size = MAX_PATH_LEN;
+	}
+	char *buf = Heap_AllocateMemory(size);
+	if (buf == NULL) {
 		state->eax = -1;
 		return;
 	}
 	struct Proc_Process *thisProcess = Proc_GetProcessData(Proc_GetProcessID());
 	struct File *cwd = thisProcess->cwd;
-	int result = CWD_GetWorkingDirectoryPath(cwd->dentry->cwd, (char *)bufferAddr, size);
-	Mutex_Unlock(&(space->mutex));
+	int result = CWD_GetWorkingDirectoryPath(cwd->dentry->cwd, buf, size);
+	if (result == 0 && !MemorySecurity_CopyToUser(bufferAddr, buf, strlen(buf) + 1)) {
+		result = -1;
+	}
+	Heap_FreeMemory(buf, size);
 	state->eax = result;
 }
 
@@ -709,46 +712,52 @@ void i686_Syscall_GetPPID(struct i686_CPUState *state) {
 }
 
 void i686_Syscall_Fstat(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 12;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[2];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	int fd = *(int *)(paramsStart);
-	uintptr_t statAddr = *(uintptr_t *)(paramsStart + 4);
-	if (!MemorySecurity_VerifyMemoryRangePermissions(statAddr, statAddr + sizeof(struct VFS_Stat), MSECURITY_UW)) {
-		Mutex_Unlock(&(space->mutex));
-		state->eax = -1;
-		return;
+	int fd = (int)params[0];
+	uintptr_t statAddr = params[1];
+	struct VFS_Stat stat;
+	memset(&stat, 0, sizeof(struct VFS_Stat));
+	int result = FileTable_FileStat(NULL, fd, &stat);
+	if (result == 0 && !MemorySecurity_CopyToUser(statAddr, &stat, sizeof(struct VFS_Stat))) {
+		result = -1;
 	}
-	struct VFS_Stat *stat = (struct VFS_Stat *)statAddr;
-	state->eax = FileTable_FileStat(NULL, fd, stat);
-	Mutex_Unlock(&(space->mutex));
+	state->eax = result;
 }
 
 void i686_Syscall_GetTimeOfDay(struct i686_CPUState *state) {
-	uint32_t paramsStart = state->esp + 4;
-	uint32_t paramsEnd = state->esp + 12;
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	if (!MemorySecurity_VerifyMemoryRangePermissions(paramsStart, paramsEnd, MSECURITY_UR)) {
-		Mutex_Unlock(&(space->mutex));
+	uint32_t params[1];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
 		state->eax = -1;
 		return;
 	}
-	uintptr_t valAddr = *(uintptr_t *)paramsStart;
-	if (!MemorySecurity_VerifyMemoryRangePermissions(valAddr, valAddr + sizeof(struct timeval), MSECURITY_UW)) {
-		Mutex_Unlock(&(space->mutex));
+	struct timeval val;
+	val.tv_sec = HAL_Time_GetUnixTime();
+	val.tv_usec = 0;
+	if (!MemorySecurity_CopyToUser(params[0], &val, sizeof(struct timeval))) {
 		state->eax = -1;
 		return;
 	}
-	struct timeval *val = (struct timeval *)valAddr;
-	val->tv_sec = HAL_Time_GetUnixTime();
-	val->tv_usec = 0;
-	Mutex_Unlock(&(space->mutex));
 	state->eax = 0;
 }
+
+void i686_Syscall_SharedMemoryOpen(struct i686_CPUState *state) {
+	uint32_t params[2];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
+		state->eax = -1;
+		return;
+	}
+	state->eax = Syscall_SharedMemoryOpen(params[0], (int)params[1]);
+}
+
+void i686_Syscall_SharedMemoryUnlink(struct i686_CPUState *state) {
+	uint32_t params[1];
+	if (!i686_Syscall_GetParameters(state, params, ARR_SIZE(params))) {
+		state->eax = -1;
+		return;
+	}
+	state->eax = Syscall_SharedMemoryUnlink(params[0]);
+}
@@ -10,7 +10,9 @@ void i686_Syscall_Write(struct i686_CPUState *state);
 void i686_Syscall_Close(struct i686_CPUState *state);
 void i686_Syscall_MemoryMap(struct i686_CPUState *state);
 void i686_Syscall_MemoryUnmap(struct i686_CPUState *state);
+void i686_Syscall_MemoryRemap(struct i686_CPUState *state);
 void i686_Syscall_Fork(struct i686_CPUState *state);
+void i686_Syscall_Vfork(struct i686_CPUState *state);
 void i686_Syscall_Execve(struct i686_CPUState *state);
 void i686_Syscall_Wait4(struct i686_CPUState *state);
 void i686_Syscall_GetDirectoryEntries(struct i686_CPUState *state);
@@ -21,5 +23,7 @@ void i686_Syscall_GetPID(struct i686_CPUState *state);
 void i686_Syscall_GetPPID(struct i686_CPUState *state);
 void i686_Syscall_Fstat(struct i686_CPUState *state);
 void i686_Syscall_GetTimeOfDay(struct i686_CPUState *state);
+void i686_Syscall_SharedMemoryOpen(struct i686_CPUState *state);
+void i686_Syscall_SharedMemoryUnlink(struct i686_CPUState *state);
 
 #endif
@@ -0,0 +1,199 @@
+#include <common/core/devices/heapprof.h>
+#include <common/core/fd/fd.h>
+#include <common/core/fd/fs/devfs.h>
+#include <common/core/fd/vfs.h>
+#include <common/core/memory/heap.h>
+#include <common/core/memory/heapprof.h>
+#include <common/core/memory/objcache.h>
+#include <common/lib/kmsg.h>
+#include <common/lib/printf.h>
+
+#define HEAPPROF_MAX_REPORTED_SITES 1024
+#define HEAPPROF_LINE_SIZE 128
+
+struct HeapProfDevice_Report {
+	char *buf;
+	size_t size;
+	size_t capacity;
+	size_t pos;
+};
+
+static void HeapProfDevice_Append(struct HeapProfDevice_Report *report, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	report->size += va_sprintf(fmt, report->buf + report->size, report->capacity - report->size, args);
+	va_end(args);
+}
+
+static void HeapProfDevice_CountCache(MAYBE_UNUSED struct ObjectCache *cache, void *ctx) {
+	(*(size_t *)ctx)++;
+}
+
+static void HeapProfDevice_ReportCache(struct ObjectCache *cache, void *ctx) {
+	struct HeapProfDevice_Report *report = (struct HeapProfDevice_Report *)ctx;
+	struct ObjectCache_Statistics stats;
+	ObjectCache_GetStatistics(cache, &stats);
+	HeapProfDevice_Append(report, "%s: object %u, slot %u, blocks %u, in use %u, free %u, allocations %u\n",
+						  stats.name, stats.objectSize, stats.slotSize, stats.blocksCount, stats.objectsInUse,
+						  stats.objectsFree, stats.allocationsCount);
+}
+
+static void HeapProfDevice_ReportSizeClasses(struct HeapProfDevice_Report *report) {
+	HeapProfDevice_Append(report, "Size classes (size: blocks, empty blocks, cached, objects, requested, allocated):\n");
+	size_t count = Heap_GetSizeClassesCount();
+	for (size_t i = 0; i <= count; ++i) {
+		struct Heap_SizeClassStatistics stats;
+		Heap_GetSizeClassStatistics(i, &stats);
+		if (i == count) {
+			HeapProfDevice_Append(report, "large: areas %u, requested %u, allocated %u\n", stats.objectsInUse,
+								  stats.requestedBytes, stats.allocatedBytes);
+		} else if (stats.blocksCount != 0) {
+			HeapProfDevice_Append(report, "%u: %u, %u, %u, %u, %u, %u\n", stats.objectSize, stats.blocksCount,
+								  stats.emptyBlocksCount, stats.cachedObjects, stats.objectsInUse, stats.requestedBytes,
+								  stats.allocatedBytes);
+		}
+	}
+}
+
+static void HeapProfDevice_ReportSites(struct HeapProfDevice_Report *report, struct HeapProf_Site *sites,
+									   size_t count) {
+	// insertion sort by live bytes, descending. Good enough for a thousand of sites
+	for (size_t i = 1; i < count; ++i) {
+		struct HeapProf_Site current = sites[i];
+		size_t j = i;
+		for (; j > 0 && sites[j - 1].liveBytes < current.liveBytes; --j) {
+			sites[j] = sites[j - 1];
+		}
+		sites[j] = current;
+	}
+	HeapProfDevice_Append(report, "Allocation sites (caller: live bytes, live allocations, total allocations):\n");
+	for (size_t i = 0; i < count; ++i) {
+		HeapProfDevice_Append(report, "0x%p: %u, %u, %u\n", sites[i].caller, sites[i].liveBytes, sites[i].liveCount,
+							  sites[i].totalCount);
+	}
+}
+
+static bool HeapProfDevice_MakeReport(struct HeapProfDevice_Report *report) {
+	struct HeapProf_Site *sites = Heap_AllocateMemory(sizeof(struct HeapProf_Site) * HEAPPROF_MAX_REPORTED_SITES);
+	if (sites == NULL) {
+		return false;
+	}
+	size_t sitesCount = HeapProf_GetSites(sites, HEAPPROF_MAX_REPORTED_SITES);
+	size_t cachesCount = 0;
+	ObjectCache_Enumerate(HeapProfDevice_CountCache, &cachesCount);
+	size_t linesCount = 8 + Heap_GetSizeClassesCount() + cachesCount + sitesCount;
+	report->capacity = linesCount * HEAPPROF_LINE_SIZE;
+	report->buf = Heap_AllocateMemory(report->capacity);
+	if (report->buf == NULL) {
+		Heap_FreeMemory(sites, sizeof(struct HeapProf_Site) * HEAPPROF_MAX_REPORTED_SITES);
+		return false;
+	}
+	report->size = report->pos = 0;
+	struct HeapProf_Statistics stats;
+	HeapProf_GetStatistics(&stats);
+	HeapProfDevice_Append(report, "Heap profiler %s: %u sites, %u live allocations, %u dropped\n",
+						  stats.enabled ? "enabled" : "disabled", stats.sitesCount, stats.liveAllocations,
+						  stats.droppedAllocations);
+	HeapProfDevice_ReportSizeClasses(report);
+	HeapProfDevice_Append(report, "Object caches:\n");
+	ObjectCache_Enumerate(HeapProfDevice_ReportCache, report);
+	HeapProfDevice_ReportSites(report, sites, sitesCount);
+	Heap_FreeMemory(sites, sizeof(struct HeapProf_Site) * HEAPPROF_MAX_REPORTED_SITES);
+	return true;
+}
+
+static int HeapProfDevice_Read(struct File *file, int size, char *buf) {
+	struct HeapProfDevice_Report *report = (struct HeapProfDevice_Report *)(file->ctx);
+	if (size < 0) {
+		return -1;
+	}
+	size_t count = report->size - report->pos;
+	if (count > (size_t)size) {
+		count = (size_t)size;
+	}
+	memcpy(buf, report->buf + report->pos, count);
+	report->pos += count;
+	return (int)count;
+}
+
+static bool HeapProfDevice_IsCommand(const char *buf, int size, const char *command) {
+	size_t length = strlen(command);
+	if ((size_t)size < length) {
+		return false;
+	}
+	for (size_t i = 0; i < length; ++i) {
+		if (buf[i] != command[i]) {
+			return false;
+		}
+	}
+	return (size_t)size == length || buf[length] == '\n';
+}
+
+static int HeapProfDevice_Write(MAYBE_UNUSED struct File *file, int size, const char *buf) {
+	if (HeapProfDevice_IsCommand(buf, size, "start")) {
+		if (!HeapProf_Start()) {
+			return -1;
+		}
+		return size;
+	} else if (HeapProfDevice_IsCommand(buf, size, "stop")) {
+		HeapProf_Stop();
+		return size;
+	}
+	return -1;
+}
+
+static void HeapProfDevice_Close(struct File *file) {
+	struct HeapProfDevice_Report *report = (struct HeapProfDevice_Report *)(file->ctx);
+	Heap_FreeMemory(report->buf, report->capacity);
+	FREE_OBJ(report);
+	VFS_FinalizeFile(file);
+}
+
+static struct FileOperations HeapProfDevice_FileOperations = {.read = HeapProfDevice_Read,
+															  .write = HeapProfDevice_Write,
+															  .readdir = NULL,
+															  .lseek = NULL,
+															  .flush = NULL,
+															  .close = HeapProfDevice_Close};
+
+static struct File *HeapProfDevice_Open(MAYBE_UNUSED struct VFS_Inode *inode, MAYBE_UNUSED int perm) {
+	struct File *file = ObjectCache_Allocate(&File_Cache);
+	if (file == NULL) {
+		return NULL;
+	}
+	struct HeapProfDevice_Report *report = ALLOC_OBJ(struct HeapProfDevice_Report);
+	if (report == NULL) {
+		ObjectCache_Free(&File_Cache, file);
+		return NULL;
+	}
+	if (!HeapProfDevice_MakeReport(report)) {
+		FREE_OBJ(report);
+		ObjectCache_Free(&File_Cache, file);
+		return NULL;
+	}
+	file->ctx = report;
+	file->ops = &HeapProfDevice_FileOperations;
+	file->isATTY = false;
+	return file;
+}
+
+static struct VFS_InodeOperations HeapProfDevice_InodeOperations = {
+	.getChild = NULL,
+	.open = HeapProfDevice_Open,
+	.mkdir = NULL,
+	.link = NULL,
+	.unlink = NULL,
+};
+
+void HeapProfDevice_Register() {
+	struct VFS_Inode *inode = ObjectCache_Allocate(&VFS_InodeCache);
+	if (inode == NULL) {
+		KernelLog_ErrorMsg("Heap Profiler Device", "Failed to allocate inode for heap profiler");
+	}
+	inode->ctx = NULL;
+	inode->ops = &HeapProfDevice_InodeOperations;
+	if (!DevFS_RegisterInode("heapprof", inode)) {
+		KernelLog_ErrorMsg("Heap Profiler Device",
+						   "Failed to register heap profiler inode in Device Filesystem (path: \"/dev/heapprof\")");
+	}
+}
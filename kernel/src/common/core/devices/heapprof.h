@@ -0,0 +1,6 @@
+#ifndef __DEVICE_HEAPPROF_H_INCLUDED__
+#define __DEVICE_HEAPPROF_H_INCLUDED__
+
+void HeapProfDevice_Register();
+
+#endif
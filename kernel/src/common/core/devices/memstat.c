@@ -0,0 +1,115 @@
+#include <common/core/devices/memstat.h>
+#include <common/core/fd/fd.h>
+#include <common/core/fd/fs/devfs.h>
+#include <common/core/fd/vfs.h>
+#include <common/core/memory/heap.h>
+#include <common/core/memory/objcache.h>
+#include <common/core/memory/zeropool.h>
+#include <common/lib/kmsg.h>
+#include <common/lib/printf.h>
+#include <hal/memory/phys.h>
+#include <hal/memory/virt.h>
+
+#define MEMSTAT_REPORT_SIZE 1024
+
+struct MemStatDevice_Report {
+	char buf[MEMSTAT_REPORT_SIZE];
+	size_t size;
+	size_t pos;
+};
+
+static void MemStatDevice_Append(struct MemStatDevice_Report *report, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	report->size += va_sprintf(fmt, report->buf + report->size, MEMSTAT_REPORT_SIZE - report->size, args);
+	va_end(args);
+}
+
+static void MemStatDevice_ReportFreeBlocks(struct MemStatDevice_Report *report) {
+	static const char *arenaNames[HAL_PHYS_ARENAS_COUNT] = {"kernel", "user"};
+	MemStatDevice_Append(report, "Free frame blocks (arena: count of each order, starting from single frames):\n");
+	for (int arena = 0; arena < HAL_PHYS_ARENAS_COUNT; ++arena) {
+		MemStatDevice_Append(report, "%s:", arenaNames[arena]);
+		for (size_t order = 0; order < HAL_PhysicalMM_OrdersCount; ++order) {
+			MemStatDevice_Append(report, " %u", HAL_PhysicalMM_GetFreeBlocksCount(arena, order));
+		}
+		MemStatDevice_Append(report, "\n");
+	}
+}
+
+static void MemStatDevice_MakeReport(struct MemStatDevice_Report *report) {
+	report->size = report->pos = 0;
+	MemStatDevice_ReportFreeBlocks(report);
+	struct ZeroPool_Statistics poolStats;
+	ZeroPool_GetStatistics(&poolStats);
+	MemStatDevice_Append(report, "Zeroed frames pool: frames %u, capacity %u, hits %u, misses %u\n",
+						 poolStats.framesCount, poolStats.capacity, poolStats.hits, poolStats.misses);
+	struct HAL_VirtualMM_FlushStatistics flushStats;
+	HAL_VirtualMM_GetFlushStatistics(&flushStats);
+	MemStatDevice_Append(report, "TLB flushes: full %u, ranged %u, pages invalidated %u\n", flushStats.fullFlushes,
+						 flushStats.rangedFlushes, flushStats.invalidatedPages);
+}
+
+static int MemStatDevice_Read(struct File *file, int size, char *buf) {
+	struct MemStatDevice_Report *report = (struct MemStatDevice_Report *)(file->ctx);
+	if (size < 0) {
+		return -1;
+	}
+	size_t count = report->size - report->pos;
+	if (count > (size_t)size) {
+		count = (size_t)size;
+	}
+	memcpy(buf, report->buf + report->pos, count);
+	report->pos += count;
+	return (int)count;
+}
+
+static void MemStatDevice_Close(struct File *file) {
+	FREE_OBJ(((struct MemStatDevice_Report *)(file->ctx)));
+	VFS_FinalizeFile(file);
+}
+
+static struct FileOperations MemStatDevice_FileOperations = {.read = MemStatDevice_Read,
+															 .write = NULL,
+															 .readdir = NULL,
+															 .lseek = NULL,
+															 .flush = NULL,
+															 .close = MemStatDevice_Close};
+
+static struct File *MemStatDevice_Open(MAYBE_UNUSED struct VFS_Inode *inode, MAYBE_UNUSED int perm) {
+	struct File *file = ObjectCache_Allocate(&File_Cache);
+	if (file == NULL) {
+		return NULL;
+	}
+	struct MemStatDevice_Report *report = ALLOC_OBJ(struct MemStatDevice_Report);
+	if (report == NULL) {
+		ObjectCache_Free(&File_Cache, file);
+		return NULL;
+	}
+	MemStatDevice_MakeReport(report);
+	file->ctx = report;
+	file->ops = &MemStatDevice_FileOperations;
+	file->isATTY = false;
+	return file;
+}
+
+static struct VFS_InodeOperations MemStatDevice_InodeOperations = {
+	.getChild = NULL,
+	.open = MemStatDevice_Open,
+	.mkdir = NULL,
+	.link = NULL,
+	.unlink = NULL,
+};
+
+void MemStatDevice_Register() {
+	struct VFS_Inode *inode = ObjectCache_Allocate(&VFS_InodeCache);
+	if (inode == NULL) {
+		KernelLog_ErrorMsg("Memory Statistics Device", "Failed to allocate inode for memory statistics");
+	}
+	inode->ctx = NULL;
+	inode->ops = &MemStatDevice_InodeOperations;
+	if (!DevFS_RegisterInode("memstat", inode)) {
+		KernelLog_ErrorMsg("Memory Statistics Device",
+						   "Failed to register memory statistics inode in Device Filesystem (path: \"/dev/memstat\")");
+	}
+}
@@ -0,0 +1,6 @@
+#ifndef __DEVICE_MEMSTAT_H_INCLUDED__
+#define __DEVICE_MEMSTAT_H_INCLUDED__
+
+void MemStatDevice_Register();
+
+#endif
@@ -0,0 +1,268 @@
+#include <common/core/devices/shm.h>
+#include <common/core/fd/fs/devfs.h>
+#include <common/core/fd/vfs.h>
+#include <common/core/memory/heap.h>
+#include <common/core/memory/objcache.h>
+#include <common/core/memory/pagecache.h>
+#include <common/core/proc/mutex.h>
+#include <common/lib/kmsg.h>
+
+#define SHM_PREFIX "shm."
+#define SHM_PREFIX_LENGTH 4
+#define SHM_MAX_NAME_LENGTH (VFS_MAX_NAME_LENGTH - SHM_PREFIX_LENGTH)
+
+struct SharedMemory_Object {
+	struct PageCache cache;
+	struct Mutex mutex;
+	size_t refCount;
+	// devfs inodes are copied into inode cache, so open looks objects up by serial instead of trusting pointers
+	size_t serial;
+	struct VFS_Inode *inode;
+	char *name;
+	struct SharedMemory_Object *prev, *next;
+};
+
+static struct Mutex m_registryMutex = {.queueHead = NULL, .queueTail = NULL, .locked = false};
+static struct SharedMemory_Object *m_registryHead = NULL;
+static size_t m_nextSerial = 1;
+
+static struct SharedMemory_Object *SharedMemory_NewObject() {
+	struct SharedMemory_Object *object = ALLOC_OBJ(struct SharedMemory_Object);
+	if (object == NULL) {
+		return NULL;
+	}
+	PageCache_Initialize(&(object->cache), false);
+	Mutex_Initialize(&(object->mutex));
+	object->refCount = 1;
+	object->serial = 0;
+	object->inode = NULL;
+	object->name = NULL;
+	object->prev = object->next = NULL;
+	return object;
+}
+
+static void SharedMemory_Reference(struct SharedMemory_Object *object) {
+	Mutex_Lock(&(object->mutex));
+	object->refCount++;
+	Mutex_Unlock(&(object->mutex));
+}
+
+static void SharedMemory_Drop(struct SharedMemory_Object *object) {
+	Mutex_Lock(&(object->mutex));
+	object->refCount--;
+	if (object->refCount != 0) {
+		Mutex_Unlock(&(object->mutex));
+		return;
+	}
+	Mutex_Unlock(&(object->mutex));
+	PageCache_Clear(&(object->cache));
+	if (object->name != NULL) {
+		Heap_FreeMemory(object->name, strlen(object->name) + 1);
+	}
+	FREE_OBJ(object);
+}
+
+static void SharedMemory_Close(struct File *file) {
+	SharedMemory_Drop((struct SharedMemory_Object *)(file->ctx));
+	if (file->dentry != NULL) {
+		VFS_FinalizeFile(file);
+	}
+}
+
+static struct FileOperations SharedMemory_FileOperations = {.read = NULL,
+															.write = NULL,
+															.readdir = NULL,
+															.lseek = NULL,
+															.flush = NULL,
+															.close = SharedMemory_Close};
+
+struct SharedMemory_Object *SharedMemory_GetFileObject(struct File *file) {
+	if (file->ops != &SharedMemory_FileOperations) {
+		return NULL;
+	}
+	return (struct SharedMemory_Object *)(file->ctx);
+}
+
+uintptr_t SharedMemory_GetPage(struct SharedMemory_Object *object, off_t offset) {
+	return PageCache_GetPage(&(object->cache), NULL, offset);
+}
+
+static struct File *SharedMemory_MakeFile(struct SharedMemory_Object *object) {
+	struct File *file = ObjectCache_Allocate(&File_Cache);
+	if (file == NULL) {
+		return NULL;
+	}
+	file->offset = 0;
+	file->ctx = object;
+	file->ops = &SharedMemory_FileOperations;
+	file->isATTY = false;
+	return file;
+}
+
+struct File *SharedMemory_MakeAnonymousFile() {
+	struct SharedMemory_Object *object = SharedMemory_NewObject();
+	if (object == NULL) {
+		return NULL;
+	}
+	struct File *file = SharedMemory_MakeFile(object);
+	if (file == NULL) {
+		SharedMemory_Drop(object);
+		return NULL;
+	}
+	Mutex_Initialize(&(file->mutex));
+	file->refCount = 1;
+	file->mode = VFS_O_RDWR;
+	file->dentry = NULL;
+	return file;
+}
+
+static struct SharedMemory_Object *SharedMemory_FindByName(const char *name) {
+	for (struct SharedMemory_Object *current = m_registryHead; current != NULL; current = current->next) {
+		if (StringsEqual(current->name, name)) {
+			return current;
+		}
+	}
+	return NULL;
+}
+
+static struct File *SharedMemory_OpenInode(struct VFS_Inode *inode, MAYBE_UNUSED int perm) {
+	size_t serial = (size_t)(inode->ctx);
+	Mutex_Lock(&m_registryMutex);
+	struct SharedMemory_Object *object = m_registryHead;
+	while (object != NULL && object->serial != serial) {
+		object = object->next;
+	}
+	if (object == NULL) {
+		Mutex_Unlock(&m_registryMutex);
+		return NULL;
+	}
+	SharedMemory_Reference(object);
+	Mutex_Unlock(&m_registryMutex);
+	struct File *file = SharedMemory_MakeFile(object);
+	if (file == NULL) {
+		SharedMemory_Drop(object);
+		return NULL;
+	}
+	return file;
+}
+
+static struct VFS_InodeOperations SharedMemory_InodeOperations = {
+	.getChild = NULL,
+	.open = SharedMemory_OpenInode,
+	.mkdir = NULL,
+	.link = NULL,
+	.unlink = NULL,
+};
+
+static bool SharedMemory_IsValidName(const char *name) {
+	size_t length = strlen(name);
+	if (length == 0 || length > SHM_MAX_NAME_LENGTH) {
+		return false;
+	}
+	for (size_t i = 0; i < length; ++i) {
+		if (name[i] == '/') {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void SharedMemory_GetDeviceName(const char *name, char *buf) {
+	memcpy(buf, SHM_PREFIX, SHM_PREFIX_LENGTH);
+	memcpy(buf + SHM_PREFIX_LENGTH, name, strlen(name) + 1);
+}
+
+static bool SharedMemory_Create(const char *name) {
+	struct SharedMemory_Object *object = SharedMemory_NewObject();
+	if (object == NULL) {
+		return false;
+	}
+	size_t length = strlen(name);
+	object->name = Heap_AllocateMemory(length + 1);
+	if (object->name == NULL) {
+		SharedMemory_Drop(object);
+		return false;
+	}
+	memcpy(object->name, name, length + 1);
+	object->inode = ObjectCache_Allocate(&VFS_InodeCache);
+	if (object->inode == NULL) {
+		SharedMemory_Drop(object);
+		return false;
+	}
+	object->serial = m_nextSerial++;
+	object->inode->ctx = (void *)(object->serial);
+	object->inode->ops = &SharedMemory_InodeOperations;
+	object->inode->stat.stType = VFS_DT_REG;
+	object->inode->stat.stSize = 0;
+	object->inode->stat.stBlksize = 0;
+	object->inode->stat.stBlkcnt = 0;
+	char deviceName[VFS_MAX_NAME_LENGTH + 1];
+	SharedMemory_GetDeviceName(name, deviceName);
+	if (!DevFS_RegisterInode(deviceName, object->inode)) {
+		ObjectCache_Free(&VFS_InodeCache, object->inode);
+		SharedMemory_Drop(object);
+		return false;
+	}
+	// registry holds the initial reference until the object is unlinked
+	object->next = m_registryHead;
+	if (m_registryHead != NULL) {
+		m_registryHead->prev = object;
+	}
+	m_registryHead = object;
+	return true;
+}
+
+struct File *SharedMemory_Open(const char *name, int perm, bool create, bool exclusive) {
+	if (name[0] == '/') {
+		name++;
+	}
+	if (!SharedMemory_IsValidName(name)) {
+		return NULL;
+	}
+	if (create) {
+		Mutex_Lock(&m_registryMutex);
+		bool exists = SharedMemory_FindByName(name) != NULL;
+		if ((exists && exclusive) || (!exists && !SharedMemory_Create(name))) {
+			Mutex_Unlock(&m_registryMutex);
+			return NULL;
+		}
+		Mutex_Unlock(&m_registryMutex);
+	}
+	char path[VFS_MAX_NAME_LENGTH + 6];
+	memcpy(path, "/dev/", 5);
+	SharedMemory_GetDeviceName(name, path + 5);
+	return VFS_Open(path, perm);
+}
+
+bool SharedMemory_Unlink(const char *name) {
+	if (name[0] == '/') {
+		name++;
+	}
+	if (!SharedMemory_IsValidName(name)) {
+		return false;
+	}
+	Mutex_Lock(&m_registryMutex);
+	struct SharedMemory_Object *object = SharedMemory_FindByName(name);
+	if (object == NULL) {
+		Mutex_Unlock(&m_registryMutex);
+		return false;
+	}
+	if (object->prev != NULL) {
+		object->prev->next = object->next;
+	} else {
+		m_registryHead = object->next;
+	}
+	if (object->next != NULL) {
+		object->next->prev = object->prev;
+	}
+	char deviceName[VFS_MAX_NAME_LENGTH + 1];
+	SharedMemory_GetDeviceName(name, deviceName);
+	if (!DevFS_UnregisterInode(deviceName)) {
+		KernelLog_ErrorMsg("Shared Memory", "Registered shared memory object is missing from Device Filesystem");
+	}
+	Mutex_Unlock(&m_registryMutex);
+	// devfs no longer hands out copies of the inode, and open files keep their own references to the object
+	ObjectCache_Free(&VFS_InodeCache, object->inode);
+	SharedMemory_Drop(object);
+	return true;
+}
@@ -0,0 +1,18 @@
+#ifndef __DEVICE_SHM_H_INCLUDED__
+#define __DEVICE_SHM_H_INCLUDED__
+
+#include <common/core/fd/fd.h>
+#include <common/misc/utils.h>
+
+// Shared memory objects are unsized page caches without a backing file. Mapping them with MAP_SHARED maps the same
+// frames in every address space. Named objects are visible as /dev/shm.<name>
+struct SharedMemory_Object;
+
+struct File *SharedMemory_MakeAnonymousFile();
+struct File *SharedMemory_Open(const char *name, int perm, bool create, bool exclusive);
+bool SharedMemory_Unlink(const char *name);
+
+struct SharedMemory_Object *SharedMemory_GetFileObject(struct File *file);
+uintptr_t SharedMemory_GetPage(struct SharedMemory_Object *object, off_t offset);
+
+#endif
@@ -91,7 +91,7 @@ bool GPT_EnumeratePartitions(struct Storage_Device *dev) {
 			KernelLog_WarnMsg("GPT Partition Table Parser", "Failed to make partition device");
 			for (size_t j = 0; j < i; ++j) {
 				if (partdevs[j] != NULL) {
-					FREE_OBJ(partdevs[j]);
+					ObjectCache_Free(&VFS_InodeCache, partdevs[j]);
 				}
 				return false;
 			}
@@ -105,7 +105,7 @@ bool GPT_EnumeratePartitions(struct Storage_Device *dev) {
 		memset(buf, 0, 256);
 		Storage_MakePartitionName(dev, buf, i);
 		if (!DevFS_RegisterInode(buf, partdevs[i])) {
-			FREE_OBJ(partdevs[i]);
+			ObjectCache_Free(&VFS_InodeCache, partdevs[i]);
 		}
 	}
 	return true;
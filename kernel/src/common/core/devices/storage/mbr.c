@@ -39,7 +39,7 @@ bool MBR_EnumeratePartitions(struct Storage_Device *dev) {
 			if (partdevs[i] == NULL) {
 				for (size_t j = 0; j < i; ++j) {
 					if (partdevs[j] != NULL) {
-						FREE_OBJ(partdevs[j]);
+						ObjectCache_Free(&VFS_InodeCache, partdevs[j]);
 					}
 				}
 				return false;
@@ -57,7 +57,7 @@ bool MBR_EnumeratePartitions(struct Storage_Device *dev) {
 		memset(buf, 0, 256);
 		Storage_MakePartitionName(dev, buf, i);
 		if (!DevFS_RegisterInode(buf, partdevs[i])) {
-			FREE_OBJ(partdevs[i]);
+			ObjectCache_Free(&VFS_InodeCache, partdevs[i]);
 		}
 	}
 	return true;
@@ -75,14 +75,14 @@ static struct FileOperations m_partDevFileOperations = {
 };
 
 static struct File *PartDev_Open(struct VFS_Inode *inode, MAYBE_UNUSED int perm) {
-	struct File *fd = ALLOC_OBJ(struct File);
+	struct File *fd = ObjectCache_Allocate(&File_Cache);
 	if (fd == NULL) {
 		return NULL;
 	}
 	struct PartDev_InodeData *ino_data = (struct PartDev_InodeData *)(inode->ctx);
 	struct Storage_Device *storage = ino_data->storage;
 	if (!Storage_LockTryOpenPartition(storage)) {
-		FREE_OBJ(fd);
+		ObjectCache_Free(&File_Cache, fd);
 		return NULL;
 	}
 	fd->ctx = (void *)ino_data;
@@ -100,13 +100,13 @@ static struct VFS_InodeOperations m_inodeOperations = {
 };
 
 struct VFS_Inode *PartDev_MakePartitionDevice(struct Storage_Device *storage, uint64_t start, uint64_t count) {
-	struct VFS_Inode *partInode = ALLOC_OBJ(struct VFS_Inode);
+	struct VFS_Inode *partInode = ObjectCache_Allocate(&VFS_InodeCache);
 	if (partInode == NULL) {
 		return NULL;
 	}
 	struct PartDev_InodeData *partData = ALLOC_OBJ(struct PartDev_InodeData);
 	if (partData == NULL) {
-		FREE_OBJ(partInode);
+		ObjectCache_Free(&VFS_InodeCache, partInode);
 		return NULL;
 	}
 	partData->start = start;
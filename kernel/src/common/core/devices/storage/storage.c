@@ -216,13 +216,13 @@ static struct FileOperations m_StorageFileOperations = {.read = storageFDCallbac
 														.close = Storage_FDCallbackClose};
 
 struct File *Storage_FileOpen(struct VFS_Inode *inode, MAYBE_UNUSED int perm) {
-	struct File *fd = ALLOC_OBJ(struct File);
+	struct File *fd = ObjectCache_Allocate(&File_Cache);
 	if (fd == NULL) {
 		return NULL;
 	}
 	struct Storage_Device *storage = (struct Storage_Device *)(inode->ctx);
 	if (!Storage_LockTryOpen(storage)) {
-		FREE_OBJ(fd);
+		ObjectCache_Free(&File_Cache, fd);
 		return NULL;
 	}
 	fd->ctx = inode->ctx;
@@ -241,7 +241,7 @@ static struct VFS_InodeOperations storage_inode_ops = {
 };
 
 struct VFS_Inode *Storage_MakeInode(struct Storage_Device *storage) {
-	struct VFS_Inode *inode = ALLOC_OBJ(struct VFS_Inode);
+	struct VFS_Inode *inode = ObjectCache_Allocate(&VFS_InodeCache);
 	if (inode == NULL) {
 		return NULL;
 	}
@@ -69,13 +69,13 @@ struct File *TTYDevice_Open(MAYBE_UNUSED struct VFS_Inode *inode, int perm) {
 	if ((perm & VFS_O_RDONLY) != 0) {
 		return NULL;
 	}
-	struct File *ttyFile = ALLOC_OBJ(struct File);
+	struct File *ttyFile = ObjectCache_Allocate(&File_Cache);
 	if (ttyFile == NULL) {
 		return NULL;
 	}
 	struct TTYDevice_File *fileCtx = ALLOC_OBJ(struct TTYDevice_File);
 	if (fileCtx == NULL) {
-		FREE_OBJ(ttyFile);
+		ObjectCache_Free(&File_Cache, ttyFile);
 		return NULL;
 	}
 	ttyFile->ctx = fileCtx;
@@ -95,7 +95,7 @@ static struct VFS_InodeOperations TTYDevice_InodeOperations = {
 
 void TTYDevice_Register() {
 	Mutex_Initialize(&TTYDevice_Mutex);
-	struct VFS_Inode *inode = ALLOC_OBJ(struct VFS_Inode);
+	struct VFS_Inode *inode = ObjectCache_Allocate(&VFS_InodeCache);
 	if (inode == NULL) {
 		KernelLog_ErrorMsg("HAL Console Driver", "Failed to allocate Inode object for terminal inode");
 	}
@@ -1,8 +1,12 @@
 #include <common/core/fd/fd.h>
+#include <common/core/fd/vfs.h>
 #include <common/core/memory/heap.h>
+#include <common/core/memory/pagecache.h>
 #include <common/lib/kmsg.h>
 #include <hal/memory/virt.h>
 
+struct ObjectCache File_Cache = OBJECT_CACHE_INITIALIZER("File", struct File, NULL);
+
 int File_ReadWithoutLocking(struct File *file, int count, char *buf) {
 	if (file->ops->read == NULL) {
 		return -1;
@@ -14,7 +18,13 @@ int File_WriteWithoutLocking(struct File *file, int count, const char *buf) {
 	if (file->ops->write == NULL) {
 		return -1;
 	}
-	return file->ops->write(file, count, buf);
+	off_t offset = file->offset;
+	int result = file->ops->write(file, count, buf);
+	// pages of the file that are already cached are updated, so that its mappings see written data
+	if (result > 0 && file->dentry != NULL) {
+		PageCache_Update(&(file->dentry->inode->pageCache), offset, buf, (size_t)result);
+	}
+	return result;
 }
 
 int File_Read(struct File *file, int count, char *buf) {
@@ -101,7 +111,7 @@ void File_Drop(struct File *file) {
 	if (file->ops->close != NULL) {
 		file->ops->close(file);
 	}
-	FREE_OBJ(file);
+	ObjectCache_Free(&File_Cache, file);
 }
 
 int File_PReadWithoutLocking(struct File *file, off_t pos, int count, char *buf) {
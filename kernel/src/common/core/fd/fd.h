@@ -2,6 +2,7 @@
 #define __FD_H_INCLUDED__
 
 #include <common/core/fd/fdtypes.h>
+#include <common/core/memory/objcache.h>
 #include <common/core/proc/mutex.h>
 #include <common/core/proc/proc.h>
 
@@ -14,6 +15,8 @@ struct File {
 	struct VFS_Dentry *dentry;
 	struct Mutex mutex;
 	size_t refCount;
+	// Access mode the file was opened with (VFS_O_RDONLY, VFS_O_WRONLY or VFS_O_RDWR)
+	int mode;
 	bool isATTY;
 };
 
@@ -32,6 +35,8 @@ struct FileOperations {
 	void (*close)(struct File *file);
 };
 
+extern struct ObjectCache File_Cache;
+
 int File_Read(struct File *file, int count, char *buf);
 int File_Write(struct File *file, int count, const char *buf);
 int File_ReadUser(struct File *file, int count, char *buf);
@@ -59,6 +59,14 @@ bool DevFS_RegisterInode(const char *name, struct VFS_Inode *inode) {
 	entry.hash = GetStringHash(entry.name);
 	entry.inode = inode;
 	Mutex_Lock(&m_mutex);
+	// slots of unregistered entries are reused, so that devices created and removed at runtime don't grow the array
+	for (size_t i = 0; i < DYNARRAY_LENGTH(m_rootEntries); ++i) {
+		if (m_rootEntries[i].inode == NULL) {
+			m_rootEntries[i] = entry;
+			Mutex_Unlock(&m_mutex);
+			return true;
+		}
+	}
 
 	Dynarray(struct DevFS_RootDirectoryEntry) newDynarray = DYNARRAY_PUSH(m_rootEntries, entry);
 
@@ -73,11 +81,32 @@ bool DevFS_RegisterInode(const char *name, struct VFS_Inode *inode) {
 	return true;
 }
 
+// Slot is kept to preserve inode numbers of other entries until it is reused by DevFS_RegisterInode
+bool DevFS_UnregisterInode(const char *name) {
+	size_t hash = GetStringHash(name);
+	Mutex_Lock(&m_mutex);
+	for (size_t i = 0; i < DYNARRAY_LENGTH(m_rootEntries); ++i) {
+		if (m_rootEntries[i].inode == NULL || m_rootEntries[i].hash != hash) {
+			continue;
+		}
+		if (!StringsEqual(m_rootEntries[i].name, name)) {
+			continue;
+		}
+		Heap_FreeMemory((void *)(m_rootEntries[i].name), strlen(m_rootEntries[i].name) + 1);
+		m_rootEntries[i].name = NULL;
+		m_rootEntries[i].inode = NULL;
+		Mutex_Unlock(&m_mutex);
+		return true;
+	}
+	Mutex_Unlock(&m_mutex);
+	return false;
+}
+
 static ino_t DevFS_GetRootChild(MAYBE_UNUSED struct VFS_Inode *inode, const char *name) {
 	size_t hash = GetStringHash(name);
 	Mutex_Lock(&m_mutex);
 	for (size_t i = 0; i < DYNARRAY_LENGTH(m_rootEntries); ++i) {
-		if (m_rootEntries[i].hash != hash) {
+		if (m_rootEntries[i].inode == NULL || m_rootEntries[i].hash != hash) {
 			continue;
 		}
 		if (!StringsEqual(m_rootEntries[i].name, name)) {
@@ -91,7 +120,7 @@ static ino_t DevFS_GetRootChild(MAYBE_UNUSED struct VFS_Inode *inode, const char
 }
 
 static struct File *DeVFS_OpenRoot(MAYBE_UNUSED struct VFS_Inode *inode, MAYBE_UNUSED int perm) {
-	struct File *newFile = ALLOC_OBJ(struct File);
+	struct File *newFile = ObjectCache_Allocate(&File_Cache);
 	if (newFile == NULL) {
 		return NULL;
 	}
@@ -105,6 +134,10 @@ static struct File *DeVFS_OpenRoot(MAYBE_UNUSED struct VFS_Inode *inode, MAYBE_U
 static int DevFS_ReadRootDirectory(struct File *file, struct DirectoryEntry *buf) {
 	Mutex_Lock(&m_mutex);
 	off_t index = file->offset;
+	while (index < DYNARRAY_LENGTH(m_rootEntries) && m_rootEntries[index].inode == NULL) {
+		++index;
+	}
+	file->offset = index;
 	if (index >= DYNARRAY_LENGTH(m_rootEntries)) {
 		Mutex_Unlock(&m_mutex);
 		return 0;
@@ -6,5 +6,6 @@
 
 void DevFS_Initialize();
 bool DevFS_RegisterInode(const char *name, struct VFS_Inode *inode);
+bool DevFS_UnregisterInode(const char *name);
 
 #endif
@@ -123,6 +123,9 @@ struct FAT32_RegularFileContext {
 	struct FAT32_RWStream stream;
 };
 
+static struct ObjectCache m_directoryEntriesCache =
+	OBJECT_CACHE_INITIALIZER("FAT32_DirectoryEntry", struct FAT32_DirectoryEntry, NULL);
+
 enum {
 	FAT32_ATTR_READ_ONLY = 0x01,
 	FAT32_ATTR_HIDDEN = 0x02,
@@ -400,6 +403,13 @@ static enum {
 	return FAT32_READ_ENTRY_READ;
 }
 
+static void FAT32_DisposeDirectoryEntries(Dynarray(struct FAT32_DirectoryEntry *) entries) {
+	for (size_t i = 0; i < DYNARRAY_LENGTH(entries); ++i) {
+		ObjectCache_Free(&m_directoryEntriesCache, entries[i]);
+	}
+	DYNARRAY_DISPOSE(entries);
+}
+
 static Dynarray(struct FAT32_DirectoryEntry *)
 	FAT32_ReadDirectoryFromStream(struct FAT32_Superblock *sb, struct FAT32_RWStream *stream) {
 	Dynarray(struct FAT32_DirectoryEntry *) result = DYNARRAY_NEW(struct FAT32_DirectoryEntry *);
@@ -407,7 +417,7 @@ static Dynarray(struct FAT32_DirectoryEntry *)
 	while (true) {
 		int status = FAT32_ReadDirectoryEntryFromStream(sb, &buf, stream);
 		if (status == FAT32_READ_ENTRY_ERROR) {
-			DYNARRAY_DISPOSE(result);
+			FAT32_DisposeDirectoryEntries(result);
 			return NULL;
 		}
 		if (status == FAT32_READ_ENTRY_SKIP) {
@@ -416,15 +426,16 @@ static Dynarray(struct FAT32_DirectoryEntry *)
 		if (status == FAT32_READ_ENTRY_END) {
 			break;
 		}
-		struct FAT32_DirectoryEntry *dynamicBuf = ALLOC_OBJ(struct FAT32_DirectoryEntry);
+		struct FAT32_DirectoryEntry *dynamicBuf = ObjectCache_Allocate(&m_directoryEntriesCache);
 		if (dynamicBuf == NULL) {
-			DYNARRAY_DISPOSE(result);
+			FAT32_DisposeDirectoryEntries(result);
 			return NULL;
 		}
 		memcpy(dynamicBuf, &buf, sizeof(buf));
 		Dynarray(struct FAT32_DirectoryEntry *) copy = DYNARRAY_PUSH(result, dynamicBuf);
 		if (copy == NULL) {
-			DYNARRAY_DISPOSE(result);
+			ObjectCache_Free(&m_directoryEntriesCache, dynamicBuf);
+			FAT32_DisposeDirectoryEntries(result);
 			return NULL;
 		}
 		result = copy;
@@ -443,7 +454,7 @@ static bool FAT32_MakeDirectoryInode(struct FAT32_Superblock *fat32Superblock, s
 	}
 	struct FAT32_Inode *inodeContext = ALLOC_OBJ(struct FAT32_Inode);
 	if (inodeContext == NULL) {
-		DYNARRAY_DISPOSE(entries);
+		FAT32_DisposeDirectoryEntries(entries);
 		return false;
 	}
 	inodeContext->sb = fat32Superblock;
@@ -463,7 +474,7 @@ static bool FAT32_MakeDirectoryInode(struct FAT32_Superblock *fat32Superblock, s
 static void FAT32_CleanInode(struct VFS_Inode *inode) {
 	struct FAT32_Inode *ctx = (struct FAT32_Inode *)(inode->ctx);
 	if (ctx->entries != NULL) {
-		DYNARRAY_DISPOSE(ctx->entries);
+		FAT32_DisposeDirectoryEntries(ctx->entries);
 	}
 	FREE_OBJ(ctx);
 }
@@ -482,18 +493,18 @@ static ino_t FAT32_TryInsertingInode(struct FAT32_Superblock *fat32Superblock, s
 }
 
 static ino_t FAT32_AddDirectoryInode(struct FAT32_Superblock *fat32Superblock, struct FAT32_DirectoryEntry *entry) {
-	struct VFS_Inode *inode = ALLOC_OBJ(struct VFS_Inode);
+	struct VFS_Inode *inode = ObjectCache_Allocate(&VFS_InodeCache);
 	if (inode == NULL) {
 		return 0;
 	}
 	if (!FAT32_MakeDirectoryInode(fat32Superblock, entry, inode)) {
-		FREE_OBJ(inode);
+		ObjectCache_Free(&VFS_InodeCache, inode);
 		return 0;
 	}
 	ino_t index = FAT32_TryInsertingInode(fat32Superblock, inode);
 	if (index == 0) {
 		FAT32_CleanInode(inode);
-		FREE_OBJ(inode);
+		ObjectCache_Free(&VFS_InodeCache, inode);
 		return 0;
 	}
 	inode->stat.stBlkcnt = (entry->fileSize + fat32Superblock->clusterSize - 1) / fat32Superblock->clusterSize;
@@ -504,13 +515,13 @@ static ino_t FAT32_AddDirectoryInode(struct FAT32_Superblock *fat32Superblock, s
 }
 
 static ino_t FAT32_AddFileInode(struct FAT32_Superblock *fat32Superblock, struct FAT32_DirectoryEntry *entry) {
-	struct VFS_Inode *inode = ALLOC_OBJ(struct VFS_Inode);
+	struct VFS_Inode *inode = ObjectCache_Allocate(&VFS_InodeCache);
 	if (inode == NULL) {
 		return 0;
 	}
 	struct FAT32_Inode *inodeContext = ALLOC_OBJ(struct FAT32_Inode);
 	if (inodeContext == NULL) {
-		FREE_OBJ(inode);
+		ObjectCache_Free(&VFS_InodeCache, inode);
 		return 0;
 	}
 	inode->ctx = (void *)inodeContext;
@@ -527,7 +538,7 @@ static ino_t FAT32_AddFileInode(struct FAT32_Superblock *fat32Superblock, struct
 	ino_t index = FAT32_TryInsertingInode(fat32Superblock, inode);
 	if (index == 0) {
 		FAT32_CleanInode(inode);
-		FREE_OBJ(inode);
+		ObjectCache_Free(&VFS_InodeCache, inode);
 		return 0;
 	}
 	return index;
@@ -607,14 +618,14 @@ static struct File *FAT32_OpenRegularFile(struct VFS_Inode *inode, int perm) {
 	if (((perm & VFS_O_RDWR) != 0) || ((perm & VFS_O_WRONLY) != 0)) {
 		return NULL;
 	}
-	struct File *fd = ALLOC_OBJ(struct File);
+	struct File *fd = ObjectCache_Allocate(&File_Cache);
 	if (fd == NULL) {
 		return NULL;
 	}
 	fd->ops = &m_regularFileOperations;
 	struct FAT32_RegularFileContext *regFileContext = ALLOC_OBJ(struct FAT32_RegularFileContext);
 	if (regFileContext == NULL) {
-		FREE_OBJ(fd);
+		ObjectCache_Free(&File_Cache, fd);
 		return NULL;
 	}
 	fd->ctx = (void *)regFileContext;
@@ -629,7 +640,7 @@ static struct File *FAT32_OpenDirectory(MAYBE_UNUSED struct VFS_Inode *inode, in
 	if (((perm & VFS_O_RDWR) != 0) || ((perm & VFS_O_WRONLY) != 0)) {
 		return NULL;
 	}
-	struct File *fd = ALLOC_OBJ(struct File);
+	struct File *fd = ObjectCache_Allocate(&File_Cache);
 	if (fd == NULL) {
 		return NULL;
 	}
@@ -9,6 +9,9 @@ static struct VFS_Superblock *m_root;
 static struct VFS_Superblock *m_superblockList;
 static struct VFS_Superblock_type *m_superblockTypes;
 
+struct ObjectCache VFS_InodeCache = OBJECT_CACHE_INITIALIZER("VFS_Inode", struct VFS_Inode, NULL);
+struct ObjectCache VFS_DentryCache = OBJECT_CACHE_INITIALIZER("VFS_Dentry", struct VFS_Dentry, NULL);
+
 struct VFS_Inode *VFS_GetInode(struct VFS_Superblock *sb, ino_t id) {
 	if (sb->type->getInode == NULL) {
 		return NULL;
@@ -24,13 +27,13 @@ struct VFS_Inode *VFS_GetInode(struct VFS_Superblock *sb, ino_t id) {
 		}
 		current = current->nextInCache;
 	}
-	struct VFS_Inode *node = ALLOC_OBJ(struct VFS_Inode);
+	struct VFS_Inode *node = ObjectCache_Allocate(&VFS_InodeCache);
 	if (node == NULL) {
 		Mutex_Unlock(&(sb->mutex));
 		return NULL;
 	}
 	if (!sb->type->getInode(sb, node, id)) {
-		FREE_OBJ(node);
+		ObjectCache_Free(&VFS_InodeCache, node);
 		Mutex_Unlock(&(sb->mutex));
 		return NULL;
 	}
@@ -46,6 +49,7 @@ struct VFS_Inode *VFS_GetInode(struct VFS_Superblock *sb, ino_t id) {
 	node->sb = sb;
 	node->mount = NULL;
 	Mutex_Initialize(&(node->mutex));
+	PageCache_Initialize(&(node->pageCache), true);
 	Mutex_Unlock(&(sb->mutex));
 	return node;
 }
@@ -66,10 +70,11 @@ void VFS_DropInode(struct VFS_Superblock *sb, struct VFS_Inode *inode) {
 		if (inode->nextInCache != NULL) {
 			inode->nextInCache->prevInCache = NULL;
 		}
+		PageCache_Clear(&(inode->pageCache));
 		if (sb->type->dropInode != NULL) {
 			sb->type->dropInode(sb, inode, inode->id);
 		}
-		FREE_OBJ(inode);
+		ObjectCache_Free(&VFS_InodeCache, inode);
 	}
 	Mutex_Unlock(&(sb->mutex));
 }
@@ -173,7 +178,7 @@ bool VFS_DropDentry(struct VFS_Dentry *dentry) {
 		CWD_DisposeInfo(dentry->cwd);
 	}
 	Mutex_Unlock(&(dentry->mutex));
-	FREE_OBJ(dentry);
+	ObjectCache_Free(&VFS_DentryCache, dentry);
 	return true;
 }
 
@@ -230,7 +235,7 @@ struct VFS_Dentry *VFS_DentryLoadChild(struct VFS_Dentry *dentry, const char *na
 	if (newInode == NULL) {
 		return NULL;
 	}
-	struct VFS_Dentry *newDentry = ALLOC_OBJ(struct VFS_Dentry);
+	struct VFS_Dentry *newDentry = ObjectCache_Allocate(&VFS_DentryCache);
 	newDentry->traceableFromRoot = false;
 	if (dentry == NULL) {
 		VFS_DropInode(newInode->sb, newInode);
@@ -240,13 +245,13 @@ struct VFS_Dentry *VFS_DentryLoadChild(struct VFS_Dentry *dentry, const char *na
 		struct CWD_Info *info = CWD_ForkCwdInfo(dentry->cwd);
 		if (info == NULL) {
 			VFS_DropInode(newInode->sb, newInode);
-			FREE_OBJ(newDentry);
+			ObjectCache_Free(&VFS_DentryCache, newDentry);
 			return NULL;
 		}
 		if (!CWD_ChangeDirectory(info, name)) {
 			CWD_DisposeInfo(info);
 			VFS_DropInode(newInode->sb, newInode);
-			FREE_OBJ(newDentry);
+			ObjectCache_Free(&VFS_DentryCache, newDentry);
 			return NULL;
 		}
 		newDentry->cwd = info;
@@ -402,7 +407,7 @@ bool VFS_Dentry_MountInitializedFS(const char *path, struct VFS_Superblock *sb)
 		VFS_Dentry_DropRecursively(dir);
 		return false;
 	}
-	struct VFS_Dentry *dentry = ALLOC_OBJ(struct VFS_Dentry);
+	struct VFS_Dentry *dentry = ObjectCache_Allocate(&VFS_DentryCache);
 	dentry->hash = 0;
 	dentry->traceableFromRoot = dir->traceableFromRoot;
 	if (dentry == NULL) {
@@ -417,7 +422,7 @@ bool VFS_Dentry_MountInitializedFS(const char *path, struct VFS_Superblock *sb)
 	if ((dentry->cwd = CWD_ForkCwdInfo(dir->cwd)) == NULL) {
 		VFS_Dentry_DropRecursively(dir);
 		VFS_DropInode(inode->sb, inode);
-		FREE_OBJ(dentry);
+		ObjectCache_Free(&VFS_DentryCache, dentry);
 		return false;
 	}
 	dentry->parent = dentry->head = dentry->next = dentry->prev = NULL;
@@ -511,7 +516,7 @@ void VFS_Initialize(struct VFS_Superblock *sb) {
 	if (inode == NULL) {
 		KernelLog_ErrorMsg("Virtual File System", "Failed to load rootfs root inode");
 	}
-	struct VFS_Dentry *dentry = ALLOC_OBJ(struct VFS_Dentry);
+	struct VFS_Dentry *dentry = ObjectCache_Allocate(&VFS_DentryCache);
 	if (dentry == NULL) {
 		KernelLog_ErrorMsg("Virtual File System", "Failed to allocate root dirent");
 	}
@@ -561,6 +566,7 @@ struct File *VFS_OpenAtDentry(struct VFS_Dentry *dentry, const char *path, int p
 	}
 	Mutex_Initialize(&(fd->mutex));
 	fd->refCount = 1;
+	fd->mode = perm & VFS_O_ACCMODE;
 	Mutex_Unlock(&(file->mutex));
 	fd->dentry = file;
 	return fd;
@@ -3,6 +3,8 @@
 
 #include <common/core/fd/cwd.h>
 #include <common/core/fd/fd.h>
+#include <common/core/memory/objcache.h>
+#include <common/core/memory/pagecache.h>
 #include <common/core/proc/mutex.h>
 
 enum {
@@ -56,6 +58,7 @@ struct VFS_Inode {
 	struct VFS_Superblock *sb;
 	struct VFS_InodeOperations *ops;
 	struct Mutex mutex;
+	struct PageCache pageCache;
 };
 
 struct VFS_Superblock_type {
@@ -82,6 +85,9 @@ struct VFS_Superblock {
 	struct Mutex mutex;
 };
 
+extern struct ObjectCache VFS_InodeCache;
+extern struct ObjectCache VFS_DentryCache;
+
 void VFS_Initialize(struct VFS_Superblock *sb);
 
 bool VFS_Dentry_MountInitializedFS(const char *path, struct VFS_Superblock *sb);
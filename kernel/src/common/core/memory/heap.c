@@ -1,76 +1,385 @@
+#include <common/core/memory/heap.h>
+#include <common/core/memory/heapprof.h>
+#include <common/core/memory/zeropool.h>
 #include <common/core/proc/mutex.h>
+#include <common/lib/kmsg.h>
 #include <hal/memory/phys.h>
 #include <hal/memory/virt.h>
+#include <hal/proc/intlevel.h>
 
+#define HEAP_MOD_NAME "Kernel Heap"
 #define BLOCK_SIZE 65536
-#define HEAP_SIZE_CLASSES_COUNT 13
+#define HEAP_SIZE_CLASSES_COUNT 42
+#define HEAP_SIZE_CLASS_GRANULARITY 8
+#define HEAP_EMPTY_BLOCKS_WATERMARK 2
+#define HEAP_MAGAZINE_MAX_CAPACITY 32
+#define HEAP_MAGAZINE_BYTES 16384
 
 struct Heap_SlubElemHeader {
 	struct Heap_SlubElemHeader *next;
 };
 
+struct Heap_Block {
+	struct Heap_SlubElemHeader *freeList;
+	struct Heap_Block *prev;
+	struct Heap_Block *next;
+	uint16_t usedCount;
+	uint8_t sizeClass;
+};
+
+struct Heap_SizeClassInfo {
+	struct Heap_Block *partialBlocks;
+	struct Heap_Block *emptyBlocks;
+	size_t emptyBlocksCount;
+	size_t blocksCount;
+	size_t objectsInUse;
+	size_t requestedBytes;
+};
+
+// Per-class stack of free objects in front of the slabs. It is only touched with interrupts disabled, so allocations
+// served from it never sleep
+struct Heap_Magazine {
+	void *objects[HEAP_MAGAZINE_MAX_CAPACITY];
+	size_t count;
+	size_t capacity;
+};
+
 static struct Mutex m_mutex;
-static size_t m_sizeClasses[HEAP_SIZE_CLASSES_COUNT] = {16,	  32,	64,	  128,	 256,	512,  1024,
-														2048, 4096, 8192, 16384, 32768, 65536};
+// Four classes per power of two up to 8 KiB. Larger classes divide the block with little or no tail
+static size_t m_sizeClasses[HEAP_SIZE_CLASSES_COUNT] = {
+	16,	  24,	32,	  40,	48,	  56,	 64,	80,	   96,	  112,	 128,	160,   192,	 224,
+	256,  320,	384,  448,	512,  640,	 768,	896,   1024,  1280,	 1536,	1792,  2048, 2560,
+	3072, 3584, 4096, 5120, 6144, 7168, 8192, 9360, 10912, 13104, 16384, 21840, 32768, 65536};
+
+static uint8_t m_sizeToClass[BLOCK_SIZE / HEAP_SIZE_CLASS_GRANULARITY + 1];
+static struct Heap_SizeClassInfo m_slubs[HEAP_SIZE_CLASSES_COUNT];
+static struct Heap_Magazine m_magazines[HEAP_SIZE_CLASSES_COUNT];
+static struct Heap_Block *m_blocks;
+static size_t m_blocksCount;
+static size_t m_largeAreasCount;
+static size_t m_largeRequestedBytes;
+static size_t m_largeAllocatedBytes;
+static struct Heap_ReclaimHook *m_reclaimHooks = NULL;
+
+static INLINE size_t Heap_GetSizeClass(size_t size) {
+	if (size > BLOCK_SIZE) {
+		return HEAP_SIZE_CLASSES_COUNT;
+	}
+	return m_sizeToClass[ALIGN_UP(size, HEAP_SIZE_CLASS_GRANULARITY) / HEAP_SIZE_CLASS_GRANULARITY];
+}
+
+static INLINE uintptr_t Heap_GetBlockAddress(struct Heap_Block *block) {
+	return HAL_VirtualMM_KernelMappingBase + (uintptr_t)(block - m_blocks) * BLOCK_SIZE;
+}
+
+static INLINE struct Heap_Block *Heap_GetBlockByObject(void *object) {
+	return m_blocks + ((uintptr_t)object - HAL_VirtualMM_KernelMappingBase) / BLOCK_SIZE;
+}
+
+static void Heap_InsertBlock(struct Heap_Block **head, struct Heap_Block *block) {
+	block->prev = NULL;
+	block->next = *head;
+	if (*head != NULL) {
+		(*head)->prev = block;
+	}
+	*head = block;
+}
 
-static struct Heap_SlubElemHeader *m_slubs[HEAP_SIZE_CLASSES_COUNT];
+static void Heap_RemoveBlock(struct Heap_Block **head, struct Heap_Block *block) {
+	if (block->prev == NULL) {
+		*head = block->next;
+	} else {
+		block->prev->next = block->next;
+	}
+	if (block->next != NULL) {
+		block->next->prev = block->prev;
+	}
+	block->prev = block->next = NULL;
+}
 
-static size_t Heap_GetSizeClass(size_t size) {
+static void Heap_ReleaseBlock(struct Heap_Block *block) {
+	uintptr_t address = Heap_GetBlockAddress(block);
+	block->freeList = NULL;
+	HAL_PhysicalMM_KernelFreeArea(address - HAL_VirtualMM_KernelMappingBase, BLOCK_SIZE);
+}
+
+static size_t Heap_ReleaseEmptyBlocks(size_t index, size_t keep) {
+	size_t released = 0;
+	while (m_slubs[index].emptyBlocksCount > keep) {
+		struct Heap_Block *block = m_slubs[index].emptyBlocks;
+		Heap_RemoveBlock(&(m_slubs[index].emptyBlocks), block);
+		m_slubs[index].emptyBlocksCount--;
+		m_slubs[index].blocksCount--;
+		Heap_ReleaseBlock(block);
+		++released;
+	}
+	return released;
+}
+
+static size_t Heap_ReleaseAllEmptyBlocks() {
+	size_t released = 0;
 	for (size_t i = 0; i < HEAP_SIZE_CLASSES_COUNT; ++i) {
-		if (size <= m_sizeClasses[i]) {
-			return i;
-		}
+		released += Heap_ReleaseEmptyBlocks(i, 0);
 	}
-	return HEAP_SIZE_CLASSES_COUNT;
+	return released;
 }
 
 static bool Heap_AddObjectToSlubs(size_t index) {
 	size_t size = m_sizeClasses[index];
 	size_t objectsCount = BLOCK_SIZE / size;
-	size_t block = HAL_PhysicalMM_KernelAllocArea(BLOCK_SIZE);
-	if (block == 0) {
+	uintptr_t physical = HAL_PhysicalMM_KernelAllocArea(BLOCK_SIZE);
+	if (physical == 0) {
 		return false;
 	}
-	for (size_t i = 0; i < objectsCount; ++i) {
-		size_t offset = i * size;
-		size_t address = HAL_VirtualMM_KernelMappingBase + block + offset;
-		struct Heap_SlubElemHeader *block = (struct Heap_SlubElemHeader *)address;
-		block->next = m_slubs[index];
-		m_slubs[index] = block;
+	// frame allocator hands out naturally aligned blocks, so block descriptor can be found from object address
+	if (physical % BLOCK_SIZE != 0) {
+		KernelLog_ErrorMsg(HEAP_MOD_NAME, "Slab block at %p is not aligned", physical);
+	}
+	uintptr_t address = physical + HAL_VirtualMM_KernelMappingBase;
+	struct Heap_Block *block = Heap_GetBlockByObject((void *)address);
+	block->freeList = NULL;
+	block->usedCount = 0;
+	block->sizeClass = index;
+	for (size_t i = objectsCount; i > 0; --i) {
+		struct Heap_SlubElemHeader *object = (struct Heap_SlubElemHeader *)(address + (i - 1) * size);
+		object->next = block->freeList;
+		block->freeList = object;
 	}
+	Heap_InsertBlock(&(m_slubs[index].partialBlocks), block);
+	m_slubs[index].blocksCount++;
 	return true;
 }
 
 void Heap_Initialize() {
 	Mutex_Initialize(&m_mutex);
+	size_t sizeClass = 0;
+	for (size_t i = 0; i < ARR_SIZE(m_sizeToClass); ++i) {
+		while (m_sizeClasses[sizeClass] < i * HEAP_SIZE_CLASS_GRANULARITY) {
+			++sizeClass;
+		}
+		m_sizeToClass[i] = sizeClass;
+	}
+	memset(m_slubs, 0, sizeof(m_slubs));
+	memset(m_magazines, 0, sizeof(m_magazines));
 	for (size_t i = 0; i < HEAP_SIZE_CLASSES_COUNT; ++i) {
-		m_slubs[i] = NULL;
+		size_t capacity = HEAP_MAGAZINE_BYTES / m_sizeClasses[i];
+		if (capacity > HEAP_MAGAZINE_MAX_CAPACITY) {
+			capacity = HEAP_MAGAZINE_MAX_CAPACITY;
+		} else if (capacity < 2) {
+			capacity = 2;
+		}
+		m_magazines[i].capacity = capacity;
+	}
+	m_largeAreasCount = m_largeRequestedBytes = m_largeAllocatedBytes = 0;
+	m_blocksCount = (0 - HAL_VirtualMM_KernelMappingBase) / BLOCK_SIZE;
+	size_t tableSize = ALIGN_UP(m_blocksCount * sizeof(struct Heap_Block), HAL_VirtualMM_PageSize);
+	uintptr_t table = HAL_PhysicalMM_KernelAllocArea(tableSize);
+	if (table == 0) {
+		KernelLog_ErrorMsg(HEAP_MOD_NAME, "Failed to allocate slab block descriptors");
 	}
+	m_blocks = (struct Heap_Block *)(table + HAL_VirtualMM_KernelMappingBase);
+	memset(m_blocks, 0, tableSize);
 }
 
-void *Heap_AllocateMemory(size_t size) {
+static void *Heap_AllocateFromSlubs(size_t sizeClass) {
+	struct Heap_SizeClassInfo *info = m_slubs + sizeClass;
+	struct Heap_Block *block = info->partialBlocks;
+	if (block == NULL) {
+		block = info->emptyBlocks;
+		if (block != NULL) {
+			Heap_RemoveBlock(&(info->emptyBlocks), block);
+			info->emptyBlocksCount--;
+			Heap_InsertBlock(&(info->partialBlocks), block);
+		} else {
+			if (!Heap_AddObjectToSlubs(sizeClass)) {
+				return NULL;
+			}
+			block = info->partialBlocks;
+		}
+	}
+	struct Heap_SlubElemHeader *result = block->freeList;
+	block->freeList = result->next;
+	block->usedCount++;
+	if (block->freeList == NULL) {
+		Heap_RemoveBlock(&(info->partialBlocks), block);
+	}
+	return result;
+}
+
+static void Heap_ReturnToSlubs(void *area, size_t sizeClass) {
+	struct Heap_SizeClassInfo *info = m_slubs + sizeClass;
+	struct Heap_Block *block = Heap_GetBlockByObject(area);
+	if (block->usedCount == 0) {
+		KernelLog_ErrorMsg(HEAP_MOD_NAME, "Attempt to free %p which is already free", area);
+	}
+	if (block->freeList == NULL) {
+		Heap_InsertBlock(&(info->partialBlocks), block);
+	}
+	struct Heap_SlubElemHeader *hdr = (struct Heap_SlubElemHeader *)area;
+	hdr->next = block->freeList;
+	block->freeList = hdr;
+	block->usedCount--;
+	if (block->usedCount == 0) {
+		Heap_RemoveBlock(&(info->partialBlocks), block);
+		Heap_InsertBlock(&(info->emptyBlocks), block);
+		info->emptyBlocksCount++;
+		Heap_ReleaseEmptyBlocks(sizeClass, HEAP_EMPTY_BLOCKS_WATERMARK);
+	}
+}
+
+static void Heap_RefillMagazine(size_t sizeClass) {
+	struct Heap_Magazine *magazine = m_magazines + sizeClass;
+	void *objects[HEAP_MAGAZINE_MAX_CAPACITY];
+	size_t count = 0;
+	while (count < magazine->capacity / 2) {
+		void *object = Heap_AllocateFromSlubs(sizeClass);
+		// memory cached in other size classes may be enough to grow this one
+		if (object == NULL && count == 0 && Heap_ReleaseAllEmptyBlocks() != 0) {
+			object = Heap_AllocateFromSlubs(sizeClass);
+		}
+		if (object == NULL) {
+			break;
+		}
+		objects[count++] = object;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	while (count > 0 && magazine->count < magazine->capacity) {
+		magazine->objects[magazine->count++] = objects[--count];
+	}
+	HAL_InterruptLevel_Recover(level);
+	while (count > 0) {
+		Heap_ReturnToSlubs(objects[--count], sizeClass);
+	}
+}
+
+static void Heap_FlushMagazine(size_t sizeClass, size_t keep) {
+	struct Heap_Magazine *magazine = m_magazines + sizeClass;
+	void *objects[HEAP_MAGAZINE_MAX_CAPACITY];
+	size_t count = 0;
+	int level = HAL_InterruptLevel_Elevate();
+	while (magazine->count > keep) {
+		objects[count++] = magazine->objects[--magazine->count];
+	}
+	HAL_InterruptLevel_Recover(level);
+	while (count > 0) {
+		Heap_ReturnToSlubs(objects[--count], sizeClass);
+	}
+}
+
+void Heap_RegisterReclaimHook(struct Heap_ReclaimHook *hook) {
+	int level = HAL_InterruptLevel_Elevate();
+	hook->next = m_reclaimHooks;
+	m_reclaimHooks = hook;
+	HAL_InterruptLevel_Recover(level);
+}
+
+size_t Heap_Reclaim() {
+	Mutex_Lock(&m_mutex);
+	for (size_t i = 0; i < HEAP_SIZE_CLASSES_COUNT; ++i) {
+		Heap_FlushMagazine(i, 0);
+	}
+	size_t released = Heap_ReleaseAllEmptyBlocks();
+	Mutex_Unlock(&m_mutex);
+	// pool is refilled when the system is idle, so under memory pressure its frames are better used elsewhere
+	released += ZeroPool_Release();
+	// hooks are called without heap lock, as they usually free heap objects along with frames
+	for (struct Heap_ReclaimHook *hook = m_reclaimHooks; hook != NULL; hook = hook->next) {
+		released += hook->reclaim();
+	}
+	return released;
+}
+
+static void *Heap_AllocateLarge(size_t size) {
+	uintptr_t result = HAL_PhysicalMM_KernelAllocArea(ALIGN_UP(size, HAL_VirtualMM_PageSize));
+	if (result == 0 && Heap_Reclaim() != 0) {
+		result = HAL_PhysicalMM_KernelAllocArea(ALIGN_UP(size, HAL_VirtualMM_PageSize));
+	}
+	if (result == 0) {
+		return NULL;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	m_largeAreasCount++;
+	m_largeRequestedBytes += size;
+	m_largeAllocatedBytes += ALIGN_UP(size, HAL_VirtualMM_PageSize);
+	HAL_InterruptLevel_Recover(level);
+	return (void *)(result + HAL_VirtualMM_KernelMappingBase);
+}
+
+static void Heap_FreeLarge(void *area, size_t size) {
+	HAL_PhysicalMM_KernelFreeArea(((uintptr_t)area) - HAL_VirtualMM_KernelMappingBase,
+								  ALIGN_UP(size, HAL_VirtualMM_PageSize));
+	int level = HAL_InterruptLevel_Elevate();
+	m_largeAreasCount--;
+	m_largeRequestedBytes -= size;
+	m_largeAllocatedBytes -= ALIGN_UP(size, HAL_VirtualMM_PageSize);
+	HAL_InterruptLevel_Recover(level);
+}
+
+static INLINE void *Heap_PopFromMagazine(size_t sizeClass, size_t size) {
+	struct Heap_Magazine *magazine = m_magazines + sizeClass;
+	if (magazine->count == 0) {
+		return NULL;
+	}
+	m_slubs[sizeClass].objectsInUse++;
+	m_slubs[sizeClass].requestedBytes += size;
+	return magazine->objects[--magazine->count];
+}
+
+static void *Heap_Allocate(size_t size) {
 	if (size == 0) {
 		return NULL;
 	}
+	size_t sizeClass = Heap_GetSizeClass(size);
+	if (sizeClass == HEAP_SIZE_CLASSES_COUNT) {
+		return Heap_AllocateLarge(size);
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	void *result = Heap_PopFromMagazine(sizeClass, size);
+	if (result != NULL) {
+		HAL_InterruptLevel_Recover(level);
+		return result;
+	}
+	HAL_InterruptLevel_Recover(level);
 	Mutex_Lock(&m_mutex);
+	Heap_RefillMagazine(sizeClass);
+	Mutex_Unlock(&m_mutex);
+	level = HAL_InterruptLevel_Elevate();
+	result = Heap_PopFromMagazine(sizeClass, size);
+	HAL_InterruptLevel_Recover(level);
+	return result;
+}
+
+static void Heap_Free(void *area, size_t size) {
 	size_t sizeClass = Heap_GetSizeClass(size);
 	if (sizeClass == HEAP_SIZE_CLASSES_COUNT) {
-		uintptr_t result = HAL_PhysicalMM_KernelAllocArea(ALIGN_UP(size, HAL_VirtualMM_PageSize));
-		Mutex_Unlock(&m_mutex);
-		if (result == 0) {
-			return NULL;
-		}
-		return (void *)(result + HAL_VirtualMM_KernelMappingBase);
+		Heap_FreeLarge(area, size);
+		return;
 	}
-	if (m_slubs[sizeClass] == NULL) {
-		if (!Heap_AddObjectToSlubs(sizeClass)) {
-			Mutex_Unlock(&m_mutex);
-			return NULL;
-		}
+	struct Heap_Block *block = Heap_GetBlockByObject(area);
+	if (block->usedCount == 0 || block->sizeClass != sizeClass) {
+		KernelLog_ErrorMsg(HEAP_MOD_NAME, "Attempt to free %p with wrong size or outside of the heap", area);
+	}
+	struct Heap_Magazine *magazine = m_magazines + sizeClass;
+	int level = HAL_InterruptLevel_Elevate();
+	m_slubs[sizeClass].objectsInUse--;
+	m_slubs[sizeClass].requestedBytes -= size;
+	if (magazine->count < magazine->capacity) {
+		magazine->objects[magazine->count++] = area;
+		HAL_InterruptLevel_Recover(level);
+		return;
 	}
-	struct Heap_SlubElemHeader *result = m_slubs[sizeClass];
-	m_slubs[sizeClass] = result->next;
+	HAL_InterruptLevel_Recover(level);
+	Mutex_Lock(&m_mutex);
+	Heap_FlushMagazine(sizeClass, magazine->capacity / 2);
+	Heap_ReturnToSlubs(area, sizeClass);
 	Mutex_Unlock(&m_mutex);
+}
+
+void *Heap_AllocateMemory(size_t size) {
+	void *result = Heap_Allocate(size);
+	if (HeapProf_Enabled) {
+		HeapProf_RecordAllocation(result, size, (uintptr_t)__builtin_return_address(0));
+	}
 	return result;
 }
 
@@ -78,17 +387,37 @@ void Heap_FreeMemory(void *area, size_t size) {
 	if (area == NULL) {
 		return;
 	}
+	if (HeapProf_Enabled) {
+		HeapProf_RecordFree(area);
+	}
+	Heap_Free(area, size);
+}
+
+size_t Heap_GetSizeClassesCount() {
+	return HEAP_SIZE_CLASSES_COUNT;
+}
+
+void Heap_GetSizeClassStatistics(size_t index, struct Heap_SizeClassStatistics *stats) {
 	Mutex_Lock(&m_mutex);
-	size_t sizeClass = Heap_GetSizeClass(size);
-	if (sizeClass == HEAP_SIZE_CLASSES_COUNT) {
-		Mutex_Unlock(&m_mutex);
-		HAL_PhysicalMM_KernelFreeArea(((uintptr_t)area) - HAL_VirtualMM_KernelMappingBase,
-									  ALIGN_UP(size, HAL_VirtualMM_PageSize));
-		return;
+	int level = HAL_InterruptLevel_Elevate();
+	if (index == HEAP_SIZE_CLASSES_COUNT) {
+		stats->objectSize = 0;
+		stats->blocksCount = 0;
+		stats->emptyBlocksCount = 0;
+		stats->cachedObjects = 0;
+		stats->objectsInUse = m_largeAreasCount;
+		stats->requestedBytes = m_largeRequestedBytes;
+		stats->allocatedBytes = m_largeAllocatedBytes;
+	} else {
+		struct Heap_SizeClassInfo *info = m_slubs + index;
+		stats->objectSize = m_sizeClasses[index];
+		stats->blocksCount = info->blocksCount;
+		stats->emptyBlocksCount = info->emptyBlocksCount;
+		stats->cachedObjects = m_magazines[index].count;
+		stats->objectsInUse = info->objectsInUse;
+		stats->requestedBytes = info->requestedBytes;
+		stats->allocatedBytes = info->objectsInUse * m_sizeClasses[index];
 	}
-	struct Heap_SlubElemHeader *hdr = (struct Heap_SlubElemHeader *)area;
-	hdr->next = m_slubs[sizeClass];
-	m_slubs[sizeClass] = hdr;
+	HAL_InterruptLevel_Recover(level);
 	Mutex_Unlock(&m_mutex);
-	return;
 }
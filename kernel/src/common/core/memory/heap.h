@@ -3,10 +3,33 @@
 
 #include <common/misc/utils.h>
 
+struct Heap_SizeClassStatistics {
+	size_t objectSize;
+	size_t blocksCount;
+	size_t emptyBlocksCount;
+	size_t cachedObjects;
+	size_t objectsInUse;
+	size_t requestedBytes;
+	size_t allocatedBytes;
+};
+
 void Heap_Initialize();
 void *Heap_AllocateMemory(size_t size);
 void Heap_FreeMemory(void *area, size_t size);
 
+// Hooks let caches outside of the heap give memory back when allocation fails. Hook returns number of released frames
+struct Heap_ReclaimHook {
+	size_t (*reclaim)();
+	struct Heap_ReclaimHook *next;
+};
+
+void Heap_RegisterReclaimHook(struct Heap_ReclaimHook *hook);
+size_t Heap_Reclaim();
+
+// Index Heap_GetSizeClassesCount() reports large allocations served directly by the frame allocator
+size_t Heap_GetSizeClassesCount();
+void Heap_GetSizeClassStatistics(size_t index, struct Heap_SizeClassStatistics *stats);
+
 #define ALLOC_OBJ(t) (t *)Heap_AllocateMemory(sizeof(t))
 #define FREE_OBJ(p) Heap_FreeMemory(p, sizeof(typeof(*(p))))
 
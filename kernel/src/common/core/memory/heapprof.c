@@ -0,0 +1,169 @@
+#include <common/core/memory/heapprof.h>
+#include <hal/memory/phys.h>
+#include <hal/memory/virt.h>
+#include <hal/proc/intlevel.h>
+
+#define HEAPPROF_MAX_ALLOCATIONS 16384
+#define HEAPPROF_MAX_SITES 1024
+#define HEAPPROF_BUCKETS_COUNT 4096
+#define HEAPPROF_NO_RECORD 0xffff
+
+struct HeapProf_Allocation {
+	uintptr_t area;
+	size_t size;
+	uint16_t site;
+	uint16_t next;
+};
+
+struct HeapProf_Tables {
+	struct HeapProf_Allocation allocations[HEAPPROF_MAX_ALLOCATIONS];
+	struct HeapProf_Site sites[HEAPPROF_MAX_SITES];
+	uint16_t buckets[HEAPPROF_BUCKETS_COUNT];
+};
+
+bool HeapProf_Enabled = false;
+static struct HeapProf_Tables *m_tables = NULL;
+static uint16_t m_freeAllocations;
+static size_t m_sitesCount;
+static size_t m_liveAllocations;
+static size_t m_droppedAllocations;
+
+// Profiler state is touched from heap paths that may run with interrupts disabled, so sleeping locks can't be used
+
+static INLINE size_t HeapProf_GetBucket(uintptr_t area) {
+	return (area >> 3) % HEAPPROF_BUCKETS_COUNT;
+}
+
+static void HeapProf_Reset() {
+	for (size_t i = 0; i < HEAPPROF_MAX_ALLOCATIONS; ++i) {
+		m_tables->allocations[i].next = i + 1 < HEAPPROF_MAX_ALLOCATIONS ? i + 1 : HEAPPROF_NO_RECORD;
+	}
+	for (size_t i = 0; i < HEAPPROF_BUCKETS_COUNT; ++i) {
+		m_tables->buckets[i] = HEAPPROF_NO_RECORD;
+	}
+	memset(m_tables->sites, 0, sizeof(m_tables->sites));
+	m_freeAllocations = 0;
+	m_sitesCount = 0;
+	m_liveAllocations = 0;
+	m_droppedAllocations = 0;
+}
+
+bool HeapProf_Start() {
+	if (m_tables == NULL) {
+		uintptr_t tables = HAL_PhysicalMM_KernelAllocArea(sizeof(struct HeapProf_Tables));
+		if (tables == 0) {
+			return false;
+		}
+		m_tables = (struct HeapProf_Tables *)(tables + HAL_VirtualMM_KernelMappingBase);
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	HeapProf_Reset();
+	HeapProf_Enabled = true;
+	HAL_InterruptLevel_Recover(level);
+	return true;
+}
+
+void HeapProf_Stop() {
+	HeapProf_Enabled = false;
+}
+
+static uint16_t HeapProf_FindSite(uintptr_t caller) {
+	// Sites are never removed while profiling, so the table is probed linearly from the hash position
+	size_t start = (caller >> 2) % HEAPPROF_MAX_SITES;
+	for (size_t i = 0; i < HEAPPROF_MAX_SITES; ++i) {
+		size_t index = (start + i) % HEAPPROF_MAX_SITES;
+		struct HeapProf_Site *site = m_tables->sites + index;
+		if (site->caller == caller) {
+			return index;
+		}
+		if (site->caller == 0) {
+			site->caller = caller;
+			m_sitesCount++;
+			return index;
+		}
+	}
+	return HEAPPROF_NO_RECORD;
+}
+
+void HeapProf_RecordAllocation(void *area, size_t size, uintptr_t caller) {
+	if (area == NULL) {
+		return;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	if (!HeapProf_Enabled) {
+		HAL_InterruptLevel_Recover(level);
+		return;
+	}
+	uint16_t site = HeapProf_FindSite(caller);
+	if (site == HEAPPROF_NO_RECORD || m_freeAllocations == HEAPPROF_NO_RECORD) {
+		m_droppedAllocations++;
+		HAL_InterruptLevel_Recover(level);
+		return;
+	}
+	uint16_t index = m_freeAllocations;
+	struct HeapProf_Allocation *allocation = m_tables->allocations + index;
+	m_freeAllocations = allocation->next;
+	size_t bucket = HeapProf_GetBucket((uintptr_t)area);
+	allocation->area = (uintptr_t)area;
+	allocation->size = size;
+	allocation->site = site;
+	allocation->next = m_tables->buckets[bucket];
+	m_tables->buckets[bucket] = index;
+	m_tables->sites[site].liveCount++;
+	m_tables->sites[site].liveBytes += size;
+	m_tables->sites[site].totalCount++;
+	m_liveAllocations++;
+	HAL_InterruptLevel_Recover(level);
+}
+
+void HeapProf_RecordFree(void *area) {
+	if (area == NULL) {
+		return;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	if (!HeapProf_Enabled) {
+		HAL_InterruptLevel_Recover(level);
+		return;
+	}
+	size_t bucket = HeapProf_GetBucket((uintptr_t)area);
+	uint16_t *link = m_tables->buckets + bucket;
+	while (*link != HEAPPROF_NO_RECORD) {
+		struct HeapProf_Allocation *allocation = m_tables->allocations + *link;
+		if (allocation->area == (uintptr_t)area) {
+			uint16_t index = *link;
+			*link = allocation->next;
+			m_tables->sites[allocation->site].liveCount--;
+			m_tables->sites[allocation->site].liveBytes -= allocation->size;
+			allocation->next = m_freeAllocations;
+			m_freeAllocations = index;
+			m_liveAllocations--;
+			break;
+		}
+		link = &(allocation->next);
+	}
+	HAL_InterruptLevel_Recover(level);
+}
+
+size_t HeapProf_GetSites(struct HeapProf_Site *buf, size_t count) {
+	if (m_tables == NULL) {
+		return 0;
+	}
+	size_t result = 0;
+	int level = HAL_InterruptLevel_Elevate();
+	for (size_t i = 0; i < HEAPPROF_MAX_SITES && result < count; ++i) {
+		if (m_tables->sites[i].caller != 0) {
+			buf[result++] = m_tables->sites[i];
+		}
+	}
+	HAL_InterruptLevel_Recover(level);
+	return result;
+}
+
+void HeapProf_GetStatistics(struct HeapProf_Statistics *stats) {
+	int level = HAL_InterruptLevel_Elevate();
+	stats->enabled = HeapProf_Enabled;
+	stats->sitesCount = m_sitesCount;
+	stats->liveAllocations = m_liveAllocations;
+	stats->droppedAllocations = m_droppedAllocations;
+	HAL_InterruptLevel_Recover(level);
+}
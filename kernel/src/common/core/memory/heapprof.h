@@ -0,0 +1,29 @@
+#ifndef __HEAPPROF_H_INCLUDED__
+#define __HEAPPROF_H_INCLUDED__
+
+#include <common/misc/utils.h>
+
+struct HeapProf_Site {
+	uintptr_t caller;
+	size_t liveCount;
+	size_t liveBytes;
+	size_t totalCount;
+};
+
+struct HeapProf_Statistics {
+	bool enabled;
+	size_t sitesCount;
+	size_t liveAllocations;
+	size_t droppedAllocations;
+};
+
+extern bool HeapProf_Enabled;
+
+bool HeapProf_Start();
+void HeapProf_Stop();
+void HeapProf_RecordAllocation(void *area, size_t size, uintptr_t caller);
+void HeapProf_RecordFree(void *area);
+size_t HeapProf_GetSites(struct HeapProf_Site *buf, size_t count);
+void HeapProf_GetStatistics(struct HeapProf_Statistics *stats);
+
+#endif
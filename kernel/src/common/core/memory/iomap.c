@@ -85,7 +85,7 @@ uintptr_t IOMap_AllocateIOMapping(uintptr_t paddr, size_t size, bool cacheDisabl
 			return 0;
 		}
 	}
-	HAL_VirtualMM_Flush();
+	HAL_VirtualMM_FlushRange(vaddr, vaddr + size);
 	Mutex_Unlock(&m_mutex);
 	return vaddr;
 }
@@ -96,6 +96,7 @@ void IOMap_FreeIOMapping(uintptr_t vaddr, size_t size) {
 	for (size_t offset = 0; offset < size; offset += HAL_VirtualMM_PageSize) {
 		HAL_VirtualMM_UnmapPageAt(vspace, vaddr + offset);
 	}
+	HAL_VirtualMM_FlushRange(vaddr, vaddr + size);
 	IOMap_FreeIOMemoryRegion(vaddr, size);
 	Mutex_Unlock(&m_mutex);
 }
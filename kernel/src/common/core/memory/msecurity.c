@@ -1,77 +1,80 @@
+#include <common/core/memory/heap.h>
 #include <common/core/memory/msecurity.h>
 #include <hal/memory/virt.h>
 
-bool MemorySecurity_VerifyMemoryRangePermissions(uintptr_t start, uintptr_t end, int flags) {
-	if (start + end < start) {
+static bool MemorySecurity_IsUserRange(uintptr_t start, size_t size) {
+	if (start < HAL_VirtualMM_UserAreaStart || start > HAL_VirtualMM_UserAreaEnd) {
 		return false;
 	}
-	uintptr_t root = HAL_VirtualMM_GetCurrentAddressSpace();
-	uintptr_t alignedStart = ALIGN_DOWN(start, HAL_VirtualMM_PageSize);
-	uintptr_t alignedEnd = ALIGN_UP(end, HAL_VirtualMM_PageSize);
-	int result = HAL_VIRT_FLAGS_EXECUTABLE | HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_DISABLE_CACHE |
-				 HAL_VIRT_FLAGS_USER_ACCESSIBLE | HAL_VIRT_FLAGS_WRITABLE;
-	for (uintptr_t addr = alignedStart; addr < alignedEnd; addr += HAL_VirtualMM_PageSize) {
-		result &= HAL_VirtualMM_GetPageAttributes(root, addr);
-		if ((result | flags) != result) {
-			return false;
-		}
+	return size <= HAL_VirtualMM_UserAreaEnd - start;
+}
+
+// Strings are allowed to run up to the end of the user area, but not past it
+static size_t MemorySecurity_ClampUserLength(uintptr_t start, int maxLength) {
+	if (maxLength < 0 || !MemorySecurity_IsUserRange(start, 0)) {
+		return 0;
 	}
-	return true;
+	if ((size_t)maxLength > HAL_VirtualMM_UserAreaEnd - start) {
+		return HAL_VirtualMM_UserAreaEnd - start;
+	}
+	return maxLength;
 }
 
-int MemorySecurity_VerifyCString(uintptr_t start, int maxLength, int flags) {
-	uintptr_t root = HAL_VirtualMM_GetCurrentAddressSpace();
-	int stringFlags =
-		HAL_VIRT_FLAGS_EXECUTABLE | HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_USER_ACCESSIBLE | HAL_VIRT_FLAGS_WRITABLE;
-	for (uintptr_t addr = start; addr < start + (uintptr_t)maxLength; ++addr) {
-		if (addr < start) {
-			return false;
-		}
-		if (addr == start) {
-			stringFlags = HAL_VirtualMM_GetPageAttributes(root, ALIGN_DOWN(addr, HAL_VirtualMM_PageSize));
-			if ((stringFlags | flags) != stringFlags) {
-				return -1;
-			}
-		} else if (addr % HAL_VirtualMM_PageSize == 0) {
-			stringFlags &= HAL_VirtualMM_GetPageAttributes(root, addr);
-			if ((stringFlags | flags) != stringFlags) {
-				return -1;
-			}
-		}
-		char *loc = (char *)addr;
-		if (*loc == '\0') {
-			return addr - start;
-		}
+bool MemorySecurity_CopyFromUser(void *dst, uintptr_t src, size_t size) {
+	if (!MemorySecurity_IsUserRange(src, size)) {
+		return false;
 	}
-	return -1;
+	return HAL_VirtualMM_CopyUser(dst, (const void *)src, size) == 0;
+}
+
+bool MemorySecurity_CopyToUser(uintptr_t dst, const void *src, size_t size) {
+	if (!MemorySecurity_IsUserRange(dst, size)) {
+		return false;
+	}
+	return HAL_VirtualMM_CopyUser((void *)dst, src, size) == 0;
+}
+
+int MemorySecurity_StrncpyFromUser(char *dst, uintptr_t src, int maxLength) {
+	size_t length = MemorySecurity_ClampUserLength(src, maxLength);
+	if (length == 0) {
+		return -1;
+	}
+	return HAL_VirtualMM_CopyUserString(dst, (const char *)src, length);
+}
+
+char *MemorySecurity_CopyStringFromUser(uintptr_t src, int maxLength, int *length) {
+	size_t maxUserLength = MemorySecurity_ClampUserLength(src, maxLength);
+	if (maxUserLength == 0) {
+		return NULL;
+	}
+	int userLength = HAL_VirtualMM_UserStringLength((const char *)src, maxUserLength);
+	if (userLength == -1) {
+		return NULL;
+	}
+	char *result = Heap_AllocateMemory(userLength + 1);
+	if (result == NULL) {
+		return NULL;
+	}
+	// string could have been changed in the meantime, so its length is checked again
+	if (MemorySecurity_StrncpyFromUser(result, src, userLength + 1) != userLength) {
+		Heap_FreeMemory(result, userLength + 1);
+		return NULL;
+	}
+	*length = userLength;
+	return result;
 }
 
-int MemorySecurity_VerifyNullTerminatedPointerList(uintptr_t start, int maxPointerCount, int flags) {
+int MemorySecurity_CountUserPointers(uintptr_t start, int maxPointerCount) {
 	if (start % sizeof(uintptr_t) != 0) {
 		return -1;
 	}
-	uintptr_t root = HAL_VirtualMM_GetCurrentAddressSpace();
-	int pointerFlags =
-		HAL_VIRT_FLAGS_EXECUTABLE | HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_USER_ACCESSIBLE | HAL_VIRT_FLAGS_WRITABLE;
-	for (uintptr_t addr = start; addr < start + sizeof(uintptr_t) * (uintptr_t)maxPointerCount;
-		 addr += sizeof(uintptr_t)) {
-		if (addr < start) {
-			return false;
-		}
-		if (addr == start) {
-			pointerFlags = HAL_VirtualMM_GetPageAttributes(root, ALIGN_DOWN(addr, HAL_VirtualMM_PageSize));
-			if ((pointerFlags | flags) != pointerFlags) {
-				return -1;
-			}
-		} else if (addr % HAL_VirtualMM_PageSize == 0) {
-			pointerFlags &= HAL_VirtualMM_GetPageAttributes(root, addr);
-			if ((pointerFlags | flags) != pointerFlags) {
-				return -1;
-			}
+	for (int i = 0; i < maxPointerCount; ++i) {
+		uintptr_t pointer;
+		if (!MemorySecurity_CopyFromUser(&pointer, start + i * sizeof(uintptr_t), sizeof(uintptr_t))) {
+			return -1;
 		}
-		uintptr_t *loc = (uintptr_t *)addr;
-		if (*loc == 0) {
-			return (addr - start) / sizeof(uintptr_t);
+		if (pointer == 0) {
+			return i;
 		}
 	}
 	return -1;
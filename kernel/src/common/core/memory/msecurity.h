@@ -2,14 +2,16 @@
 #define __MSECURITY_H_INCLUDED__
 
 #include <common/misc/utils.h>
-#include <hal/memory/virt.h>
 
-#define MSECURITY_URW (HAL_VIRT_FLAGS_USER_ACCESSIBLE | HAL_VIRT_FLAGS_WRITABLE | HAL_VIRT_FLAGS_READABLE)
-#define MSECURITY_UW (HAL_VIRT_FLAGS_USER_ACCESSIBLE | HAL_VIRT_FLAGS_WRITABLE)
-#define MSECURITY_UR (HAL_VIRT_FLAGS_USER_ACCESSIBLE | HAL_VIRT_FLAGS_READABLE)
-
-bool MemorySecurity_VerifyMemoryRangePermissions(uintptr_t start, uintptr_t end, int flags);
-int MemorySecurity_VerifyCString(uintptr_t start, int maxLength, int flags);
-int MemorySecurity_VerifyNullTerminatedPointerList(uintptr_t start, int maxPointerCount, int flags);
+// Helpers below access user memory of the current address space. They check that the range belongs to the user area
+// and rely on page fault handler to catch the rest, so they should be called without address space lock held
+bool MemorySecurity_CopyFromUser(void *dst, uintptr_t src, size_t size);
+bool MemorySecurity_CopyToUser(uintptr_t dst, const void *src, size_t size);
+// Copies string with its null terminator to the buffer of maxLength bytes. Returns string length or -1
+int MemorySecurity_StrncpyFromUser(char *dst, uintptr_t src, int maxLength);
+// Returns heap allocated copy of the string that should be freed with length + 1 as size
+char *MemorySecurity_CopyStringFromUser(uintptr_t src, int maxLength, int *length);
+// Returns count of pointers before the null one or -1
+int MemorySecurity_CountUserPointers(uintptr_t start, int maxPointerCount);
 
 #endif
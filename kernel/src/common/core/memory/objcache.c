@@ -0,0 +1,125 @@
+#include <common/core/memory/objcache.h>
+#include <common/lib/kmsg.h>
+#include <hal/memory/phys.h>
+#include <hal/memory/virt.h>
+
+#define OBJCACHE_MOD_NAME "Object Cache Allocator"
+#define OBJCACHE_ALIGNMENT 8
+#define OBJCACHE_MIN_OBJECTS_PER_BLOCK 8
+#define OBJCACHE_MAX_BLOCK_SIZE 65536
+
+struct ObjectCache_FreeObject {
+	struct ObjectCache_FreeObject *next;
+};
+
+static struct ObjectCache *m_caches = NULL;
+static struct Mutex m_cachesMutex;
+
+static void ObjectCache_ComputeLayout(struct ObjectCache *cache) {
+	size_t size = cache->objectSize;
+	if (size < sizeof(struct ObjectCache_FreeObject)) {
+		size = sizeof(struct ObjectCache_FreeObject);
+	}
+	// Constructed state should survive free, so free list link is kept past the end of the object
+	cache->freeLinkOffset = 0;
+	if (cache->constructor != NULL) {
+		cache->freeLinkOffset = ALIGN_UP(cache->objectSize, sizeof(struct ObjectCache_FreeObject));
+		size = cache->freeLinkOffset + sizeof(struct ObjectCache_FreeObject);
+	}
+	cache->slotSize = ALIGN_UP(size, OBJCACHE_ALIGNMENT);
+	cache->blockSize = ALIGN_UP(cache->slotSize * OBJCACHE_MIN_OBJECTS_PER_BLOCK, HAL_VirtualMM_PageSize);
+	if (cache->blockSize > OBJCACHE_MAX_BLOCK_SIZE) {
+		cache->blockSize = ALIGN_UP(cache->slotSize, HAL_VirtualMM_PageSize);
+	}
+	cache->objectsPerBlock = cache->blockSize / cache->slotSize;
+	Mutex_Lock(&m_cachesMutex);
+	cache->next = m_caches;
+	m_caches = cache;
+	Mutex_Unlock(&m_cachesMutex);
+}
+
+static INLINE struct ObjectCache_FreeObject *ObjectCache_GetFreeLink(struct ObjectCache *cache, void *object) {
+	return (struct ObjectCache_FreeObject *)((uintptr_t)object + cache->freeLinkOffset);
+}
+
+static INLINE void *ObjectCache_GetObjectFromLink(struct ObjectCache *cache, struct ObjectCache_FreeObject *link) {
+	return (void *)((uintptr_t)link - cache->freeLinkOffset);
+}
+
+static bool ObjectCache_Grow(struct ObjectCache *cache) {
+	uintptr_t block = HAL_PhysicalMM_KernelAllocArea(cache->blockSize);
+	if (block == 0) {
+		return false;
+	}
+	block += HAL_VirtualMM_KernelMappingBase;
+	for (size_t i = cache->objectsPerBlock; i > 0; --i) {
+		void *object = (void *)(block + (i - 1) * cache->slotSize);
+		if (cache->constructor != NULL) {
+			cache->constructor(object);
+		}
+		struct ObjectCache_FreeObject *link = ObjectCache_GetFreeLink(cache, object);
+		link->next = cache->freeList;
+		cache->freeList = link;
+	}
+	cache->blocksCount++;
+	return true;
+}
+
+void *ObjectCache_Allocate(struct ObjectCache *cache) {
+	Mutex_Lock(&(cache->mutex));
+	if (cache->objectsPerBlock == 0) {
+		ObjectCache_ComputeLayout(cache);
+	}
+	if (cache->freeList == NULL) {
+		if (!ObjectCache_Grow(cache)) {
+			cache->failuresCount++;
+			Mutex_Unlock(&(cache->mutex));
+			return NULL;
+		}
+	}
+	struct ObjectCache_FreeObject *link = cache->freeList;
+	cache->freeList = link->next;
+	cache->objectsInUse++;
+	cache->allocationsCount++;
+	Mutex_Unlock(&(cache->mutex));
+	return ObjectCache_GetObjectFromLink(cache, link);
+}
+
+void ObjectCache_Free(struct ObjectCache *cache, void *object) {
+	if (object == NULL) {
+		return;
+	}
+	Mutex_Lock(&(cache->mutex));
+	if (cache->objectsInUse == 0) {
+		KernelLog_ErrorMsg(OBJCACHE_MOD_NAME, "Attempt to free object to the empty cache \"%s\"", cache->name);
+	}
+	struct ObjectCache_FreeObject *link = ObjectCache_GetFreeLink(cache, object);
+	link->next = cache->freeList;
+	cache->freeList = link;
+	cache->objectsInUse--;
+	Mutex_Unlock(&(cache->mutex));
+}
+
+void ObjectCache_GetStatistics(struct ObjectCache *cache, struct ObjectCache_Statistics *stats) {
+	Mutex_Lock(&(cache->mutex));
+	stats->name = cache->name;
+	stats->objectSize = cache->objectSize;
+	stats->slotSize = cache->slotSize;
+	stats->objectsPerBlock = cache->objectsPerBlock;
+	stats->blocksCount = cache->blocksCount;
+	stats->objectsInUse = cache->objectsInUse;
+	stats->objectsFree = cache->blocksCount * cache->objectsPerBlock - cache->objectsInUse;
+	stats->allocationsCount = cache->allocationsCount;
+	stats->failuresCount = cache->failuresCount;
+	Mutex_Unlock(&(cache->mutex));
+}
+
+void ObjectCache_Enumerate(void (*callback)(struct ObjectCache *cache, void *ctx), void *ctx) {
+	// caches are never unregistered, so the list can be walked without holding the lock
+	Mutex_Lock(&m_cachesMutex);
+	struct ObjectCache *cache = m_caches;
+	Mutex_Unlock(&m_cachesMutex);
+	for (; cache != NULL; cache = cache->next) {
+		callback(cache, ctx);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef __OBJCACHE_H_INCLUDED__
+#define __OBJCACHE_H_INCLUDED__
+
+#include <common/core/proc/mutex.h>
+#include <common/misc/utils.h>
+
+struct ObjectCache_FreeObject;
+
+struct ObjectCache {
+	const char *name;
+	size_t objectSize;
+	void (*constructor)(void *object);
+	size_t slotSize;
+	size_t freeLinkOffset;
+	size_t objectsPerBlock;
+	size_t blockSize;
+	struct ObjectCache_FreeObject *freeList;
+	struct Mutex mutex;
+	size_t blocksCount;
+	size_t objectsInUse;
+	size_t allocationsCount;
+	size_t failuresCount;
+	struct ObjectCache *next;
+};
+
+struct ObjectCache_Statistics {
+	const char *name;
+	size_t objectSize;
+	size_t slotSize;
+	size_t objectsPerBlock;
+	size_t blocksCount;
+	size_t objectsInUse;
+	size_t objectsFree;
+	size_t allocationsCount;
+	size_t failuresCount;
+};
+
+// Constructor (if any) is invoked once per slot when a new block is carved. Objects must be returned to the cache in
+// constructed state
+#define OBJECT_CACHE_INITIALIZER(cacheName, type, ctor)                                                                \
+	{ .name = cacheName, .objectSize = sizeof(type), .constructor = ctor }
+
+void *ObjectCache_Allocate(struct ObjectCache *cache);
+void ObjectCache_Free(struct ObjectCache *cache, void *object);
+void ObjectCache_GetStatistics(struct ObjectCache *cache, struct ObjectCache_Statistics *stats);
+void ObjectCache_Enumerate(void (*callback)(struct ObjectCache *cache, void *ctx), void *ctx);
+
+#endif
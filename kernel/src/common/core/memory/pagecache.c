@@ -0,0 +1,178 @@
+#include <common/core/memory/heap.h>
+#include <common/core/memory/objcache.h>
+#include <common/core/memory/pagecache.h>
+#include <hal/memory/phys.h>
+#include <hal/memory/virt.h>
+
+struct PageCache_Page {
+	struct RedBlackTree_Node node;
+	off_t offset;
+	uintptr_t frame;
+};
+
+static struct ObjectCache m_pagesCache = OBJECT_CACHE_INITIALIZER("PageCache_Page", struct PageCache_Page, NULL);
+static struct Mutex m_reclaimableMutex = {.queueHead = NULL, .queueTail = NULL, .locked = false};
+static struct PageCache *m_reclaimableHead = NULL;
+static struct Heap_ReclaimHook m_reclaimHook;
+
+static int PageCache_Comparator(struct RedBlackTree_Node *left, struct RedBlackTree_Node *right, void *ctx) {
+	(void)ctx;
+	struct PageCache_Page *leftPage = (struct PageCache_Page *)left;
+	struct PageCache_Page *rightPage = (struct PageCache_Page *)right;
+	return SPACESHIP(leftPage->offset, rightPage->offset);
+}
+
+static size_t PageCache_Reclaim();
+
+void PageCache_Initialize(struct PageCache *cache, bool reclaimable) {
+	RedBlackTree_Initialize(&(cache->pages));
+	Mutex_Initialize(&(cache->mutex));
+	cache->pagesCount = 0;
+	cache->reclaimable = reclaimable;
+	cache->prev = cache->next = NULL;
+	if (!reclaimable) {
+		return;
+	}
+	Mutex_Lock(&m_reclaimableMutex);
+	if (m_reclaimHook.reclaim == NULL) {
+		m_reclaimHook.reclaim = PageCache_Reclaim;
+		Heap_RegisterReclaimHook(&m_reclaimHook);
+	}
+	cache->next = m_reclaimableHead;
+	if (m_reclaimableHead != NULL) {
+		m_reclaimableHead->prev = cache;
+	}
+	m_reclaimableHead = cache;
+	Mutex_Unlock(&m_reclaimableMutex);
+}
+
+static uintptr_t PageCache_ReadPage(struct File *file, off_t offset) {
+	// frames are taken from the kernel arena, so that file system could read into them directly
+	uintptr_t frame = HAL_PhysicalMM_KernelAllocArea(HAL_VirtualMM_PageSize);
+	if (frame == 0) {
+		return 0;
+	}
+	char *buf = (char *)(frame + HAL_VirtualMM_KernelMappingBase);
+	if (file == NULL) {
+		memset(buf, 0, HAL_VirtualMM_PageSize);
+		return frame;
+	}
+	int result = File_PRead(file, offset, (int)HAL_VirtualMM_PageSize, buf);
+	if (result < 0) {
+		HAL_PhysicalMM_KernelFreeArea(frame, HAL_VirtualMM_PageSize);
+		return 0;
+	}
+	memset(buf + result, 0, HAL_VirtualMM_PageSize - result);
+	return frame;
+}
+
+uintptr_t PageCache_GetPage(struct PageCache *cache, struct File *file, off_t offset) {
+	struct PageCache_Page query;
+	query.offset = offset;
+	Mutex_Lock(&(cache->mutex));
+	struct PageCache_Page *page = (struct PageCache_Page *)RedBlackTree_Query(
+		&(cache->pages), (struct RedBlackTree_Node *)&query, PageCache_Comparator, NULL, true);
+	if (page != NULL) {
+		HAL_VirtualMM_ReferenceFrame(page->frame);
+		Mutex_Unlock(&(cache->mutex));
+		return page->frame;
+	}
+	page = ObjectCache_Allocate(&m_pagesCache);
+	if (page == NULL) {
+		Mutex_Unlock(&(cache->mutex));
+		return 0;
+	}
+	page->offset = offset;
+	page->frame = PageCache_ReadPage(file, offset);
+	if (page->frame == 0) {
+		ObjectCache_Free(&m_pagesCache, page);
+		Mutex_Unlock(&(cache->mutex));
+		return 0;
+	}
+	RedBlackTree_Insert(&(cache->pages), (struct RedBlackTree_Node *)page, PageCache_Comparator, NULL);
+	cache->pagesCount++;
+	HAL_VirtualMM_ReferenceFrame(page->frame);
+	Mutex_Unlock(&(cache->mutex));
+	return page->frame;
+}
+
+void PageCache_Update(struct PageCache *cache, off_t offset, const char *buf, size_t size) {
+	Mutex_Lock(&(cache->mutex));
+	if (cache->pagesCount == 0) {
+		Mutex_Unlock(&(cache->mutex));
+		return;
+	}
+	off_t end = offset + (off_t)size;
+	for (off_t current = ALIGN_DOWN(offset, HAL_VirtualMM_PageSize); current < end;
+		 current += HAL_VirtualMM_PageSize) {
+		struct PageCache_Page query;
+		query.offset = current;
+		struct PageCache_Page *page = (struct PageCache_Page *)RedBlackTree_Query(
+			&(cache->pages), (struct RedBlackTree_Node *)&query, PageCache_Comparator, NULL, true);
+		if (page == NULL) {
+			continue;
+		}
+		off_t from = current < offset ? offset : current;
+		off_t to = current + (off_t)HAL_VirtualMM_PageSize > end ? end : current + (off_t)HAL_VirtualMM_PageSize;
+		char *dst = (char *)(page->frame + HAL_VirtualMM_KernelMappingBase) + (from - current);
+		memcpy(dst, buf + (from - offset), to - from);
+	}
+	Mutex_Unlock(&(cache->mutex));
+}
+
+static void PageCache_FreePage(struct RedBlackTree_Node *node, MAYBE_UNUSED void *opaque) {
+	struct PageCache_Page *page = (struct PageCache_Page *)node;
+	// if the page is still mapped somewhere, the last mapping will free the frame
+	if (HAL_VirtualMM_DropFrameReference(page->frame)) {
+		HAL_PhysicalMM_KernelFreeArea(page->frame, HAL_VirtualMM_PageSize);
+	}
+	ObjectCache_Free(&m_pagesCache, page);
+}
+
+void PageCache_Clear(struct PageCache *cache) {
+	if (cache->reclaimable) {
+		Mutex_Lock(&m_reclaimableMutex);
+		if (cache->prev == NULL) {
+			m_reclaimableHead = cache->next;
+		} else {
+			cache->prev->next = cache->next;
+		}
+		if (cache->next != NULL) {
+			cache->next->prev = cache->prev;
+		}
+		Mutex_Unlock(&m_reclaimableMutex);
+	}
+	Mutex_Lock(&(cache->mutex));
+	RedBlackTree_Clear(&(cache->pages), PageCache_FreePage, NULL);
+	cache->pagesCount = 0;
+	Mutex_Unlock(&(cache->mutex));
+}
+
+// Caches that are in use are skipped rather than waited for, as the hook may be called with any of them locked
+static size_t PageCache_Reclaim() {
+	if (!Mutex_TryLock(&m_reclaimableMutex)) {
+		return 0;
+	}
+	size_t released = 0;
+	for (struct PageCache *cache = m_reclaimableHead; cache != NULL; cache = cache->next) {
+		if (!Mutex_TryLock(&(cache->mutex))) {
+			continue;
+		}
+		struct RedBlackTree_Node *current = cache->pages.ends[0];
+		while (current != NULL) {
+			struct RedBlackTree_Node *next = current->iter[1];
+			struct PageCache_Page *page = (struct PageCache_Page *)current;
+			// mapped pages are kept, so that all mappings of the file share the same frame
+			if (!HAL_VirtualMM_IsFrameShared(page->frame)) {
+				RedBlackTree_Remove(&(cache->pages), current);
+				cache->pagesCount--;
+				PageCache_FreePage(current, NULL);
+				released++;
+			}
+			current = next;
+		}
+		Mutex_Unlock(&(cache->mutex));
+	}
+	Mutex_Unlock(&m_reclaimableMutex);
+	return released;
+}
@@ -0,0 +1,31 @@
+#ifndef __PAGECACHE_H_INCLUDED__
+#define __PAGECACHE_H_INCLUDED__
+
+#include <common/core/fd/fd.h>
+#include <common/core/proc/mutex.h>
+#include <common/lib/rbtree.h>
+#include <common/misc/utils.h>
+
+// Per-inode cache of file pages. Cached frames are owned by the cache and can be mapped into any number of address
+// spaces, each mapping holding a frame reference
+struct PageCache {
+	struct RedBlackTree_Tree pages;
+	struct Mutex mutex;
+	size_t pagesCount;
+	// reclaimable caches are linked together, so that their pages can be dropped under memory pressure
+	bool reclaimable;
+	struct PageCache *prev, *next;
+};
+
+// Pages of reclaimable cache can be read from the file again, so the ones that are not mapped are dropped by the heap
+// reclaim hook. Caches without backing file should not be reclaimable
+void PageCache_Initialize(struct PageCache *cache, bool reclaimable);
+// Pages missing from the cache are read from the file or zeroed if there is no file. Returned frame is referenced on
+// behalf of the caller
+uintptr_t PageCache_GetPage(struct PageCache *cache, struct File *file, off_t offset);
+// Copies data written to the file into cached pages, so that mappings see it
+void PageCache_Update(struct PageCache *cache, off_t offset, const char *buf, size_t size);
+// Drops all pages. Cache can't be used afterwards
+void PageCache_Clear(struct PageCache *cache);
+
+#endif
@@ -1,5 +1,9 @@
+#include <common/core/devices/shm.h>
 #include <common/core/memory/heap.h>
+#include <common/core/fd/vfs.h>
+#include <common/core/memory/objcache.h>
 #include <common/core/memory/virt.h>
+#include <common/core/memory/zeropool.h>
 #include <common/core/proc/proc.h>
 #include <common/core/proc/proclayout.h>
 #include <common/lib/kmsg.h>
@@ -8,6 +12,12 @@
 #include <hal/proc/intlevel.h>
 
 #define VIRT_MOD_NAME "Virtual Memory Manager"
+#define VIRTUALMM_FRAMES_BATCH_SIZE 256
+
+static struct ObjectCache m_regionNodesCache =
+	OBJECT_CACHE_INITIALIZER("VirtualMM_MemoryRegionNode", struct VirtualMM_MemoryRegionNode, NULL);
+static struct ObjectCache m_holeNodesCache =
+	OBJECT_CACHE_INITIALIZER("VirtualMM_MemoryHoleNode", struct VirtualMM_MemoryHoleNode, NULL);
 
 static bool VirtualMM_EnoughMemFilter(struct RedBlackTree_Node *node, void *ctx) {
 	size_t size = *(size_t *)ctx;
@@ -36,31 +46,60 @@ static int VirtualMM_GetMemoryAreaComparator(struct RedBlackTree_Node *desired,
 	return 1;
 }
 
+struct VirtualMM_FramesBatch {
+	HAL_PhysicalMM_Address frames[VIRTUALMM_FRAMES_BATCH_SIZE];
+	size_t count;
+};
+
+static void VirtualMM_FreeUnmappedFrame(HAL_PhysicalMM_Address frame, size_t size, void *ctx) {
+	struct VirtualMM_FramesBatch *batch = (struct VirtualMM_FramesBatch *)ctx;
+	// frames of large pages are never shared
+	if (size != HAL_VirtualMM_PageSize) {
+		HAL_PhysicalMM_UserFreeArea(frame, size);
+		return;
+	}
+	if (!HAL_VirtualMM_DropFrameReference(frame)) {
+		return;
+	}
+	batch->frames[batch->count++] = frame;
+	if (batch->count == VIRTUALMM_FRAMES_BATCH_SIZE) {
+		HAL_PhysicalMM_UserFreeFrames(batch->frames, batch->count);
+		batch->count = 0;
+	}
+}
+
+static void VirtualMM_UnmapAndFreePages(struct VirtualMM_AddressSpace *space, uintptr_t start, uintptr_t end) {
+	struct VirtualMM_FramesBatch batch;
+	batch.count = 0;
+	HAL_VirtualMM_UnmapRange(space->root, start, end, VirtualMM_FreeUnmappedFrame, &batch);
+	HAL_PhysicalMM_UserFreeFrames(batch.frames, batch.count);
+}
+
 void VirtualMM_InitializeRegionTrees(struct VirtualMM_RegionTrees *regions) {
 	RedBlackTree_Initialize(&(regions->holesTreeRoot));
 	RedBlackTree_Initialize(&(regions->regionsTreeRoot));
 }
 
-void VirtualMM_FreeMemoryRegionNode(struct RedBlackTree_Node *node, void *opaque) {
-	struct VirtualMM_AddressSpace *space = (struct VirtualMM_AddressSpace *)opaque;
+// Pages of the region should be unmapped already
+void VirtualMM_FreeMemoryRegionNode(struct RedBlackTree_Node *node, MAYBE_UNUSED void *opaque) {
 	struct VirtualMM_MemoryRegionNode *region = (struct VirtualMM_MemoryRegionNode *)node;
-	if (region->isUsed) {
-		for (uintptr_t current = region->base.start; current < region->base.end; current += HAL_VirtualMM_PageSize) {
-			uintptr_t page = HAL_VirtualMM_UnmapPageAt(space->root, current);
-			if (page != 0) {
-				HAL_PhysicalMM_UserFreeFrame(page);
-			}
-		}
+	if (region->isUsed && region->type == VIRTUALMM_REGION_TYPE_FILE) {
+		File_Drop(region->file);
 	}
-	FREE_OBJ(region);
+	ObjectCache_Free(&m_regionNodesCache, region);
 }
 
 void VirtualMM_FreeMemoryHoleNode(struct RedBlackTree_Node *node, MAYBE_UNUSED void *opaque) {
 	struct VirtualMM_MemoryHoleNode *hole = (struct VirtualMM_MemoryHoleNode *)node;
-	FREE_OBJ(hole);
+	ObjectCache_Free(&m_holeNodesCache, hole);
 }
 
 void VirtualMM_CleanupRegionTrees(struct VirtualMM_AddressSpace *space) {
+	// pages of all regions are unmapped at once by walking page directory instead of region by region
+	struct VirtualMM_FramesBatch batch;
+	batch.count = 0;
+	HAL_VirtualMM_ClearUserArea(space->root, VirtualMM_FreeUnmappedFrame, &batch);
+	HAL_PhysicalMM_UserFreeFrames(batch.frames, batch.count);
 	if (space->trees.holesTreeRoot.root != NULL) {
 		RedBlackTree_Clear(&(space->trees.holesTreeRoot), VirtualMM_FreeMemoryHoleNode, (void *)space);
 	}
@@ -70,13 +109,13 @@ void VirtualMM_CleanupRegionTrees(struct VirtualMM_AddressSpace *space) {
 }
 
 bool VirtualMM_AddInitRegion(struct VirtualMM_RegionTrees *trees, uintptr_t start, uintptr_t end) {
-	struct VirtualMM_MemoryHoleNode *hole = ALLOC_OBJ(struct VirtualMM_MemoryHoleNode);
+	struct VirtualMM_MemoryHoleNode *hole = ObjectCache_Allocate(&m_holeNodesCache);
 	if (hole == NULL) {
 		return false;
 	}
-	struct VirtualMM_MemoryRegionNode *region = ALLOC_OBJ(struct VirtualMM_MemoryRegionNode);
+	struct VirtualMM_MemoryRegionNode *region = ObjectCache_Allocate(&m_regionNodesCache);
 	if (region == NULL) {
-		FREE_OBJ(hole);
+		ObjectCache_Free(&m_holeNodesCache, hole);
 		return false;
 	}
 	hole->correspondingRegion = region;
@@ -88,6 +127,7 @@ bool VirtualMM_AddInitRegion(struct VirtualMM_RegionTrees *trees, uintptr_t star
 	region->base.end = end;
 	region->base.size = end - start;
 	region->isUsed = false;
+	region->pinCount = 0;
 	RedBlackTree_Insert(&(trees->holesTreeRoot), (struct RedBlackTree_Node *)hole,
 						VirtualMM_HolesTreeInsertionComparator, NULL);
 	RedBlackTree_Insert(&(trees->regionsTreeRoot), (struct RedBlackTree_Node *)region,
@@ -107,10 +147,10 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_AllocateRegion(struct VirtualMM_Reg
 	if (hole->base.size == size) {
 		region->isUsed = true;
 		RedBlackTree_Remove(&(trees->holesTreeRoot), (struct RedBlackTree_Node *)hole);
-		FREE_OBJ(hole);
+		ObjectCache_Free(&m_holeNodesCache, hole);
 		return hole->correspondingRegion;
 	}
-	struct VirtualMM_MemoryRegionNode *newRegion = ALLOC_OBJ(struct VirtualMM_MemoryRegionNode);
+	struct VirtualMM_MemoryRegionNode *newRegion = ObjectCache_Allocate(&m_regionNodesCache);
 	if (newRegion == NULL) {
 		return NULL;
 	}
@@ -125,6 +165,7 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_AllocateRegion(struct VirtualMM_Reg
 	region->correspondingHole = NULL;
 	region->isUsed = true;
 	newRegion->isUsed = false;
+	newRegion->pinCount = 0;
 	newRegion->correspondingHole = hole;
 	newRegion->flags = flags;
 	hole->correspondingRegion = newRegion;
@@ -160,7 +201,7 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_ReserveRegion(struct VirtualMM_Regi
 	struct VirtualMM_MemoryRegionNode *left = NULL, *right = NULL;
 	struct VirtualMM_MemoryHoleNode *leftHole = NULL, *rightHole = NULL;
 	if (region->base.start < start) {
-		left = ALLOC_OBJ(struct VirtualMM_MemoryRegionNode);
+		left = ObjectCache_Allocate(&m_regionNodesCache);
 		if (left == NULL) {
 			return NULL;
 		}
@@ -168,10 +209,10 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_ReserveRegion(struct VirtualMM_Regi
 		freeHole = NULL;
 	}
 	if (region->base.end > end) {
-		right = ALLOC_OBJ(struct VirtualMM_MemoryRegionNode);
+		right = ObjectCache_Allocate(&m_regionNodesCache);
 		if (right == NULL) {
 			if (left != NULL) {
-				FREE_OBJ(left);
+				ObjectCache_Free(&m_regionNodesCache, left);
 			}
 			return NULL;
 		}
@@ -179,12 +220,12 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_ReserveRegion(struct VirtualMM_Regi
 			rightHole = freeHole;
 			freeHole = NULL;
 		} else {
-			rightHole = ALLOC_OBJ(struct VirtualMM_MemoryHoleNode);
+			rightHole = ObjectCache_Allocate(&m_holeNodesCache);
 			if (rightHole == NULL) {
 				if (left != NULL) {
-					FREE_OBJ(left);
+					ObjectCache_Free(&m_regionNodesCache, left);
 				}
-				FREE_OBJ(right);
+				ObjectCache_Free(&m_regionNodesCache, right);
 				return NULL;
 			}
 		}
@@ -192,8 +233,8 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_ReserveRegion(struct VirtualMM_Regi
 	RedBlackTree_Remove(&(trees->holesTreeRoot), (struct RedBlackTree_Node *)(region->correspondingHole));
 	if (region->base.start == start && region->base.end == end) {
 		region->isUsed = true;
+		ObjectCache_Free(&m_holeNodesCache, region->correspondingHole);
 		region->correspondingHole = NULL;
-		FREE_OBJ(region->correspondingHole);
 		return region;
 	}
 	RedBlackTree_Remove(&(trees->regionsTreeRoot), (struct RedBlackTree_Node *)region);
@@ -207,6 +248,7 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_ReserveRegion(struct VirtualMM_Regi
 		left->correspondingHole = leftHole;
 		leftHole->correspondingRegion = left;
 		left->isUsed = false;
+		left->pinCount = 0;
 		RedBlackTree_Insert(&(trees->holesTreeRoot), (struct RedBlackTree_Node *)leftHole,
 							VirtualMM_HolesTreeInsertionComparator, NULL);
 		RedBlackTree_Insert(&(trees->regionsTreeRoot), (struct RedBlackTree_Node *)left,
@@ -222,6 +264,7 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_ReserveRegion(struct VirtualMM_Regi
 		right->correspondingHole = rightHole;
 		rightHole->correspondingRegion = right;
 		right->isUsed = false;
+		right->pinCount = 0;
 		RedBlackTree_Insert(&(trees->holesTreeRoot), (struct RedBlackTree_Node *)rightHole,
 							VirtualMM_HolesTreeInsertionComparator, NULL);
 		RedBlackTree_Insert(&(trees->regionsTreeRoot), (struct RedBlackTree_Node *)right,
@@ -238,6 +281,18 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_ReserveRegion(struct VirtualMM_Regi
 	return region;
 }
 
+static struct VirtualMM_MemoryRegionNode *VirtualMM_AllocateAlignedRegion(struct VirtualMM_RegionTrees *trees,
+																		   size_t size, size_t alignment, int flags) {
+	size_t sizeBuf = size + alignment - HAL_VirtualMM_PageSize;
+	struct VirtualMM_MemoryHoleNode *hole = (struct VirtualMM_MemoryHoleNode *)RedBlackTree_LowerBound(
+		&(trees->holesTreeRoot), VirtualMM_EnoughMemFilter, &sizeBuf);
+	if (sizeBuf < size || hole == NULL || hole->base.size < sizeBuf) {
+		return VirtualMM_AllocateRegion(trees, size, flags);
+	}
+	uintptr_t start = ALIGN_UP(hole->base.start, alignment);
+	return VirtualMM_ReserveRegion(trees, start, start + size, flags);
+}
+
 enum {
 	VIRTUALMM_FREE_REGION_SUCCESS,
 	VIRTUALMM_FREE_REGION_ERROR,
@@ -247,31 +302,35 @@ enum {
 		return VIRTUALMM_FREE_REGION_SUCCESS;
 	}
 	struct VirtualMM_MemoryRegionNode *region = VirtualMM_MemoryGetRegionByAddress(trees, start);
-	if (region == NULL || !(region->isUsed) || end > region->base.end || start < region->base.start) {
+	if (region == NULL || !(region->isUsed) || region->pinCount != 0 || end > region->base.end ||
+		start < region->base.start) {
 		return VIRTUALMM_FREE_REGION_ERROR;
 	}
 	struct VirtualMM_MemoryRegionNode *leftRegion = NULL, *rightRegion = NULL;
-	struct VirtualMM_MemoryHoleNode *hole = ALLOC_OBJ(struct VirtualMM_MemoryHoleNode);
+	struct VirtualMM_MemoryHoleNode *hole = ObjectCache_Allocate(&m_holeNodesCache);
 	if (hole == NULL) {
 		return VIRTUALMM_FREE_REGION_ERROR;
 	}
 	if (region->base.start < start) {
-		leftRegion = ALLOC_OBJ(struct VirtualMM_MemoryRegionNode);
+		leftRegion = ObjectCache_Allocate(&m_regionNodesCache);
 		if (leftRegion == NULL) {
-			FREE_OBJ(hole);
+			ObjectCache_Free(&m_holeNodesCache, hole);
 			return VIRTUALMM_FREE_ALLOCATION_FAILURE;
 		}
 	}
 	if (region->base.end > end) {
-		rightRegion = ALLOC_OBJ(struct VirtualMM_MemoryRegionNode);
+		rightRegion = ObjectCache_Allocate(&m_regionNodesCache);
 		if (rightRegion == NULL) {
 			if (leftRegion != NULL) {
-				FREE_OBJ(hole);
-				FREE_OBJ(leftRegion);
+				ObjectCache_Free(&m_holeNodesCache, hole);
+				ObjectCache_Free(&m_regionNodesCache, leftRegion);
 			}
 			return VIRTUALMM_FREE_ALLOCATION_FAILURE;
 		}
 	}
+	struct File *file = (region->type == VIRTUALMM_REGION_TYPE_FILE) ? region->file : NULL;
+	off_t regionOffset = region->fileOffset;
+	uintptr_t regionStart = region->base.start;
 	region->isUsed = false;
 	region->correspondingHole = hole;
 	hole->correspondingRegion = region;
@@ -295,14 +354,22 @@ enum {
 		RedBlackTree_Remove(&(trees->regionsTreeRoot), (struct RedBlackTree_Node *)(leftAdjoinedRegion));
 		RedBlackTree_Remove(&(trees->holesTreeRoot),
 							(struct RedBlackTree_Node *)(leftAdjoinedRegion->correspondingHole));
-		FREE_OBJ(leftAdjoinedRegion->correspondingHole);
-		FREE_OBJ(leftAdjoinedRegion);
+		ObjectCache_Free(&m_holeNodesCache, leftAdjoinedRegion->correspondingHole);
+		ObjectCache_Free(&m_regionNodesCache, leftAdjoinedRegion);
 	} else if (leftRegion != NULL) {
 		leftRegion->isUsed = true;
+		leftRegion->pinCount = 0;
 		leftRegion->correspondingHole = NULL;
+		leftRegion->flags = region->flags;
+		leftRegion->type = region->type;
+		leftRegion->file = file;
+		leftRegion->fileOffset = regionOffset;
+		if (file != NULL) {
+			File_Ref(file);
+		}
 		leftRegion->base.start = region->base.start;
 		leftRegion->base.end = start;
-		leftRegion->base.size = leftRegion->base.end - leftRegion->base.size;
+		leftRegion->base.size = leftRegion->base.end - leftRegion->base.start;
 		region->base.start = leftRegion->base.end;
 		region->base.size = region->base.end - region->base.start;
 		RedBlackTree_Insert(&(trees->regionsTreeRoot), (struct RedBlackTree_Node *)leftRegion,
@@ -314,11 +381,19 @@ enum {
 		RedBlackTree_Remove(&(trees->regionsTreeRoot), (struct RedBlackTree_Node *)rightAdjoinedRegion);
 		RedBlackTree_Remove(&(trees->holesTreeRoot),
 							(struct RedBlackTree_Node *)(rightAdjoinedRegion->correspondingHole));
-		FREE_OBJ(rightAdjoinedRegion->correspondingHole);
-		FREE_OBJ(rightAdjoinedRegion);
+		ObjectCache_Free(&m_holeNodesCache, rightAdjoinedRegion->correspondingHole);
+		ObjectCache_Free(&m_regionNodesCache, rightAdjoinedRegion);
 	} else if (rightRegion != NULL) {
 		rightRegion->isUsed = true;
+		rightRegion->pinCount = 0;
 		rightRegion->correspondingHole = NULL;
+		rightRegion->flags = region->flags;
+		rightRegion->type = region->type;
+		rightRegion->file = file;
+		rightRegion->fileOffset = regionOffset + (end - regionStart);
+		if (file != NULL) {
+			File_Ref(file);
+		}
 		rightRegion->base.start = end;
 		rightRegion->base.end = region->base.end;
 		rightRegion->base.size = rightRegion->base.end - rightRegion->base.start;
@@ -334,6 +409,9 @@ enum {
 						VirtualMM_GetMemoryAreaComparator, NULL);
 	RedBlackTree_Insert(&(trees->holesTreeRoot), (struct RedBlackTree_Node *)hole,
 						VirtualMM_HolesTreeInsertionComparator, NULL);
+	if (file != NULL) {
+		File_Drop(file);
+	}
 	return VIRTUALMM_FREE_REGION_SUCCESS;
 }
 
@@ -346,8 +424,9 @@ struct VirtualMM_AddressSpace *VirtualMM_GetCurrentAddressSpace() {
 	return process->addressSpace;
 }
 
-struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMap(struct VirtualMM_AddressSpace *space, uintptr_t addr,
-													   size_t size, int flags, bool lock) {
+static struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapInternal(struct VirtualMM_AddressSpace *space,
+																	   uintptr_t addr, size_t size, int flags,
+																	   bool lock, bool zeroed) {
 	struct VirtualMM_AddressSpace *currentSpace = VirtualMM_GetCurrentAddressSpace();
 	if (space == NULL) {
 		space = currentSpace;
@@ -362,26 +441,36 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMap(struct VirtualMM_AddressS
 		node = VirtualMM_ReserveRegion(&(space->trees), addr, addr + size, flags);
 	}
 	if (node == NULL) {
+		if (lock) {
+			Mutex_Unlock(&(space->mutex));
+		}
 		return NULL;
 	}
+	node->type = VIRTUALMM_REGION_TYPE_EAGER;
 	addr = node->base.start;
-	for (uintptr_t current = addr; current < (addr + size); current += HAL_VirtualMM_PageSize) {
-		uintptr_t new_page = HAL_PhysicalMM_UserAllocFrame();
-		if (new_page == 0) {
+	HAL_PhysicalMM_Address frames[VIRTUALMM_FRAMES_BATCH_SIZE];
+	for (uintptr_t batch = addr; batch < (addr + size); batch += VIRTUALMM_FRAMES_BATCH_SIZE * HAL_VirtualMM_PageSize) {
+		size_t count = (addr + size - batch) / HAL_VirtualMM_PageSize;
+		if (count > VIRTUALMM_FRAMES_BATCH_SIZE) {
+			count = VIRTUALMM_FRAMES_BATCH_SIZE;
+		}
+		uintptr_t mappedEnd = batch;
+		bool allocated = zeroed ? ZeroPool_AllocFrames(frames, count) : HAL_PhysicalMM_UserAllocFrames(frames, count);
+		if (!allocated && Heap_Reclaim() != 0) {
+			allocated = zeroed ? ZeroPool_AllocFrames(frames, count) : HAL_PhysicalMM_UserAllocFrames(frames, count);
+		}
+		if (!allocated) {
 			goto failure;
 		}
-		if (!HAL_VirtualMM_MapPageAt(space->root, current, new_page, flags)) {
-			HAL_PhysicalMM_UserFreeFrame(new_page);
+		size_t mapped = HAL_VirtualMM_MapRange(space->root, batch, frames, count, flags);
+		mappedEnd += mapped * HAL_VirtualMM_PageSize;
+		if (mapped != count) {
+			HAL_PhysicalMM_UserFreeFrames(frames + mapped, count - mapped);
 			goto failure;
 		}
 		continue;
 	failure:
-		for (uintptr_t deallocating = addr; deallocating < current; deallocating += HAL_VirtualMM_PageSize) {
-			uintptr_t result = HAL_VirtualMM_UnmapPageAt(space->root, deallocating);
-			if (result != 0) {
-				HAL_PhysicalMM_UserFreeFrame(deallocating);
-			}
-		}
+		VirtualMM_UnmapAndFreePages(space, addr, mappedEnd);
 		if (lock) {
 			Mutex_Unlock(&(space->mutex));
 		}
@@ -392,7 +481,49 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMap(struct VirtualMM_AddressS
 	}
 	node->flags = flags;
 	if (space == currentSpace) {
-		HAL_VirtualMM_Flush();
+		HAL_VirtualMM_FlushRange(addr, addr + size);
+	}
+	if (lock) {
+		Mutex_Unlock(&(space->mutex));
+	}
+	return node;
+}
+
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMap(struct VirtualMM_AddressSpace *space, uintptr_t addr,
+													   size_t size, int flags, bool lock) {
+	return VirtualMM_MemoryMapInternal(space, addr, size, flags, lock, false);
+}
+
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapZeroed(struct VirtualMM_AddressSpace *space, uintptr_t addr,
+															 size_t size, int flags, bool lock) {
+	return VirtualMM_MemoryMapInternal(space, addr, size, flags, lock, true);
+}
+
+static struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapLazy(struct VirtualMM_AddressSpace *space, uintptr_t addr,
+																   size_t size, int flags, int type, struct File *file,
+																   off_t offset, bool lock) {
+	if (space == NULL) {
+		space = VirtualMM_GetCurrentAddressSpace();
+	}
+	if (lock) {
+		Mutex_Lock(&(space->mutex));
+	}
+	struct VirtualMM_MemoryRegionNode *node;
+	if (addr != 0) {
+		node = VirtualMM_ReserveRegion(&(space->trees), addr, addr + size, flags);
+	} else if (type == VIRTUALMM_REGION_TYPE_DEMAND_ZERO_LARGE) {
+		node = VirtualMM_AllocateAlignedRegion(&(space->trees), size, HAL_VirtualMM_LargePageSize, flags);
+	} else {
+		node = VirtualMM_AllocateRegion(&(space->trees), size, flags);
+	}
+	if (node != NULL) {
+		node->flags = flags;
+		node->type = type;
+		node->file = file;
+		node->fileOffset = offset;
+		if (file != NULL) {
+			File_Ref(file);
+		}
 	}
 	if (lock) {
 		Mutex_Unlock(&(space->mutex));
@@ -400,6 +531,101 @@ struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMap(struct VirtualMM_AddressS
 	return node;
 }
 
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapDemandZero(struct VirtualMM_AddressSpace *space, uintptr_t addr,
+																 size_t size, int flags, bool lock) {
+	return VirtualMM_MemoryMapLazy(space, addr, size, flags, VIRTUALMM_REGION_TYPE_DEMAND_ZERO, NULL, 0, lock);
+}
+
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapDemandZeroLarge(struct VirtualMM_AddressSpace *space,
+																	  uintptr_t addr, size_t size, int flags,
+																	  bool lock) {
+	return VirtualMM_MemoryMapLazy(space, addr, size, flags, VIRTUALMM_REGION_TYPE_DEMAND_ZERO_LARGE, NULL, 0, lock);
+}
+
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapFile(struct VirtualMM_AddressSpace *space, uintptr_t addr,
+														   size_t size, int flags, struct File *file, off_t offset,
+														   bool lock) {
+	return VirtualMM_MemoryMapLazy(space, addr, size, flags, VIRTUALMM_REGION_TYPE_FILE, file, offset, lock);
+}
+
+static bool VirtualMM_GetFilePage(struct VirtualMM_MemoryRegionNode *region, uintptr_t page,
+								  HAL_PhysicalMM_Address *frame) {
+	off_t offset = region->fileOffset + (off_t)(page - region->base.start);
+	struct SharedMemory_Object *object = SharedMemory_GetFileObject(region->file);
+	if (object != NULL) {
+		*frame = SharedMemory_GetPage(object, offset);
+	} else {
+		*frame = PageCache_GetPage(&(region->file->dentry->inode->pageCache), region->file, offset);
+	}
+	// mapping holds its own reference taken by the cache, so that writes to private mappings are copied
+	return *frame != 0;
+}
+
+static bool VirtualMM_PopulateLargePage(struct VirtualMM_AddressSpace *space, struct VirtualMM_MemoryRegionNode *region,
+										uintptr_t addr) {
+	uintptr_t start = ALIGN_DOWN(addr, HAL_VirtualMM_LargePageSize);
+	if (start < region->base.start || region->base.end - start < HAL_VirtualMM_LargePageSize ||
+		!HAL_VirtualMM_CanMapLargePageAt(space->root, start)) {
+		return false;
+	}
+	HAL_PhysicalMM_Address area = HAL_PhysicalMM_UserAllocArea(HAL_VirtualMM_LargePageSize);
+	if (area == 0) {
+		return false;
+	}
+	HAL_PhysicalMM_Address frames[64];
+	for (uintptr_t offset = 0; offset < HAL_VirtualMM_LargePageSize;) {
+		size_t count = 0;
+		for (; count < ARR_SIZE(frames) && offset < HAL_VirtualMM_LargePageSize; offset += HAL_VirtualMM_PageSize) {
+			frames[count++] = area + offset;
+		}
+		HAL_VirtualMM_ZeroFrames(frames, count);
+	}
+	if (!HAL_VirtualMM_MapLargePageAt(space->root, start, area, region->flags)) {
+		HAL_PhysicalMM_UserFreeArea(area, HAL_VirtualMM_LargePageSize);
+		return false;
+	}
+	return true;
+}
+
+bool VirtualMM_PopulatePage(struct VirtualMM_AddressSpace *space, uintptr_t addr) {
+	if (space == NULL) {
+		space = VirtualMM_GetCurrentAddressSpace();
+	}
+	struct VirtualMM_MemoryRegionNode *region = VirtualMM_MemoryGetRegionByAddress(&(space->trees), addr);
+	if (region == NULL || !(region->isUsed) || region->type == VIRTUALMM_REGION_TYPE_EAGER ||
+		(region->flags & (HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_WRITABLE)) == 0) {
+		return false;
+	}
+	uintptr_t page = ALIGN_DOWN(addr, HAL_VirtualMM_PageSize);
+	if (HAL_VirtualMM_GetPageAttributes(space->root, page) != 0) {
+		return true;
+	}
+	// small pages are used if there is no contiguous memory left or some pages of large page are already mapped
+	if (region->type == VIRTUALMM_REGION_TYPE_DEMAND_ZERO_LARGE && VirtualMM_PopulateLargePage(space, region, page)) {
+		return true;
+	}
+	HAL_PhysicalMM_Address frame;
+	bool allocated;
+	if (region->type == VIRTUALMM_REGION_TYPE_FILE) {
+		allocated = VirtualMM_GetFilePage(region, page, &frame);
+	} else {
+		allocated = ZeroPool_AllocFrames(&frame, 1);
+		if (!allocated && Heap_Reclaim() != 0) {
+			allocated = ZeroPool_AllocFrames(&frame, 1);
+		}
+	}
+	if (!allocated) {
+		return false;
+	}
+	if (!HAL_VirtualMM_MapPageAt(space->root, page, frame, region->flags)) {
+		if (HAL_VirtualMM_DropFrameReference(frame)) {
+			HAL_PhysicalMM_UserFreeFrame(frame);
+		}
+		return false;
+	}
+	return true;
+}
+
 int VirtualMM_MemoryUnmap(struct VirtualMM_AddressSpace *space, uintptr_t addr, size_t size, bool lock) {
 	struct VirtualMM_AddressSpace *currentSpace = VirtualMM_GetCurrentAddressSpace();
 	if (space == NULL) {
@@ -412,23 +638,120 @@ int VirtualMM_MemoryUnmap(struct VirtualMM_AddressSpace *space, uintptr_t addr,
 	// in case of failure
 	int status = VirtualMM_FreeRegion(&(space->trees), addr, addr + size);
 	if (status == VIRTUALMM_FREE_REGION_ERROR) {
-		return -1;
-	}
-	for (uintptr_t current = addr; current < (addr + size); current += HAL_VirtualMM_PageSize) {
-		uintptr_t page = HAL_VirtualMM_UnmapPageAt(space->root, current);
-		if (page != 0) {
-			HAL_PhysicalMM_UserFreeFrame(page);
+		if (lock) {
+			Mutex_Unlock(&(space->mutex));
 		}
+		return -1;
 	}
+	VirtualMM_UnmapAndFreePages(space, addr, addr + size);
 	if (lock) {
 		Mutex_Unlock(&(space->mutex));
 	}
 	if (space == currentSpace) {
-		HAL_VirtualMM_Flush();
+		HAL_VirtualMM_FlushRange(addr, addr + size);
 	}
 	return 0;
 }
 
+static bool VirtualMM_ExtendRegion(struct VirtualMM_RegionTrees *trees, struct VirtualMM_MemoryRegionNode *region,
+								   uintptr_t newEnd) {
+	struct VirtualMM_MemoryRegionNode *next = (struct VirtualMM_MemoryRegionNode *)region->base.base.iter[1];
+	if (next == NULL || next->isUsed || next->base.start != region->base.end || next->base.end < newEnd) {
+		return false;
+	}
+	struct VirtualMM_MemoryRegionNode *extension =
+		VirtualMM_ReserveRegion(trees, region->base.end, newEnd, region->flags);
+	if (extension == NULL) {
+		return false;
+	}
+	RedBlackTree_Remove(&(trees->regionsTreeRoot), (struct RedBlackTree_Node *)extension);
+	ObjectCache_Free(&m_regionNodesCache, extension);
+	region->base.end = newEnd;
+	region->base.size = region->base.end - region->base.start;
+	return true;
+}
+
+static uintptr_t VirtualMM_MoveRegion(struct VirtualMM_AddressSpace *space, struct VirtualMM_MemoryRegionNode *region,
+									  size_t newSize) {
+	struct VirtualMM_MemoryRegionNode *newRegion = VirtualMM_AllocateRegion(&(space->trees), newSize, region->flags);
+	if (newRegion == NULL) {
+		return 0;
+	}
+	newRegion->flags = region->flags;
+	newRegion->type = region->type;
+	newRegion->file = region->file;
+	newRegion->fileOffset = region->fileOffset;
+	if (region->type == VIRTUALMM_REGION_TYPE_FILE) {
+		File_Ref(region->file);
+	}
+	uintptr_t oldStart = region->base.start;
+	uintptr_t oldEnd = region->base.end;
+	uintptr_t newStart = newRegion->base.start;
+	// frames are mapped at the new place first, so that failure leaves the old mapping intact
+	for (uintptr_t offset = 0; offset < oldEnd - oldStart; offset += HAL_VirtualMM_PageSize) {
+		HAL_PhysicalMM_Address frame = HAL_VirtualMM_GetFrame(space->root, oldStart + offset);
+		if (frame == 0) {
+			continue;
+		}
+		if (!HAL_VirtualMM_MapPageAt(space->root, newStart + offset, frame, region->flags)) {
+			HAL_VirtualMM_UnmapRange(space->root, newStart, newStart + offset, NULL, NULL);
+			VirtualMM_FreeRegion(&(space->trees), newStart, newStart + newSize);
+			return 0;
+		}
+	}
+	// old region is released before its pages are unmapped, so that failure can still be rolled back
+	if (VirtualMM_FreeRegion(&(space->trees), oldStart, oldEnd) != VIRTUALMM_FREE_REGION_SUCCESS) {
+		HAL_VirtualMM_UnmapRange(space->root, newStart, newStart + (oldEnd - oldStart), NULL, NULL);
+		VirtualMM_FreeRegion(&(space->trees), newStart, newStart + newSize);
+		return 0;
+	}
+	HAL_VirtualMM_UnmapRange(space->root, oldStart, oldEnd, NULL, NULL);
+	if (space == VirtualMM_GetCurrentAddressSpace()) {
+		HAL_VirtualMM_FlushRange(oldStart, oldEnd);
+		HAL_VirtualMM_FlushRange(newStart, newStart + newSize);
+	}
+	return newStart;
+}
+
+uintptr_t VirtualMM_MemoryRemap(struct VirtualMM_AddressSpace *space, uintptr_t addr, size_t oldSize, size_t newSize,
+								bool mayMove, bool lock) {
+	if (space == NULL) {
+		space = VirtualMM_GetCurrentAddressSpace();
+	}
+	if (lock) {
+		Mutex_Lock(&(space->mutex));
+	}
+	struct VirtualMM_MemoryRegionNode *region = VirtualMM_MemoryGetRegionByAddress(&(space->trees), addr);
+	uintptr_t result = 0;
+	if (region == NULL || !(region->isUsed) || region->pinCount != 0 || region->base.start != addr ||
+		region->base.size != oldSize || newSize == 0) {
+		result = 0;
+	} else if (newSize <= oldSize) {
+		result = addr;
+		if (newSize < oldSize && VirtualMM_MemoryUnmap(space, addr + newSize, oldSize - newSize, false) != 0) {
+			result = 0;
+		}
+	} else {
+		// pages of eager regions are all mapped, so grown part can be populated on demand instead
+		int type = region->type;
+		if (type == VIRTUALMM_REGION_TYPE_EAGER) {
+			region->type = VIRTUALMM_REGION_TYPE_DEMAND_ZERO;
+		}
+		if (VirtualMM_ExtendRegion(&(space->trees), region, addr + newSize)) {
+			result = addr;
+		} else if (mayMove) {
+			result = VirtualMM_MoveRegion(space, region, newSize);
+		}
+		if (result == 0) {
+			region->type = type;
+		}
+	}
+	if (lock) {
+		Mutex_Unlock(&(space->mutex));
+	}
+	return result;
+}
+
 void VirtualMM_MemoryRetype(struct VirtualMM_AddressSpace *space, struct VirtualMM_MemoryRegionNode *region,
 							int flags) {
 	struct VirtualMM_AddressSpace *currentSpace = VirtualMM_GetCurrentAddressSpace();
@@ -436,11 +759,9 @@ void VirtualMM_MemoryRetype(struct VirtualMM_AddressSpace *space, struct Virtual
 		space = currentSpace;
 	}
 	region->flags = flags;
-	for (uintptr_t current = region->base.start; current < region->base.end; current += HAL_VirtualMM_PageSize) {
-		HAL_VirtualMM_SetPageAttributes(space->root, current, flags);
-	}
+	HAL_VirtualMM_ProtectRange(space->root, region->base.start, region->base.end, flags);
 	if (space == currentSpace) {
-		HAL_VirtualMM_Flush();
+		HAL_VirtualMM_FlushRange(region->base.start, region->base.end);
 	}
 }
 
@@ -527,68 +848,193 @@ void VirtualMM_PreemptToAddressSpace(struct VirtualMM_AddressSpace *space) {
 	HAL_VirtualMM_SwitchToAddressSpace(space->root);
 }
 
-static void VirtualMM_CopyPageAcrossAddessSpaces(struct VirtualMM_AddressSpace *src, struct VirtualMM_AddressSpace *dst,
-												 char *buf, uintptr_t addr, uintptr_t size) {
-
-	memcpy((void *)buf, (void *)addr, size);
-	VirtualMM_SwitchToAddressSpace(dst);
-	memcpy((void *)addr, (void *)buf, size);
-	VirtualMM_SwitchToAddressSpace(src);
-}
-
-#define VIRTUALMM_COPY_BUFFER_SIZE 0x100000
-
-static void VirtualMM_CopyPagesAcrossAddressSpaces(struct VirtualMM_AddressSpace *src,
-												   struct VirtualMM_AddressSpace *dst, char *buf, uintptr_t start,
-												   uintptr_t end) {
-	for (uintptr_t addr = start; addr < end; addr += VIRTUALMM_COPY_BUFFER_SIZE) {
-		size_t size = VIRTUALMM_COPY_BUFFER_SIZE;
-		if ((end - addr) < size) {
-			size = end - addr;
-		}
-		VirtualMM_CopyPageAcrossAddessSpaces(src, dst, buf, addr, size);
-	}
-}
-
 struct VirtualMM_AddressSpace *VirtualMM_CopyCurrentAddressSpace() {
-	char *copyBuffer = Heap_AllocateMemory(VIRTUALMM_COPY_BUFFER_SIZE);
-	if (copyBuffer == NULL) {
-		return NULL;
-	}
 	struct VirtualMM_AddressSpace *newSpace = VirtualMM_MakeNewAddressSpace();
 	if (newSpace == NULL) {
-		Heap_FreeMemory(copyBuffer, VIRTUALMM_COPY_BUFFER_SIZE);
 		return NULL;
 	}
 	struct VirtualMM_AddressSpace *currentSpace = VirtualMM_GetCurrentAddressSpace();
 	Mutex_Lock(&(currentSpace->mutex));
 	struct RedBlackTree_Node *current = currentSpace->trees.regionsTreeRoot.ends[0];
-	while (current != NULL) {
+	bool failed = false;
+	while (current != NULL && !failed) {
 		struct VirtualMM_MemoryRegionNode *region = (struct VirtualMM_MemoryRegionNode *)current;
 		if (region->isUsed) {
-			if (!VirtualMM_MemoryMap(newSpace, region->base.start, region->base.size,
-									 HAL_VIRT_FLAGS_WRITABLE | HAL_VIRT_FLAGS_READABLE, false)) {
-				Heap_FreeMemory(copyBuffer, VIRTUALMM_COPY_BUFFER_SIZE);
-				VirtualMM_DropAddressSpace(newSpace);
-				return NULL;
+			// frames are shared with the child and copied on the first write from either side
+			struct VirtualMM_MemoryRegionNode *newRegion = VirtualMM_ReserveRegion(
+				&(newSpace->trees), region->base.start, region->base.end, region->flags);
+			if (newRegion != NULL) {
+				newRegion->type = region->type;
+				newRegion->file = region->file;
+				newRegion->fileOffset = region->fileOffset;
+				if (region->type == VIRTUALMM_REGION_TYPE_FILE) {
+					File_Ref(region->file);
+				}
+			}
+			// shared mappings are populated in the child from the same object on demand
+			if (newRegion == NULL) {
+				failed = true;
+			} else if ((region->flags & HAL_VIRT_FLAGS_SHARED) == 0) {
+				failed = !HAL_VirtualMM_ShareCopyOnWrite(currentSpace->root, newSpace->root, region->base.start,
+														 region->base.end);
 			}
 		}
 		current = current->iter[1];
 	}
-	current = currentSpace->trees.regionsTreeRoot.ends[0];
-	while (current != NULL) {
-		struct VirtualMM_MemoryRegionNode *region = (struct VirtualMM_MemoryRegionNode *)current;
-		if (region->isUsed) {
-			int oldType = region->flags;
-			VirtualMM_MemoryRetype(currentSpace, region, HAL_VIRT_FLAGS_WRITABLE | HAL_VIRT_FLAGS_READABLE);
-			VirtualMM_CopyPagesAcrossAddressSpaces(currentSpace, newSpace, copyBuffer, region->base.start,
-												   region->base.end);
-			VirtualMM_MemoryRetype(currentSpace, region, oldType);
-			VirtualMM_MemoryRetype(newSpace, region, region->flags);
-		}
-		current = current->iter[1];
-	}
-	Heap_FreeMemory(copyBuffer, VIRTUALMM_COPY_BUFFER_SIZE);
+	HAL_VirtualMM_Flush();
 	Mutex_Unlock(&(currentSpace->mutex));
+	if (failed) {
+		VirtualMM_DropAddressSpace(newSpace);
+		return NULL;
+	}
 	return newSpace;
 }
+
+enum { VIRTUALMM_ACCESS_READ, VIRTUALMM_ACCESS_WRITE, VIRTUALMM_ACCESS_ZERO };
+
+static bool VirtualMM_AccessAddressSpace(struct VirtualMM_AddressSpace *space, uintptr_t addr, char *buf, size_t size,
+										 int mode) {
+	if (addr < HAL_VirtualMM_UserAreaStart || addr + size > HAL_VirtualMM_UserAreaEnd || addr + size < addr) {
+		return false;
+	}
+	Mutex_Lock(&(space->mutex));
+	while (size > 0) {
+		uintptr_t page = ALIGN_DOWN(addr, HAL_VirtualMM_PageSize);
+		size_t chunk = page + HAL_VirtualMM_PageSize - addr;
+		if (chunk > size) {
+			chunk = size;
+		}
+		int attributes = HAL_VirtualMM_GetPageAttributes(space->root, page);
+		if (attributes == 0) {
+			if (!VirtualMM_PopulatePage(space, page)) {
+				Mutex_Unlock(&(space->mutex));
+				return false;
+			}
+			attributes = HAL_VirtualMM_GetPageAttributes(space->root, page);
+		}
+		if (mode != VIRTUALMM_ACCESS_READ) {
+			if ((attributes & HAL_VIRT_FLAGS_WRITABLE) == 0) {
+				Mutex_Unlock(&(space->mutex));
+				return false;
+			}
+			HAL_VirtualMM_ResolveCopyOnWrite(space->root, page);
+			// write into frame that is still shared would be visible to its other owners
+			if (HAL_VirtualMM_IsCopyOnWrite(space->root, page)) {
+				Mutex_Unlock(&(space->mutex));
+				return false;
+			}
+		}
+		HAL_PhysicalMM_Address frame = HAL_VirtualMM_GetFrame(space->root, page);
+		if (frame == 0) {
+			Mutex_Unlock(&(space->mutex));
+			return false;
+		}
+		char *window = HAL_VirtualMM_MapWindow(frame);
+		char *pointer = window + (addr - page);
+		if (mode == VIRTUALMM_ACCESS_READ) {
+			memcpy(buf, pointer, chunk);
+		} else if (mode == VIRTUALMM_ACCESS_WRITE) {
+			memcpy(pointer, buf, chunk);
+		} else {
+			memset(pointer, 0, chunk);
+		}
+		HAL_VirtualMM_UnmapWindow(window);
+		addr += chunk;
+		size -= chunk;
+		if (buf != NULL) {
+			buf += chunk;
+		}
+	}
+	Mutex_Unlock(&(space->mutex));
+	return true;
+}
+
+bool VirtualMM_CopyToAddressSpace(struct VirtualMM_AddressSpace *space, uintptr_t addr, const void *buf, size_t size) {
+	return VirtualMM_AccessAddressSpace(space, addr, (char *)buf, size, VIRTUALMM_ACCESS_WRITE);
+}
+
+bool VirtualMM_CopyFromAddressSpace(struct VirtualMM_AddressSpace *space, void *buf, uintptr_t addr, size_t size) {
+	return VirtualMM_AccessAddressSpace(space, addr, (char *)buf, size, VIRTUALMM_ACCESS_READ);
+}
+
+bool VirtualMM_ZeroInAddressSpace(struct VirtualMM_AddressSpace *space, uintptr_t addr, size_t size) {
+	return VirtualMM_AccessAddressSpace(space, addr, NULL, size, VIRTUALMM_ACCESS_ZERO);
+}
+
+static void VirtualMM_UnpinRegions(struct VirtualMM_AddressSpace *space, uintptr_t start, uintptr_t end) {
+	struct VirtualMM_MemoryRegionNode *region = VirtualMM_MemoryGetRegionByAddress(&(space->trees), start);
+	while (region != NULL && region->base.start < end) {
+		region->pinCount--;
+		region = (struct VirtualMM_MemoryRegionNode *)region->base.base.iter[1];
+	}
+}
+
+bool VirtualMM_PinUserRange(struct VirtualMM_AddressSpace *space, uintptr_t start, size_t size, bool write) {
+	if (space == NULL) {
+		space = VirtualMM_GetCurrentAddressSpace();
+	}
+	uintptr_t end = start + size;
+	if (start < HAL_VirtualMM_UserAreaStart || end > HAL_VirtualMM_UserAreaEnd || end < start) {
+		return false;
+	}
+	if (size == 0) {
+		return true;
+	}
+	int required = write ? HAL_VIRT_FLAGS_WRITABLE : (HAL_VIRT_FLAGS_READABLE | HAL_VIRT_FLAGS_WRITABLE);
+	Mutex_Lock(&(space->mutex));
+	uintptr_t pinnedEnd = start;
+	struct VirtualMM_MemoryRegionNode *region = VirtualMM_MemoryGetRegionByAddress(&(space->trees), start);
+	while (pinnedEnd < end) {
+		if (region == NULL || !(region->isUsed) || (region->flags & HAL_VIRT_FLAGS_USER_ACCESSIBLE) == 0 ||
+			(region->flags & required) == 0) {
+			break;
+		}
+		region->pinCount++;
+		pinnedEnd = region->base.end;
+		region = (struct VirtualMM_MemoryRegionNode *)region->base.base.iter[1];
+	}
+	bool result = pinnedEnd >= end;
+	for (uintptr_t page = ALIGN_DOWN(start, HAL_VirtualMM_PageSize); result && page < end;
+		 page += HAL_VirtualMM_PageSize) {
+		if (HAL_VirtualMM_GetPageAttributes(space->root, page) == 0 && !VirtualMM_PopulatePage(space, page)) {
+			result = false;
+		} else if (write) {
+			HAL_VirtualMM_ResolveCopyOnWrite(space->root, page);
+			// callers write pinned range directly and rely on its pages being private
+			result = !HAL_VirtualMM_IsCopyOnWrite(space->root, page);
+		}
+	}
+	if (!result) {
+		VirtualMM_UnpinRegions(space, start, pinnedEnd);
+	}
+	Mutex_Unlock(&(space->mutex));
+	return result;
+}
+
+void VirtualMM_UnpinUserRange(struct VirtualMM_AddressSpace *space, uintptr_t start, size_t size) {
+	if (space == NULL) {
+		space = VirtualMM_GetCurrentAddressSpace();
+	}
+	if (size == 0) {
+		return;
+	}
+	Mutex_Lock(&(space->mutex));
+	VirtualMM_UnpinRegions(space, start, start + size);
+	Mutex_Unlock(&(space->mutex));
+}
+
+bool VirtualMM_HandlePageFault(uintptr_t addr, bool write) {
+	if (addr < HAL_VirtualMM_UserAreaStart || addr >= HAL_VirtualMM_UserAreaEnd) {
+		return false;
+	}
+	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
+	if (write && HAL_VirtualMM_ResolveCopyOnWrite(space->root, addr)) {
+		return true;
+	}
+	// kernel accesses user buffers without address space lock held, so its faults on them are resolved here as well
+	Mutex_Lock(&(space->mutex));
+	bool result = HAL_VirtualMM_GetPageAttributes(space->root, ALIGN_DOWN(addr, HAL_VirtualMM_PageSize)) == 0 &&
+				  VirtualMM_PopulatePage(space, addr);
+	Mutex_Unlock(&(space->mutex));
+	return result;
+}
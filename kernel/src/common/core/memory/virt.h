@@ -1,6 +1,7 @@
 #ifndef __VIRT_H_INCLUDED__
-#define __VIRT_H_i686_Ports_ReadDoubleWordCUDED__
+#define __VIRT_H_INCLUDED__
 
+#include <common/core/fd/fd.h>
 #include <common/core/proc/mutex.h>
 #include <common/lib/rbtree.h>
 #include <common/misc/utils.h>
@@ -17,10 +18,26 @@ struct VirtualMM_MemoryHoleNode {
 	struct VirtualMM_MemoryRegionNode *correspondingRegion;
 };
 
+enum {
+	// all pages are mapped when region is created
+	VIRTUALMM_REGION_TYPE_EAGER = 0,
+	// pages are mapped to zeroed frames on first access
+	VIRTUALMM_REGION_TYPE_DEMAND_ZERO = 1,
+	// pages are mapped from the page cache of the file on first access. Writes go to private copies
+	VIRTUALMM_REGION_TYPE_FILE = 2,
+	// same as demand zero, but large pages are used for parts of region that cover them entirely
+	VIRTUALMM_REGION_TYPE_DEMAND_ZERO_LARGE = 3,
+};
+
 struct VirtualMM_MemoryRegionNode {
 	struct VirtualMM_MemoryRegionBase base;
 	struct VirtualMM_MemoryHoleNode *correspondingHole;
 	int flags;
+	int type;
+	struct File *file;
+	off_t fileOffset;
+	// pinned regions can't be unmapped or moved
+	size_t pinCount;
 	bool isUsed;
 };
 
@@ -39,7 +56,23 @@ struct VirtualMM_AddressSpace {
 struct VirtualMM_AddressSpace *VirtualMM_GetCurrentAddressSpace();
 struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMap(struct VirtualMM_AddressSpace *space, uintptr_t addr,
 													   size_t size, int flags, bool lock);
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapZeroed(struct VirtualMM_AddressSpace *space, uintptr_t addr,
+															 size_t size, int flags, bool lock);
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapDemandZero(struct VirtualMM_AddressSpace *space, uintptr_t addr,
+																 size_t size, int flags, bool lock);
+// Region is placed at large page boundary if addr is zero
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapDemandZeroLarge(struct VirtualMM_AddressSpace *space,
+																	  uintptr_t addr, size_t size, int flags,
+																	  bool lock);
+struct VirtualMM_MemoryRegionNode *VirtualMM_MemoryMapFile(struct VirtualMM_AddressSpace *space, uintptr_t addr,
+														   size_t size, int flags, struct File *file, off_t offset,
+														   bool lock);
+bool VirtualMM_PopulatePage(struct VirtualMM_AddressSpace *space, uintptr_t addr);
 int VirtualMM_MemoryUnmap(struct VirtualMM_AddressSpace *space, uintptr_t addr, size_t size, bool lock);
+// Resizes the whole region starting at addr. Region is grown in place if it is followed by enough free space,
+// otherwise its pages are moved to the new place if mayMove is set. Returns new start or 0 on failure
+uintptr_t VirtualMM_MemoryRemap(struct VirtualMM_AddressSpace *space, uintptr_t addr, size_t oldSize, size_t newSize,
+								bool mayMove, bool lock);
 void VirtualMM_MemoryRetype(struct VirtualMM_AddressSpace *space, struct VirtualMM_MemoryRegionNode *region, int flags);
 struct VirtualMM_AddressSpace *VirtualMM_MakeAddressSpaceFromRoot(uintptr_t root);
 void VirtualMM_DropAddressSpace(struct VirtualMM_AddressSpace *space);
@@ -48,5 +81,15 @@ struct VirtualMM_AddressSpace *VirtualMM_MakeNewAddressSpace();
 void VirtualMM_SwitchToAddressSpace(struct VirtualMM_AddressSpace *space);
 void VirtualMM_PreemptToAddressSpace(struct VirtualMM_AddressSpace *space);
 struct VirtualMM_AddressSpace *VirtualMM_CopyCurrentAddressSpace();
+// Access memory of the address space through kernel mapping windows, without switching to it. Writes are allowed
+// to writable pages only
+bool VirtualMM_CopyToAddressSpace(struct VirtualMM_AddressSpace *space, uintptr_t addr, const void *buf, size_t size);
+bool VirtualMM_CopyFromAddressSpace(struct VirtualMM_AddressSpace *space, void *buf, uintptr_t addr, size_t size);
+bool VirtualMM_ZeroInAddressSpace(struct VirtualMM_AddressSpace *space, uintptr_t addr, size_t size);
+// Populates pages of the user range and keeps regions that contain it in place until the range is unpinned, so that
+// the kernel, filesystems and devices can access the range directly. With write set, the pages are made private
+bool VirtualMM_PinUserRange(struct VirtualMM_AddressSpace *space, uintptr_t start, size_t size, bool write);
+void VirtualMM_UnpinUserRange(struct VirtualMM_AddressSpace *space, uintptr_t start, size_t size);
+bool VirtualMM_HandlePageFault(uintptr_t addr, bool write);
 
 #endif
@@ -0,0 +1,98 @@
+#include <common/core/memory/zeropool.h>
+#include <common/core/proc/mutex.h>
+#include <hal/memory/phys.h>
+#include <hal/memory/virt.h>
+
+#define ZEROPOOL_CAPACITY 1024
+#define ZEROPOOL_REFILL_BATCH 64
+
+static HAL_PhysicalMM_Address m_frames[ZEROPOOL_CAPACITY];
+static size_t m_framesCount;
+static size_t m_hits;
+static size_t m_misses;
+static struct Mutex m_mutex;
+
+void ZeroPool_Initialize() {
+	Mutex_Initialize(&m_mutex);
+	m_framesCount = 0;
+	m_hits = 0;
+	m_misses = 0;
+}
+
+bool ZeroPool_AllocFrames(HAL_PhysicalMM_Address *frames, size_t count) {
+	Mutex_Lock(&m_mutex);
+	size_t fromPool = count;
+	if (fromPool > m_framesCount) {
+		fromPool = m_framesCount;
+	}
+	m_framesCount -= fromPool;
+	memcpy(frames, m_frames + m_framesCount, fromPool * sizeof(HAL_PhysicalMM_Address));
+	m_hits += fromPool;
+	m_misses += count - fromPool;
+	Mutex_Unlock(&m_mutex);
+	if (fromPool == count) {
+		return true;
+	}
+	if (!HAL_PhysicalMM_UserAllocFrames(frames + fromPool, count - fromPool)) {
+		HAL_PhysicalMM_UserFreeFrames(frames, fromPool);
+		return false;
+	}
+	HAL_VirtualMM_ZeroFrames(frames + fromPool, count - fromPool);
+	return true;
+}
+
+bool ZeroPool_Refill() {
+	Mutex_Lock(&m_mutex);
+	size_t count = ZEROPOOL_CAPACITY - m_framesCount;
+	Mutex_Unlock(&m_mutex);
+	if (count == 0) {
+		return false;
+	}
+	if (count > ZEROPOOL_REFILL_BATCH) {
+		count = ZEROPOOL_REFILL_BATCH;
+	}
+	HAL_PhysicalMM_Address frames[ZEROPOOL_REFILL_BATCH];
+	if (!HAL_PhysicalMM_UserAllocFrames(frames, count)) {
+		return false;
+	}
+	HAL_VirtualMM_ZeroFrames(frames, count);
+	Mutex_Lock(&m_mutex);
+	size_t accepted = ZEROPOOL_CAPACITY - m_framesCount;
+	if (accepted > count) {
+		accepted = count;
+	}
+	memcpy(m_frames + m_framesCount, frames, accepted * sizeof(HAL_PhysicalMM_Address));
+	m_framesCount += accepted;
+	Mutex_Unlock(&m_mutex);
+	HAL_PhysicalMM_UserFreeFrames(frames + accepted, count - accepted);
+	return true;
+}
+
+size_t ZeroPool_Release() {
+	HAL_PhysicalMM_Address frames[ZEROPOOL_REFILL_BATCH];
+	size_t released = 0;
+	while (true) {
+		Mutex_Lock(&m_mutex);
+		size_t count = m_framesCount;
+		if (count > ZEROPOOL_REFILL_BATCH) {
+			count = ZEROPOOL_REFILL_BATCH;
+		}
+		m_framesCount -= count;
+		memcpy(frames, m_frames + m_framesCount, count * sizeof(HAL_PhysicalMM_Address));
+		Mutex_Unlock(&m_mutex);
+		if (count == 0) {
+			return released;
+		}
+		HAL_PhysicalMM_UserFreeFrames(frames, count);
+		released += count;
+	}
+}
+
+void ZeroPool_GetStatistics(struct ZeroPool_Statistics *stats) {
+	Mutex_Lock(&m_mutex);
+	stats->framesCount = m_framesCount;
+	stats->capacity = ZEROPOOL_CAPACITY;
+	stats->hits = m_hits;
+	stats->misses = m_misses;
+	Mutex_Unlock(&m_mutex);
+}
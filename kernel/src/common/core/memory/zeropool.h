@@ -0,0 +1,21 @@
+#ifndef __ZEROPOOL_H_INCLUDED__
+#define __ZEROPOOL_H_INCLUDED__
+
+#include <common/misc/utils.h>
+#include <hal/memory/phys.h>
+
+struct ZeroPool_Statistics {
+	size_t framesCount;
+	size_t capacity;
+	size_t hits;
+	size_t misses;
+};
+
+void ZeroPool_Initialize();
+bool ZeroPool_AllocFrames(HAL_PhysicalMM_Address *frames, size_t count);
+bool ZeroPool_Refill();
+// Returns pooled frames to the frame allocator. Returns number of released frames
+size_t ZeroPool_Release();
+void ZeroPool_GetStatistics(struct ZeroPool_Statistics *stats);
+
+#endif
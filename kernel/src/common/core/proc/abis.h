@@ -10,7 +10,14 @@
 #define MAP_SHARED 0x01
 #define MAP_PRIVATE 0x02
 #define MAP_ANON 0x1000
-#define MAP_FIXED 0x1
+#define MAP_FIXED 0x10
+#define MAP_POPULATE 0x8000
+#define MAP_HUGETLB 0x40000
+
+#define MREMAP_MAYMOVE 0x01
+
+#define O_CREAT 0x200
+#define O_EXCL 0x800
 
 #define WNOHANG 1
 #define WUNTRACED 2
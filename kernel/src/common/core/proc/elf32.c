@@ -85,7 +85,7 @@ struct Elf32 *Elf32_Parse(struct File *file, MAYBE_UNUSED Elf32_HeaderVerifyCall
 			Heap_FreeMemory(headers, headersSize);
 			return NULL;
 		}
-		if (headers[i].fileSize > INT_MAX) {
+		if (headers[i].fileSize > INT_MAX || headers[i].fileSize > headers[i].memorySize) {
 			FREE_OBJ(elf);
 			Heap_FreeMemory(headers, headersSize);
 			return NULL;
@@ -98,41 +98,132 @@ struct Elf32 *Elf32_Parse(struct File *file, MAYBE_UNUSED Elf32_HeaderVerifyCall
 	return elf;
 }
 
-bool Elf32_LoadProgramHeaders(struct File *file, struct Elf32 *info) {
-	for (size_t i = 0; i < info->headersCount; ++i) {
-		uintptr_t pageStart = ALIGN_DOWN(info->headers[i].virtualAddress, HAL_VirtualMM_PageSize);
-		uintptr_t pageEnd =
-			ALIGN_UP(info->headers[i].virtualAddress + info->headers[i].memorySize, HAL_VirtualMM_PageSize);
-		struct VirtualMM_MemoryRegionNode *region =
-			VirtualMM_MemoryMap(NULL, pageStart, pageEnd - pageStart, HAL_VIRT_FLAGS_WRITABLE, true);
-		if (region == NULL) {
+static int Elf32_GetSegmentFlags(struct Elf32_ProgramHeader *header) {
+	int flags = HAL_VIRT_FLAGS_USER_ACCESSIBLE;
+	if ((header->flags & PF_R) != 0) {
+		flags |= HAL_VIRT_FLAGS_READABLE;
+	}
+	if ((header->flags & PF_W) != 0) {
+		flags |= HAL_VIRT_FLAGS_WRITABLE;
+	}
+	if ((header->flags & PF_X) != 0) {
+		flags |= HAL_VIRT_FLAGS_EXECUTABLE;
+	}
+	return flags;
+}
+
+static bool Elf32_CanMapLazily(struct Elf32_ProgramHeader *header) {
+	// file pages can only be mapped directly if segment is placed at the same offset within the page
+	return (header->virtualAddress % HAL_VirtualMM_PageSize) == (header->offset % HAL_VirtualMM_PageSize);
+}
+
+static uintptr_t Elf32_GetFileBackedEnd(struct Elf32_ProgramHeader *header) {
+	if (header->fileSize == 0) {
+		return ALIGN_DOWN(header->virtualAddress, HAL_VirtualMM_PageSize);
+	}
+	return ALIGN_UP(header->virtualAddress + header->fileSize, HAL_VirtualMM_PageSize);
+}
+
+static void Elf32_UnmapSegment(struct VirtualMM_AddressSpace *space, struct Elf32_ProgramHeader *header) {
+	uintptr_t pageStart = ALIGN_DOWN(header->virtualAddress, HAL_VirtualMM_PageSize);
+	uintptr_t pageEnd = ALIGN_UP(header->virtualAddress + header->memorySize, HAL_VirtualMM_PageSize);
+	if (!Elf32_CanMapLazily(header)) {
+		VirtualMM_MemoryUnmap(space, pageStart, pageEnd - pageStart, true);
+		return;
+	}
+	uintptr_t fileEnd = Elf32_GetFileBackedEnd(header);
+	if (fileEnd != pageStart) {
+		VirtualMM_MemoryUnmap(space, pageStart, fileEnd - pageStart, true);
+	}
+	if (fileEnd != pageEnd) {
+		VirtualMM_MemoryUnmap(space, fileEnd, pageEnd - fileEnd, true);
+	}
+}
+
+static bool Elf32_LoadSegmentEagerly(struct VirtualMM_AddressSpace *space, struct File *file,
+									 struct Elf32_ProgramHeader *header) {
+	uintptr_t pageStart = ALIGN_DOWN(header->virtualAddress, HAL_VirtualMM_PageSize);
+	uintptr_t pageEnd = ALIGN_UP(header->virtualAddress + header->memorySize, HAL_VirtualMM_PageSize);
+	struct VirtualMM_MemoryRegionNode *region =
+		VirtualMM_MemoryMapZeroed(space, pageStart, pageEnd - pageStart, HAL_VIRT_FLAGS_WRITABLE, true);
+	if (region == NULL) {
+		return false;
+	}
+	char *buf = Heap_AllocateMemory(HAL_VirtualMM_PageSize);
+	if (buf == NULL) {
+		VirtualMM_MemoryUnmap(space, pageStart, pageEnd - pageStart, true);
+		return false;
+	}
+	for (size_t pos = 0; pos < header->fileSize; pos += HAL_VirtualMM_PageSize) {
+		int count = (int)(header->fileSize - pos);
+		if (count > (int)HAL_VirtualMM_PageSize) {
+			count = (int)HAL_VirtualMM_PageSize;
+		}
+		if (File_PRead(file, header->offset + pos, count, buf) != count ||
+			!VirtualMM_CopyToAddressSpace(space, header->virtualAddress + pos, buf, count)) {
+			Heap_FreeMemory(buf, HAL_VirtualMM_PageSize);
+			VirtualMM_MemoryUnmap(space, pageStart, pageEnd - pageStart, true);
 			return false;
 		}
-		memset((void *)pageStart, 0, pageEnd - pageStart);
-		int flags = 0;
-		if ((info->headers[i].flags & PF_R) != 0) {
-			flags |= HAL_VIRT_FLAGS_READABLE;
+	}
+	Heap_FreeMemory(buf, HAL_VirtualMM_PageSize);
+	VirtualMM_MemoryRetype(space, region, Elf32_GetSegmentFlags(header));
+	return true;
+}
+
+static bool Elf32_LoadSegmentLazily(struct VirtualMM_AddressSpace *space, struct File *file,
+									struct Elf32_ProgramHeader *header) {
+	uintptr_t pageStart = ALIGN_DOWN(header->virtualAddress, HAL_VirtualMM_PageSize);
+	uintptr_t pageEnd = ALIGN_UP(header->virtualAddress + header->memorySize, HAL_VirtualMM_PageSize);
+	uintptr_t fileEnd = Elf32_GetFileBackedEnd(header);
+	uintptr_t dataEnd = header->virtualAddress + header->fileSize;
+	int flags = Elf32_GetSegmentFlags(header);
+	struct VirtualMM_MemoryRegionNode *fileRegion = NULL;
+	if (fileEnd != pageStart) {
+		off_t offset = header->offset - (header->virtualAddress - pageStart);
+		fileRegion = VirtualMM_MemoryMapFile(space, pageStart, fileEnd - pageStart, flags | HAL_VIRT_FLAGS_WRITABLE,
+											 file, offset, true);
+		if (fileRegion == NULL) {
+			return false;
 		}
-		if ((info->headers[i].flags & PF_W) != 0) {
-			flags |= HAL_VIRT_FLAGS_WRITABLE;
+	}
+	if (fileEnd != pageEnd) {
+		if (VirtualMM_MemoryMapDemandZero(space, fileEnd, pageEnd - fileEnd, flags, true) == NULL) {
+			if (fileRegion != NULL) {
+				VirtualMM_MemoryUnmap(space, pageStart, fileEnd - pageStart, true);
+			}
+			return false;
 		}
-		if ((info->headers[i].flags & PF_X) != 0) {
-			flags |= HAL_VIRT_FLAGS_EXECUTABLE;
+	}
+	if (fileRegion == NULL) {
+		return true;
+	}
+	// last file page is shared with whatever follows the segment in the file. If it is a part of BSS,
+	// its tail is cleared in a private copy
+	if (header->memorySize > header->fileSize && dataEnd != fileEnd) {
+		if (!VirtualMM_ZeroInAddressSpace(space, dataEnd, fileEnd - dataEnd)) {
+			Elf32_UnmapSegment(space, header);
+			return false;
 		}
-		flags |= HAL_VIRT_FLAGS_USER_ACCESSIBLE;
-		if (File_PReadUser(file, info->headers[i].offset, info->headers[i].fileSize,
-						   (char *)(info->headers[i].virtualAddress)) != (int)(info->headers[i].fileSize)) {
-			goto failure;
+	}
+	VirtualMM_MemoryRetype(space, fileRegion, flags);
+	return true;
+}
+
+bool Elf32_LoadProgramHeaders(struct VirtualMM_AddressSpace *space, struct File *file, struct Elf32 *info) {
+	for (size_t i = 0; i < info->headersCount; ++i) {
+		bool loaded;
+		if (Elf32_CanMapLazily(info->headers + i)) {
+			loaded = Elf32_LoadSegmentLazily(space, file, info->headers + i);
+		} else {
+			loaded = Elf32_LoadSegmentEagerly(space, file, info->headers + i);
 		}
-		VirtualMM_MemoryRetype(NULL, region, flags);
-		continue;
-	failure:
-		for (size_t j = 0; j < i; ++j) {
-			uintptr_t start = info->headers[j].virtualAddress;
-			uintptr_t end = ALIGN_UP(start + info->headers[j].memorySize, HAL_VirtualMM_PageSize);
-			VirtualMM_MemoryUnmap(NULL, start, end - start, true);
+		if (!loaded) {
+			for (size_t j = 0; j < i; ++j) {
+				Elf32_UnmapSegment(space, info->headers + j);
+			}
+			return false;
 		}
-		return false;
 	}
 	return true;
 }
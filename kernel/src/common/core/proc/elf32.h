@@ -2,6 +2,7 @@
 #define __ELF32_H_INCLUDED__
 
 #include <common/core/fd/fd.h>
+#include <common/core/memory/virt.h>
 #include <common/lib/dynarray.h>
 #include <common/misc/types.h>
 
@@ -44,7 +45,7 @@ struct Elf32 {
 typedef bool (*Elf32_HeaderVerifyCallback)(struct Elf32_Header *);
 
 struct Elf32 *Elf32_Parse(struct File *file, Elf32_HeaderVerifyCallback callback);
-bool Elf32_LoadProgramHeaders(struct File *file, struct Elf32 *info);
+bool Elf32_LoadProgramHeaders(struct VirtualMM_AddressSpace *space, struct File *file, struct Elf32 *info);
 void Elf32_Dispose(struct Elf32 *info);
 
 #endif
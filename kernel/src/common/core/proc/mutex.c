@@ -33,6 +33,17 @@ void Mutex_Lock(struct Mutex *mutex) {
 	HAL_InterruptLevel_Recover(level);
 }
 
+bool Mutex_TryLock(struct Mutex *mutex) {
+	if (!Proc_IsInitialized()) {
+		return true;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	bool result = !(mutex->locked);
+	mutex->locked = true;
+	HAL_InterruptLevel_Recover(level);
+	return result;
+}
+
 void Mutex_Unlock(struct Mutex *mutex) {
 	if (!Proc_IsInitialized()) {
 		return;
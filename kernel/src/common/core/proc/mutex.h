@@ -11,6 +11,8 @@ struct Mutex {
 
 void Mutex_Initialize(struct Mutex *mutex);
 void Mutex_Lock(struct Mutex *mutex);
+// Locks the mutex only if it can be done without waiting
+bool Mutex_TryLock(struct Mutex *mutex);
 void Mutex_Unlock(struct Mutex *mutex);
 bool Mutex_IsAnyProcessWaiting(struct Mutex *mutex);
 bool Mutex_IsLocked(struct Mutex *mutex);
@@ -1,6 +1,7 @@
 #include <common/core/fd/cwd.h>
 #include <common/core/fd/fdtable.h>
 #include <common/core/memory/heap.h>
+#include <common/core/memory/objcache.h>
 #include <common/core/memory/virt.h>
 #include <common/core/proc/proc.h>
 #include <common/core/proc/proclayout.h>
@@ -22,6 +23,7 @@ static struct Proc_Process *m_CurrentProcess;
 static struct Proc_Process *m_deallocQueueHead;
 static struct Proc_Process *m_deallocQueueTail;
 static bool m_procInitialized = false;
+static struct ObjectCache m_processesCache = OBJECT_CACHE_INITIALIZER("Proc_Process", struct Proc_Process, NULL);
 
 #define PROC_SCHEDULER_STACK_SIZE 65536
 static char Proc_SchedulerStack[PROC_SCHEDULER_STACK_SIZE];
@@ -68,7 +70,7 @@ static struct Proc_ProcessID Proc_AllocateProcessID(struct Proc_Process *process
 }
 
 struct Proc_ProcessID Proc_MakeNewProcess(struct Proc_ProcessID parent) {
-	struct Proc_Process *process = ALLOC_OBJ(struct Proc_Process);
+	struct Proc_Process *process = ObjectCache_Allocate(&m_processesCache);
 	if (process == NULL) {
 		goto fail;
 	}
@@ -92,6 +94,7 @@ struct Proc_ProcessID Proc_MakeNewProcess(struct Proc_ProcessID parent) {
 	process->next = process->prev = process->waitQueueHead = process->waitQueueTail = process->nextInQueue = NULL;
 	process->ppid = parent;
 	process->pid = new_id;
+	process->vforkParent = PROC_INVALID_PROC_ID;
 	process->processState = processState;
 	process->extendedState = extendedState;
 	if ((uintptr_t)(process->extendedState) % 16 != 0) {
@@ -115,7 +118,7 @@ free_process_state:
 free_stack:
 	Heap_FreeMemory((void *)stack, PROC_KERNEL_STACK_SIZE);
 free_process_obj:
-	FREE_OBJ(process);
+	ObjectCache_Free(&m_processesCache, process);
 fail:;
 	struct Proc_ProcessID failed_id;
 	failed_id.instanceNumber = 0;
@@ -228,6 +231,7 @@ void Proc_Exit(int exitCode) {
 	m_instanceCountsByID[process->pid.id]++;
 	m_processesByID[process->pid.id] = NULL;
 	process->state = ZOMBIE;
+	Proc_ReleaseVforkParent();
 	struct Proc_ProcessID parentID = process->ppid;
 	struct Proc_Process *parentProcess = Proc_GetProcessData(parentID);
 	if (parentProcess == NULL) {
@@ -280,6 +284,35 @@ struct Proc_Process *Proc_WaitForChildTermination(bool returnImmediately) {
 	return result;
 }
 
+void Proc_WaitForVforkChild(struct Proc_ProcessID child) {
+	struct Proc_Process *childProcess = Proc_GetProcessData(child);
+	if (childProcess == NULL) {
+		return;
+	}
+	int level = HAL_InterruptLevel_Elevate();
+	struct Proc_Process *process = m_CurrentProcess;
+	childProcess->vforkParent = process->pid;
+	process->state = WAITING_FOR_VFORK_CHILD;
+	Proc_Resume(child);
+	Proc_SuspendSelf(false);
+	HAL_InterruptLevel_Recover(level);
+}
+
+void Proc_ReleaseVforkParent() {
+	int level = HAL_InterruptLevel_Elevate();
+	struct Proc_Process *process = m_CurrentProcess;
+	if (!Proc_IsValidProcessID(process->vforkParent)) {
+		HAL_InterruptLevel_Recover(level);
+		return;
+	}
+	struct Proc_Process *parentProcess = Proc_GetProcessData(process->vforkParent);
+	if (parentProcess != NULL && parentProcess->state == WAITING_FOR_VFORK_CHILD) {
+		Proc_Resume(process->vforkParent);
+	}
+	process->vforkParent = PROC_INVALID_PROC_ID;
+	HAL_InterruptLevel_Recover(level);
+}
+
 void Proc_Yield() {
 	HAL_Timer_TriggerInterrupt();
 }
@@ -354,6 +387,6 @@ bool Proc_PollDisposeQueue() {
 	if (process->cwd != NULL) {
 		File_Drop(process->cwd);
 	}
-	FREE_OBJ(process);
+	ObjectCache_Free(&m_processesCache, process);
 	return true;
 }
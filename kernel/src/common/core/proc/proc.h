@@ -27,6 +27,8 @@ void Proc_SuspendSelf(bool overrideState);
 void Proc_Suspend(struct Proc_ProcessID id, bool overrideState);
 void Proc_Resume(struct Proc_ProcessID id);
 struct Proc_Process *Proc_WaitForChildTermination(bool returnImmediately);
+void Proc_WaitForVforkChild(struct Proc_ProcessID child);
+void Proc_ReleaseVforkParent();
 void Proc_InsertChildBack(struct Proc_Process *process);
 struct Proc_Process *Proc_GetProcessData(struct Proc_ProcessID id);
 
@@ -8,6 +8,8 @@
 
 struct Proc_Process {
 	struct Proc_ProcessID pid, ppid;
+	// parent that waits for this process to exec or exit
+	struct Proc_ProcessID vforkParent;
 	struct Proc_Process *next, *prev;
 	struct Proc_Process *waitQueueHead;
 	struct Proc_Process *waitQueueTail;
@@ -19,7 +21,7 @@ struct Proc_Process {
 	struct File *cwd;
 	uintptr_t kernelStack;
 	int returnCode;
-	enum { SLEEPING, RUNNING, WAITING_FOR_CHILD_TERM, ZOMBIE } state;
+	enum { SLEEPING, RUNNING, WAITING_FOR_CHILD_TERM, WAITING_FOR_VFORK_CHILD, ZOMBIE } state;
 	bool terminatedNormally;
 	size_t childCount;
 };
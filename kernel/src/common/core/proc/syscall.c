@@ -1,3 +1,4 @@
+#include <common/core/devices/shm.h>
 #include <common/core/fd/cwd.h>
 #include <common/core/fd/fdtable.h>
 #include <common/core/fd/vfs.h>
@@ -22,23 +23,14 @@
 
 int Syscall_Open(uintptr_t pathAddr, int perms) {
 	struct Proc_Process *thisProcess = Proc_GetProcessData(Proc_GetProcessID());
-	struct VirtualMM_AddressSpace *space = VirtualMM_GetCurrentAddressSpace();
-	Mutex_Lock(&(space->mutex));
-	int pathLen = MemorySecurity_VerifyCString(pathAddr, MAX_PATH_LEN, MSECURITY_UR);
-	if (pathLen == -1) {
-		return -1;
-	}
-	char *pathCopy = Heap_AllocateMemory(pathLen + 1);
+	int pathLen;
+	char *pathCopy = MemorySecurity_CopyStringFromUser(pathAddr, MAX_PATH_LEN, &pathLen);
 	if (pathCopy == NULL) {
-		Mutex_Unlock(&(space->mutex));
 		return -1;
 	}
-	memcpy(pathCopy, (void *)pathAddr, pathLen);
-	pathCopy[pathLen] = '\0';
-	Mutex_Unlock(&(space->mutex));
 	struct File *file = VFS_OpenAt(thisProcess->cwd, pathCopy, perms);
+	Heap_FreeMemory(pathCopy, pathLen + 1);
 	if (file == NULL) {
-		Heap_FreeMemory(pathCopy, pathLen + 1);
 		return -1;
 	}
 	int result = FileTable_AllocateFileSlot(NULL, file);
@@ -48,3 +40,34 @@ int Syscall_Open(uintptr_t pathAddr, int perms) {
 	}
 	return result;
 }
+
+int Syscall_SharedMemoryOpen(uintptr_t nameAddr, int flags) {
+	int nameLen;
+	char *nameCopy = MemorySecurity_CopyStringFromUser(nameAddr, VFS_MAX_NAME_LENGTH + 1, &nameLen);
+	if (nameCopy == NULL) {
+		return -1;
+	}
+	struct File *file =
+		SharedMemory_Open(nameCopy, flags & VFS_O_ACCMODE, (flags & O_CREAT) != 0, (flags & O_EXCL) != 0);
+	Heap_FreeMemory(nameCopy, nameLen + 1);
+	if (file == NULL) {
+		return -1;
+	}
+	int result = FileTable_AllocateFileSlot(NULL, file);
+	if (result == -1) {
+		File_Drop(file);
+		return -1;
+	}
+	return result;
+}
+
+int Syscall_SharedMemoryUnlink(uintptr_t nameAddr) {
+	int nameLen;
+	char *nameCopy = MemorySecurity_CopyStringFromUser(nameAddr, VFS_MAX_NAME_LENGTH + 1, &nameLen);
+	if (nameCopy == NULL) {
+		return -1;
+	}
+	bool result = SharedMemory_Unlink(nameCopy);
+	Heap_FreeMemory(nameCopy, nameLen + 1);
+	return result ? 0 : -1;
+}
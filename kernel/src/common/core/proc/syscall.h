@@ -11,6 +11,8 @@ int Syscall_Write(int fd, uintptr_t bufAddr, int size);
 int Syscall_Close(int fd);
 uintptr_t Syscall_MemoryMap(uintptr_t addr, size_t size, int prot, int flags);
 void Syscall_MemoryUnmap(uintptr_t addr, size_t size);
+int Syscall_SharedMemoryOpen(uintptr_t nameAddr, int flags);
+int Syscall_SharedMemoryUnlink(uintptr_t nameAddr);
 int Syscall_Fork();
 /*
 int Syscall_Execve(struct CPUState *state);
@@ -454,6 +454,15 @@ static uint16_t NVMEExecuteIOCommand(struct NVMEDrive *drive, union NVME_SQEntry
 	return drive->completitionQueue->status;
 }
 
+// Buffers are either in the kernel heap or in pinned user pages that are transferred to without bounce buffers
+static uint64_t NVME_GetBufferPhysicalAddress(uintptr_t addr) {
+	if (addr >= HAL_VirtualMM_KernelMappingBase) {
+		return (uint64_t)(addr - HAL_VirtualMM_KernelMappingBase);
+	}
+	uintptr_t page = ALIGN_DOWN(addr, HAL_VirtualMM_PageSize);
+	return (uint64_t)(HAL_VirtualMM_GetFrame(HAL_VirtualMM_GetCurrentAddressSpace(), page) + (addr - page));
+}
+
 static bool NVME_ReadWriteLBA(struct NVMEDrive *drive, size_t ns, void *buf, uint64_t lba, size_t count, bool write) {
 	Mutex_Lock(&(drive->mutex));
 	struct nvme_drive_namespace *namespace = drive->namespaces + (ns - 1);
@@ -477,17 +486,16 @@ static bool NVME_ReadWriteLBA(struct NVMEDrive *drive, size_t ns, void *buf, uin
 	size_t prpEntriesCount = ((alignedUp - alignedDown) / HAL_VirtualMM_PageSize) - 1;
 
 	if (prpEntriesCount == 0) {
-		rwCommand.rw.prp1 = (uint64_t)((uintptr_t)buf - HAL_VirtualMM_KernelMappingBase);
+		rwCommand.rw.prp1 = NVME_GetBufferPhysicalAddress((uintptr_t)buf);
 	} else if (prpEntriesCount == 1) {
-		rwCommand.rw.prp1 = (uint64_t)((uintptr_t)buf - HAL_VirtualMM_KernelMappingBase);
-		rwCommand.rw.prp2 =
-			(uint64_t)((uintptr_t)buf - HAL_VirtualMM_KernelMappingBase - page_offset + HAL_VirtualMM_PageSize);
+		rwCommand.rw.prp1 = NVME_GetBufferPhysicalAddress((uintptr_t)buf);
+		rwCommand.rw.prp2 = NVME_GetBufferPhysicalAddress((uintptr_t)buf - page_offset + HAL_VirtualMM_PageSize);
 	} else {
-		rwCommand.rw.prp1 = (uint64_t)((uintptr_t)buf - HAL_VirtualMM_KernelMappingBase);
+		rwCommand.rw.prp1 = NVME_GetBufferPhysicalAddress((uintptr_t)buf);
 		rwCommand.rw.prp2 = (uint64_t)((uintptr_t)(drive->prps) - HAL_VirtualMM_KernelMappingBase);
 		for (size_t i = 0; i < prpEntriesCount; ++i) {
-			drive->prps[i] = (uint64_t)((uintptr_t)buf - HAL_VirtualMM_KernelMappingBase - page_offset +
-										(i + 1) * HAL_VirtualMM_PageSize);
+			drive->prps[i] =
+				NVME_GetBufferPhysicalAddress((uintptr_t)buf - page_offset + (i + 1) * HAL_VirtualMM_PageSize);
 		}
 	}
 
@@ -3,9 +3,27 @@
 
 #include <common/misc/utils.h>
 
+enum {
+	HAL_PHYS_ARENA_KERNEL = 0,
+	HAL_PHYS_ARENA_USER = 1,
+	HAL_PHYS_ARENAS_COUNT = 2,
+};
+
+// Physical addresses can be wider than pointers, as user frames may lie above 4 GiB
+typedef uint64_t HAL_PhysicalMM_Address;
+
+extern const size_t HAL_PhysicalMM_OrdersCount;
+
+// Kernel areas are always reachable from the kernel mapping base, so their addresses fit into pointers
 uintptr_t HAL_PhysicalMM_KernelAllocArea(uintptr_t size);
 void HAL_PhysicalMM_KernelFreeArea(uintptr_t area, size_t size);
-uintptr_t HAL_PhysicalMM_UserAllocFrame();
-void HAL_PhysicalMM_UserFreeFrame(uintptr_t frame);
+HAL_PhysicalMM_Address HAL_PhysicalMM_UserAllocFrame();
+void HAL_PhysicalMM_UserFreeFrame(HAL_PhysicalMM_Address frame);
+bool HAL_PhysicalMM_UserAllocFrames(HAL_PhysicalMM_Address *frames, size_t count);
+void HAL_PhysicalMM_UserFreeFrames(HAL_PhysicalMM_Address *frames, size_t count);
+// Contiguous area aligned to its size rounded up to power of two
+HAL_PhysicalMM_Address HAL_PhysicalMM_UserAllocArea(size_t size);
+void HAL_PhysicalMM_UserFreeArea(HAL_PhysicalMM_Address area, size_t size);
+size_t HAL_PhysicalMM_GetFreeBlocksCount(int arena, size_t order);
 
 #endif
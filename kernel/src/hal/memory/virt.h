@@ -2,6 +2,7 @@
 #define __HAL_VIRT_H_INCLUDED__
 
 #include <common/misc/utils.h>
+#include <hal/memory/phys.h>
 
 enum {
 	HAL_VIRT_FLAGS_WRITABLE = 1,
@@ -9,6 +10,14 @@ enum {
 	HAL_VIRT_FLAGS_EXECUTABLE = 4,
 	HAL_VIRT_FLAGS_DISABLE_CACHE = 8,
 	HAL_VIRT_FLAGS_USER_ACCESSIBLE = 16,
+	// writable mappings of frames that have other owners are not copy-on-write
+	HAL_VIRT_FLAGS_SHARED = 32,
+};
+
+struct HAL_VirtualMM_FlushStatistics {
+	size_t fullFlushes;
+	size_t rangedFlushes;
+	size_t invalidatedPages;
 };
 
 extern const uintptr_t HAL_VirtualMM_KernelMappingBase;
@@ -17,16 +26,60 @@ extern const uintptr_t HAL_VirtualMM_UserAreaEnd;
 extern const uintptr_t HAL_VirtualMM_IOMappingsStart;
 extern const uintptr_t HAL_VirtualMM_IOMappingsEnd;
 extern const size_t HAL_VirtualMM_PageSize;
+extern const size_t HAL_VirtualMM_LargePageSize;
 
 uintptr_t HAL_VirtualMM_MakeNewAddressSpace();
 void HAL_VirtualMM_FreeAddressSpace(uintptr_t root);
 void HAL_VirtualMM_SwitchToAddressSpace(uintptr_t root);
 uintptr_t HAL_VirtualMM_GetCurrentAddressSpace();
 
-bool HAL_VirtualMM_MapPageAt(uintptr_t root, uintptr_t vaddr, uintptr_t paddr, int flags);
-uintptr_t HAL_VirtualMM_UnmapPageAt(uintptr_t root, uintptr_t vaddr);
+// Frame is passed with size of the page that mapped it
+typedef void (*HAL_VirtualMM_UnmapCallback)(HAL_PhysicalMM_Address frame, size_t size, void *ctx);
+
+bool HAL_VirtualMM_MapPageAt(uintptr_t root, uintptr_t vaddr, HAL_PhysicalMM_Address paddr, int flags);
+HAL_PhysicalMM_Address HAL_VirtualMM_UnmapPageAt(uintptr_t root, uintptr_t vaddr);
 void HAL_VirtualMM_SetPageAttributes(uintptr_t root, uintptr_t vaddr, int flags);
+// Range versions walk each page table once. MapRange returns count of pages mapped before page table allocation
+// failed. UnmapRange calls back for every frame that was mapped in the range
+size_t HAL_VirtualMM_MapRange(uintptr_t root, uintptr_t vaddr, const HAL_PhysicalMM_Address *frames, size_t count,
+							  int flags);
+void HAL_VirtualMM_ProtectRange(uintptr_t root, uintptr_t start, uintptr_t end, int flags);
+void HAL_VirtualMM_UnmapRange(uintptr_t root, uintptr_t start, uintptr_t end, HAL_VirtualMM_UnmapCallback callback,
+							  void *ctx);
+// Unmaps the whole user area and frees its page tables without keeping page table bookkeeping up to date
+void HAL_VirtualMM_ClearUserArea(uintptr_t root, HAL_VirtualMM_UnmapCallback callback, void *ctx);
+// Large pages map naturally aligned physically contiguous areas of HAL_VirtualMM_LargePageSize bytes in user area.
+// Page functions above split large page into small pages when they are applied to its part
+bool HAL_VirtualMM_CanMapLargePageAt(uintptr_t root, uintptr_t vaddr);
+bool HAL_VirtualMM_MapLargePageAt(uintptr_t root, uintptr_t vaddr, HAL_PhysicalMM_Address paddr, int flags);
+// Returns area that was mapped or 0 if there is no large page at vaddr
+HAL_PhysicalMM_Address HAL_VirtualMM_UnmapLargePageAt(uintptr_t root, uintptr_t vaddr);
 int HAL_VirtualMM_GetPageAttributes(uintptr_t root, uintptr_t vaddr);
 void HAL_VirtualMM_Flush();
+// Invalidates translations for the range of the current address space. Long ranges are flushed entirely
+void HAL_VirtualMM_FlushRange(uintptr_t start, uintptr_t end);
+void HAL_VirtualMM_GetFlushStatistics(struct HAL_VirtualMM_FlushStatistics *stats);
+void HAL_VirtualMM_ZeroFrames(HAL_PhysicalMM_Address *frames, size_t count);
+// Window is a temporary kernel mapping of the frame. Only one window can be held at a time and it should be
+// released without blocking
+void *HAL_VirtualMM_MapWindow(HAL_PhysicalMM_Address frame);
+void HAL_VirtualMM_UnmapWindow(void *window);
+// Returns frame that backs the page, including pages that are not accessible
+HAL_PhysicalMM_Address HAL_VirtualMM_GetFrame(uintptr_t root, uintptr_t vaddr);
+// Accessors for user memory of the current address space. Faults that can't be resolved make them fail instead of
+// panicking. Callers should check that the range is inside the user area and should not hold address space lock
+size_t HAL_VirtualMM_CopyUser(void *dst, const void *src, size_t size);
+int HAL_VirtualMM_CopyUserString(char *dst, const char *src, size_t maxLength);
+int HAL_VirtualMM_UserStringLength(const char *src, size_t maxLength);
+
+bool HAL_VirtualMM_ShareCopyOnWrite(uintptr_t srcRoot, uintptr_t dstRoot, uintptr_t start, uintptr_t end);
+bool HAL_VirtualMM_ResolveCopyOnWrite(uintptr_t root, uintptr_t vaddr);
+// Page stays copy-on-write if resolving it failed to allocate a private copy. Such page is reported as writable
+bool HAL_VirtualMM_IsCopyOnWrite(uintptr_t root, uintptr_t vaddr);
+// Frame with no references recorded has a single owner. Mapping frame that has other owners makes it copy-on-write
+void HAL_VirtualMM_ReferenceFrame(HAL_PhysicalMM_Address frame);
+// Returns true if there are no other mappings of the frame left and it can be freed
+bool HAL_VirtualMM_DropFrameReference(HAL_PhysicalMM_Address frame);
+bool HAL_VirtualMM_IsFrameShared(HAL_PhysicalMM_Address frame);
 
 #endif
@@ -20,14 +20,20 @@
 #define MAP_FIXED 0x10
 #define MAP_ANON 0x1000
 #define MAP_FILE 0x0000
+#define MAP_POPULATE 0x8000
+#define MAP_HUGETLB 0x40000
 #define MAP_FAIL ((void *)-1)
 
+#define MREMAP_MAYMOVE 0x01
+
 #define WNOHANG 1
 #define WUNTRACED 2
 
 #define O_RDONLY 0
 #define O_WRONLY 1
 #define O_RDWR 2
+#define O_CREAT 0x200
+#define O_EXCL 0x800
 
 #define EXIT_SUCCESS 0
 #define EXIT_FAILURE -1
@@ -46,7 +52,9 @@ int close(int fd);
 void exit(int exitCode);
 void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
 int munmap(void *addr, size_t length);
+void *mremap(void *oldAddress, size_t oldSize, size_t newSize, int flags);
 int fork();
+int vfork();
 int execve(const char *fname, char const *argp[], char const *envp[]);
 int wait4(int pid, int *wstatus, int options, struct rusage *rusage);
 int getdents(int fd, struct dirent *entries, int count);
@@ -55,6 +63,8 @@ int chdir(const char *path);
 int fchdir(int fd);
 int getpid();
 int getppid();
+int shm_open(const char *name, int oflag);
+int shm_unlink(const char *name);
 
 #define DT_UNKNOWN 0
 #define DT_FIFO 1
@@ -24,5 +24,18 @@ make_syscall execve, 59
 make_syscall gettimeofday, 67
 make_syscall munmap, 73
 make_syscall getdents, 99
+make_syscall mremap, 163
 make_syscall mmap, 197
+
+; child runs on the same stack until execve, so return address can not be kept there
+global vfork
+vfork:
+    pop ecx
+    mov eax, 190
+    int 0x80
+    push ecx
+    ret
+
 make_syscall getcwd, 304
+make_syscall shm_open, 482
+make_syscall shm_unlink, 483
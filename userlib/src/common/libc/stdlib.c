@@ -150,6 +150,15 @@ static void __Heap_FreeAnon(uintptr_t addr, size_t size) {
 	munmap((void *)addr, ALIGN_UP(size, __Platform_PageSize));
 }
 
+static uintptr_t __Heap_ResizeAnon(uintptr_t addr, size_t oldSize, size_t newSize) {
+	uintptr_t result = (uintptr_t)mremap((void *)addr, ALIGN_UP(oldSize, __Platform_PageSize),
+										 ALIGN_UP(newSize, __Platform_PageSize), MREMAP_MAYMOVE);
+	if (result == (uintptr_t)-1) {
+		return 0;
+	}
+	return result;
+}
+
 static bool __Heap_MakeSlub(size_t sizeclass) {
 	uintptr_t blk = __Heap_AllocAnon(BLOCK_SIZE);
 	if (blk == 0) {
@@ -320,6 +329,21 @@ void *realloc(void *ptr, size_t size) {
 	if (size <= capacity) {
 		return ptr;
 	}
+	if (__Heap_GetSlub(hdr) == NULL && size <= (size_t)-1 - sizeof(struct Heap_ObjHeader) - __Platform_PageSize) {
+		// large objects are grown in place or moved by the kernel without copying
+		size_t effectiveSize = ALIGN_UP(size + sizeof(struct Heap_ObjHeader), __Platform_PageSize);
+		struct Heap_ObjHeader *newHdr =
+			(struct Heap_ObjHeader *)__Heap_ResizeAnon((uintptr_t)hdr, hdr->effectiveSize, effectiveSize);
+		if (newHdr != NULL) {
+			newHdr->effectiveSize = effectiveSize;
+#if MALLOC_CHECKS
+			__Heap_UnregisterRange(newHdr->range);
+			newHdr->range = __Heap_RegisterRange(((uintptr_t)newHdr) + sizeof(struct Heap_ObjHeader), size);
+			__Heap_SetSlub(newHdr, NULL);
+#endif
+			return (void *)(((uintptr_t)newHdr) + sizeof(struct Heap_ObjHeader));
+		}
+	}
 	void *newArea = malloc(size);
 	if (newArea == NULL) {
 		return NULL;
@@ -156,10 +156,11 @@ int main(int argc, char const *argv[], char const *envp[]) {
 		if (argc == 0) {
 			continue;
 		}
-		int pid = fork();
+		int pid = vfork();
 		if (pid == 0) {
 			execve(filename, argv, envp);
 			Log_ErrorMsg("Shell", "Failed to start \"%s\"", filename);
+			exit(-1);
 		} else {
 			int result = wait4(-1, &wstatus, 0, NULL);
 			if (result != pid) {